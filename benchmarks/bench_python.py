@@ -0,0 +1,127 @@
+"""
+Python callback 路径的 benchmark, 输出与 msgbus_bench 相同格式的 JSON
+
+C++ MockCppProducer 生产 Trade, 订阅者在 Python 回调里消费. 对每种订阅方式
+(逐条 callback, NumPy 批量, 消费线程池) 和订阅者数量测端到端吞吐, 丢失数以及
+hub.stats() 里单次 callback 耗时的分位数.
+
+    python benchmarks/bench_python.py [--quick] [--messages N] [--cpp build/msgbus_bench] [--out FILE]
+
+--cpp 给出 msgbus_bench 的路径时先运行 C++ 套件, 把两部分结果合并成一个文档.
+"""
+
+import argparse
+import gc
+import json
+import os
+import subprocess
+import sys
+import threading
+import time
+
+import msgbus
+
+
+def run_case(mode, subscribers, lossless, messages):
+    hub = msgbus.MarketDataHub(queue_size=4096, worker_threads=2 if mode == "pool" else 0)
+    last = messages - 1
+    done = [False] * subscribers
+    finished = threading.Event()
+    lock = threading.Lock()
+
+    # 每个订阅者看到最后一条 (timestamp == messages - 1, 不会被覆盖) 即完成
+    def mark_done(index):
+        with lock:
+            done[index] = True
+            if all(done):
+                finished.set()
+
+    def make_callback(index):
+        if mode == "batch_numpy":
+            def on_batch(data_type, batch):
+                if len(batch) and batch["timestamp"][-1] == last:
+                    mark_done(index)
+            return on_batch
+
+        def on_trade(data_type, trade):
+            if trade["timestamp"] == last:
+                mark_done(index)
+        return on_trade
+
+    for i in range(subscribers):
+        if mode == "batch_numpy":
+            hub.subscribe_batch(msgbus.DataType.TRADE, make_callback(i), max_batch=1024,
+                                as_numpy=True, wait=msgbus.WaitStrategy.YIELD, lossless=lossless)
+        else:
+            hub.subscribe(msgbus.DataType.TRADE, make_callback(i), wait=msgbus.WaitStrategy.YIELD,
+                          lossless=lossless)
+    time.sleep(0.05)
+
+    producer = msgbus.MockCppProducer(hub)
+    begin = time.perf_counter()
+    producer.start(messages)
+    producer.wait()
+    produced = time.perf_counter()
+    finished.wait(timeout=10 if lossless else 2)
+    consumed = time.perf_counter()
+
+    stats = hub.stats()
+    hub.stop_all()
+
+    received = sum(s["delivered"] for s in stats.values())
+    lost = sum(s["lost"] for s in stats.values())
+    worst = max(stats.values(), key=lambda s: s["callback_p99_ns"])
+    return {
+        "producer_mps": messages / (produced - begin) / 1e6,
+        "consumer_mps": received / subscribers / (consumed - begin) / 1e6,
+        "received": received,
+        "lost": lost,
+        # 单次 callback 的耗时 (批量模式为一批), 取最慢的订阅者
+        "latency_ns": {
+            "p50": worst["callback_p50_ns"],
+            "p99": worst["callback_p99_ns"],
+            "p99_9": worst["callback_p999_ns"],
+            "max": worst["callback_max_ns"],
+        },
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--quick", action="store_true", help="fewer cases and messages")
+    parser.add_argument("--messages", type=int, default=0, help="messages per case")
+    parser.add_argument("--cpp", help="path to msgbus_bench, its results are merged in")
+    parser.add_argument("--out", help="write JSON here instead of stdout")
+    args = parser.parse_args()
+
+    messages = args.messages or (50000 if args.quick else 500000)
+    subscriber_counts = [1, 4] if args.quick else [1, 2, 4, 8]
+
+    doc = {"suite": "msgbus", "format": 1, "host": {"cpus": os.cpu_count()},
+           "config": {"messages": messages, "quick": args.quick}, "results": []}
+    if args.cpp:
+        cmd = [args.cpp, "--messages", str(messages)] + (["--quick"] if args.quick else [])
+        doc = json.loads(subprocess.run(cmd, check=True, stdout=subprocess.PIPE, text=True).stdout)
+
+    gc.disable()
+    for mode in ("callback", "batch_numpy", "pool"):
+        for subscribers in subscriber_counts:
+            for lossless in (False, True):
+                if mode == "pool" and lossless:
+                    continue  # 无损订阅总是使用独立线程
+                params = {"path": "python_" + mode, "subscribers": subscribers, "lossless": lossless}
+                print(f"python {json.dumps(params)}", file=sys.stderr)
+                result = {"benchmark": "hub", "params": params}
+                result.update(run_case(mode, subscribers, lossless, messages))
+                doc["results"].append(result)
+
+    text = json.dumps(doc, indent=1)
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(text + "\n")
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,566 @@
+// Parameterized benchmark suite for SPMCQueue and MarketDataHub.
+//
+// Sweeps payload size, queue capacity, reader count, reader wait strategy and CPU pinning
+// topology for the raw queue, then runs MarketDataHub end to end through the C++ handler
+// path and the std::function callback path (the one Python callbacks use, minus the GIL).
+// Results go to stdout (or --out) as one JSON document; benchmarks/bench_python.py measures
+// the Python callback path in the same format and benchmarks/compare_results.py diffs two runs.
+//
+//   msgbus_bench [--quick] [--messages N] [--rate MPS] [--filter SUBSTR] [--out FILE]
+
+#include "market_data_hub.hpp"
+#include "spmc.hpp"
+#include "statistic.hpp"
+#include "thread_placement.hpp"
+#include "tsc_clock.hpp"
+#include "wait_strategy.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using marketdata::MarketDataHub;
+using marketdata::ThreadPlacement;
+using marketdata::WaitStrategy;
+
+namespace {
+
+struct Config {
+    uint64_t messages = 2000000;
+    double rate = 0;  // producer messages per second, 0 = as fast as possible
+    bool quick = false;
+    std::string filter;
+    std::string out;
+};
+
+constexpr uint32_t kHubQueueSize = marketdata::kDefaultQueueSize;
+
+enum class Topology { NONE, COMPACT, SPREAD };
+
+const char* topology_name(Topology t) {
+    switch (t) {
+        case Topology::NONE: return "none";
+        case Topology::COMPACT: return "compact";
+        case Topology::SPREAD: return "spread";
+    }
+    return "unknown";
+}
+
+const char* wait_name(WaitStrategy w) {
+    switch (w) {
+        case WaitStrategy::BUSY_SPIN: return "busy_spin";
+        case WaitStrategy::PAUSE_SPIN: return "pause_spin";
+        case WaitStrategy::YIELD: return "yield";
+        case WaitStrategy::SLEEP: return "sleep";
+        case WaitStrategy::BLOCKING: return "blocking";
+    }
+    return "unknown";
+}
+
+// Thread 0 is the producer, 1..n the readers. compact packs them onto consecutive CPUs,
+// spread spaces them evenly over the machine (different cores / sockets where possible).
+// Returns false when the machine has fewer CPUs than threads.
+bool placements(Topology topology, uint32_t threads, std::vector<ThreadPlacement>& out) {
+    out.assign(threads, ThreadPlacement{});
+    if (topology == Topology::NONE) {
+        return true;
+    }
+    uint32_t cpus = std::thread::hardware_concurrency();
+    if (cpus < threads) {
+        return false;
+    }
+    uint32_t step = topology == Topology::COMPACT ? 1 : cpus / threads;
+    for (uint32_t i = 0; i < threads; ++i) {
+        out[i].cpus = {static_cast<int>(i * step)};
+    }
+    return true;
+}
+
+// Minimal JSON object builder, enough for flat results with nested objects
+class Json {
+public:
+    Json& add(const std::string& key, const std::string& value) {
+        return raw(key, "\"" + value + "\"");
+    }
+    Json& add(const std::string& key, const char* value) {
+        return add(key, std::string(value));
+    }
+    Json& add(const std::string& key, bool value) {
+        return raw(key, value ? "true" : "false");
+    }
+    Json& add(const std::string& key, double value) {
+        std::ostringstream os;
+        os.precision(6);
+        os << std::fixed << value;
+        return raw(key, os.str());
+    }
+    Json& add(const std::string& key, uint64_t value) {
+        return raw(key, std::to_string(value));
+    }
+    Json& add(const std::string& key, uint32_t value) {
+        return raw(key, std::to_string(value));
+    }
+    Json& add(const std::string& key, const Json& value) {
+        return raw(key, value.str());
+    }
+    Json& raw(const std::string& key, const std::string& value) {
+        body_ += (body_.empty() ? "" : ", ") + ("\"" + key + "\": ") + value;
+        return *this;
+    }
+    std::string str() const {
+        return "{" + body_ + "}";
+    }
+
+private:
+    std::string body_;
+};
+
+Json latency_json(const Histogram<>& h) {
+    Json j;
+    j.add("p50", h.percentile(50))
+     .add("p90", h.percentile(90))
+     .add("p99", h.percentile(99))
+     .add("p99_9", h.percentile(99.9))
+     .add("p99_99", h.percentile(99.99))
+     .add("max", h.max())
+     .add("mean", h.mean());
+    return j;
+}
+
+// What every case reports
+struct CaseResult {
+    bool ok = true;
+    std::string skipped;  // reason when !ok
+    double producer_seconds = 0;
+    double consumer_seconds = 0;  // slowest reader, first to last message
+    uint64_t received = 0;        // summed over readers
+    uint64_t lost = 0;
+    Histogram<> latency;          // merged over readers
+};
+
+std::string result_json(const std::string& benchmark, const Json& params, const CaseResult& r,
+                        uint64_t messages, uint32_t readers) {
+    Json j;
+    j.add("benchmark", benchmark).add("params", params);
+    if (!r.ok) {
+        j.add("skipped", r.skipped);
+        return j.str();
+    }
+    j.add("producer_mps", messages / r.producer_seconds / 1e6)
+     .add("consumer_mps", r.consumer_seconds > 0 ? r.received / readers / r.consumer_seconds / 1e6 : 0.0)
+     .add("received", r.received)
+     .add("lost", r.lost)
+     .add("latency_ns", latency_json(r.latency));
+    return j.str();
+}
+
+// Producer pacing: spin until message i is due
+class Pacer {
+public:
+    explicit Pacer(double rate) : ticks_per_msg_(rate > 0 ? TscClock::instance().ticks_per_ns() * 1e9 / rate : 0) {}
+
+    void start() {
+        begin_ = TscClock::now();
+    }
+
+    void wait(uint64_t i) const {
+        if (ticks_per_msg_ <= 0) {
+            return;
+        }
+        uint64_t due = begin_ + static_cast<uint64_t>(i * ticks_per_msg_);
+        while (TscClock::now() < due) {
+            marketdata::cpu_relax();
+        }
+    }
+
+private:
+    double ticks_per_msg_;
+    uint64_t begin_ = 0;
+};
+
+// Per-reader state, filled by the reader thread and merged afterwards
+struct ReaderState {
+    Histogram<> latency;
+    uint64_t received = 0;
+    uint64_t lost = 0;
+    uint64_t first_tick = 0;
+    uint64_t last_tick = 0;
+    std::atomic<bool> done{false};
+};
+
+void merge_readers(std::vector<std::unique_ptr<ReaderState>>& states, CaseResult& r) {
+    const TscClock& clock = TscClock::instance();
+    for (auto& s : states) {
+        r.latency.merge(s->latency);
+        r.received += s->received;
+        r.lost += s->lost;
+        if (s->last_tick > s->first_tick) {
+            r.consumer_seconds = std::max(r.consumer_seconds, clock.ns(s->last_tick - s->first_tick) / 1e9);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// Raw SPMCQueue
+
+template <size_t N>
+struct Payload {
+    static_assert(N > 16, "payload holds a timestamp and an index");
+    uint64_t ts_ticks;
+    uint64_t idx;
+    char pad[N - 16];
+};
+
+template <class T>
+CaseResult run_queue(const Config& config, uint32_t capacity, uint32_t readers, WaitStrategy wait,
+                     Topology topology) {
+    CaseResult result;
+    std::vector<ThreadPlacement> place;
+    if (!placements(topology, readers + 1, place)) {
+        result.ok = false;
+        result.skipped = "not enough CPUs";
+        return result;
+    }
+
+    DynamicSPMCQueue<T> q(capacity, false);
+    marketdata::WakeupNotifier notifier;  // unused: BLOCKING is not swept for the raw queue
+    std::atomic<uint32_t> ready{0};
+    std::atomic<bool> producer_done{false};
+    const uint64_t messages = config.messages;
+    const TscClock& clock = TscClock::instance();
+
+    std::vector<std::unique_ptr<ReaderState>> states;
+    std::vector<std::unique_ptr<std::thread>> threads;
+    for (uint32_t r = 0; r < readers; ++r) {
+        states.push_back(std::make_unique<ReaderState>());
+        ReaderState* state = states.back().get();
+        auto reader = q.getReader();
+        threads.push_back(marketdata::start_placed_thread(place[r + 1], [&, state, reader]() mutable {
+            marketdata::IdleWaiter waiter(wait, notifier);
+            T msg;
+            ready.fetch_add(1);
+            while (true) {
+                auto res = reader.readCopy(msg);
+                if (!res) {
+                    if (producer_done.load(std::memory_order_acquire) && reader.empty()) {
+                        break;
+                    }
+                    waiter.idle([] { return true; });
+                    continue;
+                }
+                waiter.reset();
+                uint64_t now = TscClock::now();
+                if (state->received == 0) {
+                    state->first_tick = now;
+                }
+                state->last_tick = now;
+                state->latency.add(clock.ns(now - msg.ts_ticks));
+                state->received++;
+                state->lost += res.lost;
+                if (msg.idx == messages - 1) {
+                    break;
+                }
+            }
+        }));
+    }
+
+    while (ready.load() != readers) {
+        std::this_thread::yield();
+    }
+
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    auto producer = marketdata::start_placed_thread(place[0], [&] {
+        Pacer pacer(config.rate);
+        pacer.start();
+        begin = TscClock::now();
+        for (uint64_t i = 0; i < messages; ++i) {
+            pacer.wait(i);
+            q.write([i](T& msg) {
+                msg.ts_ticks = TscClock::now();
+                msg.idx = i;
+            });
+        }
+        end = TscClock::now();
+        producer_done.store(true, std::memory_order_release);
+    });
+    producer->join();
+    for (auto& t : threads) {
+        t->join();
+    }
+
+    result.producer_seconds = clock.ns(end - begin) / 1e9;
+    merge_readers(states, result);
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------
+// MarketDataHub end to end: producer emplace() -> queue -> subscriber thread -> consumer
+
+// C++ handler: called directly with the typed message, timestamps carried in Trade fields
+struct LatencyHandler {
+    ReaderState* state;
+    uint64_t last_idx;
+
+    void on_trade(const marketdata::Trade& trade) {
+        uint64_t now = TscClock::now();
+        if (state->received == 0) {
+            state->first_tick = now;
+        }
+        state->last_tick = now;
+        state->latency.add(TscClock::instance().ns(now - trade.timestamp));
+        state->received++;
+        if (static_cast<uint64_t>(trade.price) == last_idx) {
+            state->done.store(true, std::memory_order_release);
+        }
+    }
+};
+
+enum class HubPath { HANDLER, CALLBACK };
+
+CaseResult run_hub(const Config& config, HubPath path, uint32_t capacity, uint32_t subscribers, WaitStrategy wait,
+                   Topology topology, bool lossless) {
+    CaseResult result;
+    std::vector<ThreadPlacement> place;
+    if (!placements(topology, subscribers + 1, place)) {
+        result.ok = false;
+        result.skipped = "not enough CPUs";
+        return result;
+    }
+
+    marketdata::HubOptions options;
+    options.queue_size = capacity;
+    options.huge_pages = false;
+    options.producer_wait = WaitStrategy::PAUSE_SPIN;
+    MarketDataHub hub(options);
+
+    const uint64_t messages = config.messages;
+    std::vector<std::unique_ptr<ReaderState>> states;
+    for (uint32_t s = 0; s < subscribers; ++s) {
+        states.push_back(std::make_unique<ReaderState>());
+        ReaderState* state = states.back().get();
+        marketdata::SubscribeOptions sub;
+        sub.wait = wait;
+        sub.placement = place[s + 1];
+        sub.lossless = lossless;
+        sub.dedicated_thread = true;
+        LatencyHandler handler{state, messages - 1};
+        if (path == HubPath::HANDLER) {
+            hub.subscribe(handler, sub);
+        } else {
+            hub.subscribe(marketdata::DataType::TRADE, [handler](marketdata::DataType, const void* data) mutable {
+                handler.on_trade(*static_cast<const marketdata::Trade*>(data));
+            }, sub);
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));  // let subscriber threads reach their loop
+
+    const TscClock& clock = TscClock::instance();
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    auto producer = marketdata::start_placed_thread(place[0], [&] {
+        Pacer pacer(config.rate);
+        pacer.start();
+        begin = TscClock::now();
+        for (uint64_t i = 0; i < messages; ++i) {
+            pacer.wait(i);
+            hub.emplace<marketdata::Trade>("BTCUSDT", [i](marketdata::Trade& trade) {
+                trade.timestamp = TscClock::now();
+                trade.price = static_cast<double>(i);
+                trade.quantity = 1.0;
+                trade.is_buyer_maker = false;
+            });
+        }
+        end = TscClock::now();
+    });
+    producer->join();
+
+    // A lossy subscriber may never see the last message; give up once everyone is caught up
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (std::chrono::steady_clock::now() < deadline) {
+        bool all_done = true;
+        for (auto& stats : hub.stats()) {
+            all_done = all_done && stats.lag == 0;
+        }
+        for (auto& s : states) {
+            all_done = all_done && s->done.load(std::memory_order_acquire);
+        }
+        if (all_done) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (auto& stats : hub.stats()) {
+        result.lost += stats.lost;
+    }
+    hub.stop_all();
+
+    result.producer_seconds = clock.ns(end - begin) / 1e9;
+    uint64_t lost = result.lost;
+    merge_readers(states, result);
+    result.lost = lost;  // the hub's counters, ReaderState does not see overruns
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------
+
+bool parse_args(int argc, char** argv, Config& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument(arg + " needs a value");
+            }
+            return argv[++i];
+        };
+        if (arg == "--quick") {
+            config.quick = true;
+        } else if (arg == "--messages") {
+            config.messages = std::stoull(value());
+        } else if (arg == "--rate") {
+            config.rate = std::stod(value());
+        } else if (arg == "--filter") {
+            config.filter = value();
+        } else if (arg == "--out") {
+            config.out = value();
+        } else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--quick] [--messages N] [--rate MPS] [--filter SUBSTR] [--out FILE]" << std::endl;
+            return false;
+        }
+    }
+    if (config.messages == 0) {
+        throw std::invalid_argument("--messages must be > 0");
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Config config;
+    try {
+        if (!parse_args(argc, argv, config)) {
+            return 2;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+    if (config.quick && config.messages == Config().messages) {
+        config.messages = 200000;
+    }
+
+    const TscClock& clock = TscClock::instance();
+    std::vector<std::string> results;
+    auto record = [&](const std::string& benchmark, const Json& params, std::function<CaseResult()> run,
+                      uint32_t readers) {
+        std::string name = benchmark + " " + params.str();
+        if (!config.filter.empty() && name.find(config.filter) == std::string::npos) {
+            return;
+        }
+        std::cerr << name << std::endl;
+        CaseResult r;
+        try {
+            r = run();
+        } catch (const std::exception& e) {
+            r.ok = false;
+            r.skipped = e.what();
+        }
+        results.push_back(result_json(benchmark, params, r, config.messages, readers));
+    };
+
+    const std::vector<uint32_t> reader_counts = config.quick ? std::vector<uint32_t>{1, 4}
+                                                             : std::vector<uint32_t>{1, 2, 4, 8};
+    const std::vector<uint32_t> capacities = config.quick ? std::vector<uint32_t>{512}
+                                                          : std::vector<uint32_t>{256, 4096, 65536};
+    const std::vector<WaitStrategy> waits = config.quick
+        ? std::vector<WaitStrategy>{WaitStrategy::BUSY_SPIN}
+        : std::vector<WaitStrategy>{WaitStrategy::BUSY_SPIN, WaitStrategy::PAUSE_SPIN, WaitStrategy::YIELD};
+    const std::vector<Topology> topologies = config.quick
+        ? std::vector<Topology>{Topology::NONE}
+        : std::vector<Topology>{Topology::NONE, Topology::COMPACT, Topology::SPREAD};
+
+    auto queue_case = [&](auto payload_tag) {
+        using T = typename decltype(payload_tag)::type;
+        const uint32_t payload = sizeof(T);
+        for (uint32_t capacity : capacities) {
+            for (uint32_t readers : reader_counts) {
+                for (WaitStrategy wait : waits) {
+                    for (Topology topology : topologies) {
+                        Json params;
+                        params.add("payload_bytes", payload)
+                              .add("block_bytes", static_cast<uint64_t>(DynamicSPMCQueue<T>::kBlockSize))
+                              .add("capacity", capacity)
+                              .add("readers", readers)
+                              .add("wait", wait_name(wait))
+                              .add("topology", topology_name(topology));
+                        record("queue", params, [&] {
+                            return run_queue<T>(config, capacity, readers, wait, topology);
+                        }, readers);
+                    }
+                }
+            }
+        }
+    };
+    queue_case(marketdata::TypeTag<Payload<24>>{});
+    queue_case(marketdata::TypeTag<Payload<64>>{});
+    if (!config.quick) {
+        queue_case(marketdata::TypeTag<Payload<128>>{});
+        queue_case(marketdata::TypeTag<Payload<512>>{});
+    }
+
+    const std::vector<WaitStrategy> hub_waits = config.quick
+        ? std::vector<WaitStrategy>{WaitStrategy::BUSY_SPIN}
+        : std::vector<WaitStrategy>{WaitStrategy::BUSY_SPIN, WaitStrategy::YIELD, WaitStrategy::SLEEP,
+                                    WaitStrategy::BLOCKING};
+    for (HubPath path : {HubPath::HANDLER, HubPath::CALLBACK}) {
+        for (uint32_t subscribers : reader_counts) {
+            for (WaitStrategy wait : hub_waits) {
+                for (Topology topology : topologies) {
+                    for (bool lossless : {false, true}) {
+                        Json params;
+                        params.add("path", path == HubPath::HANDLER ? "cpp_handler" : "std_function")
+                              .add("capacity", kHubQueueSize)
+                              .add("subscribers", subscribers)
+                              .add("wait", wait_name(wait))
+                              .add("topology", topology_name(topology))
+                              .add("lossless", lossless);
+                        record("hub", params, [&] {
+                            return run_hub(config, path, kHubQueueSize, subscribers, wait, topology, lossless);
+                        }, subscribers);
+                    }
+                }
+            }
+        }
+    }
+
+    Json host;
+    host.add("cpus", static_cast<uint32_t>(std::thread::hardware_concurrency()))
+        .add("tsc_ticks_per_ns", clock.ticks_per_ns())
+        .add("tsc_invariant", TscClock::invariant());
+    Json cfg;
+    cfg.add("messages", config.messages).add("rate_mps", config.rate).add("quick", config.quick);
+
+    std::string list;
+    for (const auto& r : results) {
+        list += (list.empty() ? "\n    " : ",\n    ") + r;
+    }
+    std::string doc = "{\"suite\": \"msgbus\", \"format\": 1, \"host\": " + host.str() + ", \"config\": " +
+                      cfg.str() + ", \"results\": [" + list + "\n]}\n";
+
+    if (config.out.empty()) {
+        std::cout << doc;
+    } else {
+        std::ofstream(config.out) << doc;
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+"""
+比较两次 benchmark 的 JSON 结果 (msgbus_bench / bench_python.py 的输出)
+
+按 benchmark + params 配对, 吞吐下降或 p99 / p99.9 延迟上升超过阈值时报告回归并以 1 退出:
+
+    python benchmarks/compare_results.py old.json new.json [--threshold 10]
+
+只在一边出现或被跳过的用例会单独列出, 不算回归.
+"""
+
+import argparse
+import json
+import sys
+
+THROUGHPUT = ("producer_mps", "consumer_mps")
+LATENCY = ("p99", "p99_9")
+
+
+def load(path):
+    with open(path) as f:
+        doc = json.load(f)
+    results = {}
+    for result in doc["results"]:
+        if result.get("skipped"):
+            continue
+        key = result["benchmark"] + " " + json.dumps(result["params"], sort_keys=True)
+        results[key] = result
+    return results
+
+
+def change(old, new):
+    return (new - old) / old * 100.0 if old else 0.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0, help="allowed change in percent")
+    args = parser.parse_args()
+
+    old = load(args.old)
+    new = load(args.new)
+    regressions = 0
+
+    for key in sorted(old.keys() & new.keys()):
+        a, b = old[key], new[key]
+        problems = []
+        for metric in THROUGHPUT:
+            delta = change(a[metric], b[metric])
+            if delta < -args.threshold:
+                problems.append(f"{metric} {a[metric]:.3f} -> {b[metric]:.3f} ({delta:+.1f}%)")
+        for metric in LATENCY:
+            before, after = a["latency_ns"][metric], b["latency_ns"][metric]
+            delta = change(before, after)
+            if delta > args.threshold:
+                problems.append(f"{metric} {before}ns -> {after}ns ({delta:+.1f}%)")
+        if problems:
+            regressions += 1
+            print(f"REGRESSION {key}")
+            for problem in problems:
+                print(f"    {problem}")
+
+    for key in sorted(old.keys() - new.keys()):
+        print(f"missing in new: {key}")
+    for key in sorted(new.keys() - old.keys()):
+        print(f"new case: {key}")
+
+    compared = len(old.keys() & new.keys())
+    print(f"{compared} cases compared, {regressions} regressions (threshold {args.threshold}%)")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
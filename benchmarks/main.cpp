@@ -1,5 +1,6 @@
 #include "spmc.hpp"
 #include "statistic.hpp"
+#include "tsc_clock.hpp"
 
 #include <cassert>
 #include <chrono>
@@ -10,7 +11,7 @@
 #include <sched.h>
 
 struct Msg {
-    uint64_t ts_ns;
+    uint64_t ts_ticks;  // TscClock::now() when written
     uint64_t idx;
 };
 
@@ -30,6 +31,9 @@ const uint64_t MAX_I = 100000000;
 
 SPMCQueue<Msg, 512> q;
 
+// Fixed-size histogram per reader instead of storing every sample (800MB per reader at MAX_I)
+Histogram<> reader_stats[4];
+
 void bind_thread_to_cpu(std::thread& th, int cpu_id) {
     cpu_set_t cpuset;
     CPU_ZERO(&cpuset);
@@ -41,8 +45,8 @@ void bind_thread_to_cpu(std::thread& th, int cpu_id) {
 }
 
 void read_thread(int tid) {
-    Statistic<uint64_t> stat;
-    stat.reserve(MAX_I);
+    Histogram<>& stat = reader_stats[tid];
+    const TscClock& clock = TscClock::instance();
     uint64_t count = 0;
     auto reader = q.getReader();
 
@@ -54,8 +58,8 @@ void read_thread(int tid) {
         }
         // std::cout << "tid: " << tid << " got msg idx=" << msg->idx << std::endl;
 
-        uint64_t now = timestamp<std::chrono::nanoseconds>();
-        uint64_t latency = now - msg->ts_ns;
+        // rdtsc instead of system_clock::now(): the clock call would otherwise cost more than the dequeue
+        uint64_t latency = clock.ns(TscClock::now() - msg->ts_ticks);
         stat.add(latency);
         count++;
 
@@ -76,7 +80,7 @@ void read_thread(int tid) {
 void write_thread() {
     for (uint64_t i = 0; i < MAX_I; ++i) {
         Msg msg;
-        msg.ts_ns = timestamp<std::chrono::nanoseconds>();
+        msg.ts_ticks = TscClock::now();
         msg.idx = i;
 
         q.write(msg);
@@ -84,6 +88,10 @@ void write_thread() {
 }
 
 int main() {
+    const TscClock& clock = TscClock::instance();
+    std::cout << "tsc: " << clock.ticks_per_ns() << " ticks/ns, invariant: " << TscClock::invariant()
+              << std::endl;
+
     std::thread writer(write_thread);
 
     std::thread readers[4];
@@ -98,5 +106,12 @@ int main() {
     }
     writer.join();
 
+    Histogram<> total;
+    for (const auto& stat : reader_stats) {
+        total.merge(stat);
+    }
+    std::cout << "all readers, latency stats: " << std::endl;
+    total.print(std::cout);
+
     return 0;
 }
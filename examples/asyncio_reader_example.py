@@ -0,0 +1,56 @@
+"""
+asyncio 示例: 在事件循环线程上拉取行情
+
+这个示例展示如何:
+1. 用 hub.reader() 创建拉取式 Reader, 不创建订阅线程, 也不需要 call_soon_threadsafe
+2. 对 reader.fileno() (eventfd) 调用 loop.add_reader, 可读时 poll() 直到读空
+3. 生产者只在 Reader 从空闲变为有数据时写一次 eventfd
+"""
+
+import asyncio
+
+import msgbus
+
+
+async def consume(hub, num_messages):
+    loop = asyncio.get_running_loop()
+    ready = asyncio.Event()
+    received = 0
+    wakeups = 0
+
+    # lossless=True: MockCppProducer 比事件循环快得多, 让它等待而不是套圈 Reader
+    with hub.reader(msgbus.DataType.TRADE, lossless=True) as reader:
+        loop.add_reader(reader.fileno(), ready.set)
+        try:
+            while received < num_messages:
+                # poll() 返回空时已经 arm 了 eventfd, 下一条消息到达时 ready 被设置
+                batch = reader.poll(4096, as_numpy=True)
+                if len(batch) == 0:
+                    ready.clear()
+                    await ready.wait()
+                    wakeups += 1
+                    continue
+                received += len(batch)
+        finally:
+            loop.remove_reader(reader.fileno())
+        stats = reader.stats()
+
+    print(f"Messages received: {received} / {num_messages}")
+    print(f"Event loop wakeups: {wakeups}")
+    print(f"Polls with data: {stats['callbacks']}, lost: {stats['lost']}")
+
+
+async def main():
+    hub = msgbus.MarketDataHub(queue_size=4096)
+    producer = msgbus.MockCppProducer(hub)
+    num_messages = 100000
+
+    task = asyncio.create_task(consume(hub, num_messages))
+    await asyncio.sleep(0.1)
+    producer.start(num_messages)
+    await task
+    producer.wait()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
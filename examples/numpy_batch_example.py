@@ -0,0 +1,56 @@
+"""
+NumPy 批量示例: 结构化数组进出 MarketDataHub
+
+这个示例展示如何:
+1. 用 msgbus.trade_dtype 构造一批 Trade, 通过 add_trades 一次写入
+2. 用 subscribe_batch(as_numpy=True) 按批接收 NumPy 数组, 做向量化计算
+"""
+
+import time
+
+import numpy as np
+
+import msgbus
+
+
+stats = {"batches": 0, "messages": 0, "notional": 0.0}
+
+
+def on_trades(data_type, trades):
+    """批量回调: trades 是 dtype 为 msgbus.trade_dtype 的 NumPy 数组"""
+    stats["batches"] += 1
+    stats["messages"] += len(trades)
+    stats["notional"] += float(np.sum(trades["price"] * trades["quantity"]))
+
+
+def main():
+    hub = msgbus.MarketDataHub()
+    sub_id = hub.subscribe_batch(msgbus.DataType.TRADE, on_trades, max_batch=4096, as_numpy=True)
+    time.sleep(0.1)
+
+    # 直接在结构化数组里构造一批 Trade, 字段布局与 C++ 结构体一致
+    num_messages = 10000
+    trades = np.zeros(num_messages, dtype=msgbus.trade_dtype)
+    trades["timestamp"] = np.arange(num_messages, dtype=np.uint64)
+    trades["price"] = 50000.0 + np.arange(num_messages) % 100
+    trades["quantity"] = 0.01
+    trades["symbol"] = b"BTCUSDT"
+    trades["is_buyer_maker"] = np.arange(num_messages) % 2 == 0
+
+    # 每次写入 256 条, 不超过队列容量, 给消费者留出时间
+    for start in range(0, num_messages, 256):
+        hub.add_trades(trades[start:start + 256])
+        time.sleep(0.001)
+
+    time.sleep(0.5)
+    dropped = hub.dropped_count(sub_id)
+    hub.unsubscribe(sub_id)
+
+    print(f"Batches received: {stats['batches']}")
+    print(f"Messages received: {stats['messages']} / {num_messages}")
+    print(f"Dropped: {dropped}")
+    print(f"Total notional: {stats['notional']:.2f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,55 @@
+"""
+共享内存示例: 一个生产进程, 多个独立的 Python 消费进程
+
+生产进程用 shm_name 创建 hub, 队列放在 POSIX 共享内存中;
+每个消费进程用 MarketDataHub.attach() 只读连接同一组队列,
+各自有自己的 GIL 和订阅者线程, 行情只解码一次.
+"""
+
+import multiprocessing as mp
+import time
+
+import msgbus
+
+
+SHM_NAME = "/msgbus_example"
+NUM_MESSAGES = 20000
+
+
+def consumer(index, ready):
+    hub = msgbus.MarketDataHub.attach(SHM_NAME)
+    received = [0]
+
+    def on_trade(data_type, trade):
+        received[0] += 1
+
+    sub_id = hub.subscribe(msgbus.DataType.TRADE, on_trade)
+    ready.release()
+
+    time.sleep(2.0)
+    dropped = hub.dropped_count(sub_id)
+    hub.unsubscribe(sub_id)
+    print(f"consumer {index}: received {received[0]}, dropped {dropped}")
+
+
+def main():
+    # 先创建队列, 消费进程才能连接; hub 销毁时共享内存名字被删除
+    hub = msgbus.MarketDataHub(queue_size=1 << 16, shm_name=SHM_NAME)
+
+    num_consumers = 3
+    ready = mp.Semaphore(0)
+    procs = [mp.Process(target=consumer, args=(i, ready)) for i in range(num_consumers)]
+    for p in procs:
+        p.start()
+    for _ in procs:
+        ready.acquire()
+
+    for i in range(NUM_MESSAGES):
+        hub.add_trade(i, 50000.0 + i % 100, 0.01, "BTCUSDT", i % 2 == 0)
+
+    for p in procs:
+        p.join()
+
+
+if __name__ == "__main__":
+    main()
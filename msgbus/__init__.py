@@ -8,11 +8,40 @@ Built with C++ and exposed to Python via pybind11.
 try:
     from ._core import (
         DataType,
+        WaitStrategy,
+        Side,
+        SubscriptionFilter,
+        ThreadPlacement,
         Kline,
         Trade,
         BookL1,
+        CompactKline,
+        CompactTrade,
+        CompactBookL1,
+        BookL2Update,
+        BookSnapshot,
         MarketDataHub,
+        Reader,
         MockCppProducer,
+        JournalReader,
+        ReplayProducer,
+        MultiProducerIngress,
+        IngressPort,
+        KlineAggregator,
+        BookBuilder,
+        UdpSender,
+        UdpReceiver,
+        kline_dtype,
+        trade_dtype,
+        book_l1_dtype,
+        compact_kline_dtype,
+        compact_trade_dtype,
+        compact_book_l1_dtype,
+        book_l2_dtype,
+        book_snapshot_dtype,
+        BOOK_L2_RESET,
+        BOOK_L2_MORE,
+        BOOK_DEPTH,
     )
 except ImportError as e:
     raise ImportError(
@@ -24,9 +53,38 @@ __version__ = "0.1.0"
 
 __all__ = [
     "DataType",
+    "WaitStrategy",
+    "Side",
+    "SubscriptionFilter",
+    "ThreadPlacement",
     "Kline",
     "Trade",
     "BookL1",
+    "CompactKline",
+    "CompactTrade",
+    "CompactBookL1",
+    "BookL2Update",
+    "BookSnapshot",
     "MarketDataHub",
+    "Reader",
     "MockCppProducer",
+    "JournalReader",
+    "ReplayProducer",
+    "MultiProducerIngress",
+    "IngressPort",
+    "KlineAggregator",
+    "BookBuilder",
+    "UdpSender",
+    "UdpReceiver",
+    "kline_dtype",
+    "trade_dtype",
+    "book_l1_dtype",
+    "compact_kline_dtype",
+    "compact_trade_dtype",
+    "compact_book_l1_dtype",
+    "book_l2_dtype",
+    "book_snapshot_dtype",
+    "BOOK_L2_RESET",
+    "BOOK_L2_MORE",
+    "BOOK_DEPTH",
 ]
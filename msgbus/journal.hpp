@@ -0,0 +1,473 @@
+#pragma once
+
+#include "market_data.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace marketdata {
+
+/**
+ * 行情日志 (journal) 的文件格式
+ *
+ * <path>:     JournalHeader | JournalRecord[count]
+ * <path>.idx: JournalIndexHeader | uint64_t recv_ns[(count + stride - 1) / stride]
+ *
+ * 记录定长, 第 i 条在 sizeof(JournalHeader) + i * sizeof(JournalRecord) 处, 不需要逐条解析.
+ * 索引每 stride 条记录存一个录制时间, 按时间定位时先二分索引, 再顺序找最多 stride 条.
+ * recv_ns 是单调不减的: 开始录制时的 system_clock 加上 steady_clock 经过的时间, 系统时钟
+ * 被 NTP 或手动回拨时索引仍然有序, 回放节奏也不受影响. 开始时的系统时间存在 start_wall_ns.
+ * 写入者先写记录再 release 更新 count, 正在录制的日志也可以被其他进程读取.
+ * 所有字段为本机字节序, 日志不跨架构使用.
+ */
+constexpr uint64_t kJournalMagic = 0x4d474255534a4e31ull;  // "MGBUSJN1"
+constexpr uint32_t kJournalVersion = 2;
+constexpr uint32_t kJournalIndexStride = 1024;
+
+struct alignas(64) JournalHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size;           // sizeof(JournalRecord)
+    uint32_t index_stride;          // 每多少条记录一个索引项
+    uint32_t reserved;
+    std::atomic<uint64_t> count;    // 已写完的记录数
+    uint64_t start_wall_ns;         // 开始录制时的 system_clock 时间 (纳秒), recv_ns 的起点
+};
+
+// 一条记录: 录制时间, 数据类型和原样保存的 Kline/Trade/BookL1
+struct JournalRecord {
+    uint64_t recv_ns;    // 录制线程收到消息的时间 (纳秒, 单调不减, 见文件格式说明), 回放按它控制节奏
+    uint32_t data_type;  // DataType::KLINE / TRADE / BOOK_L1
+    uint32_t reserved;
+    alignas(8) unsigned char payload[sizeof(Kline) > sizeof(BookL1) ? sizeof(Kline) : sizeof(BookL1)];
+
+    DataType type() const {
+        return static_cast<DataType>(data_type);
+    }
+
+    // payload 中保存的消息, T 必须与 type() 对应
+    template <class T>
+    const T& as() const {
+        return *reinterpret_cast<const T*>(payload);
+    }
+
+    MarketData to_market_data() const {
+        switch (type()) {
+            case DataType::KLINE:
+                return as<Kline>();
+            case DataType::BOOK_L1:
+                return as<BookL1>();
+            default:
+                return as<Trade>();
+        }
+    }
+};
+
+static_assert(sizeof(Trade) <= sizeof(JournalRecord::payload), "journal payload must hold every message");
+static_assert(std::is_trivially_copyable_v<Kline> && std::is_trivially_copyable_v<Trade> &&
+              std::is_trivially_copyable_v<BookL1>, "journal records are raw copies of the messages");
+
+struct alignas(64) JournalIndexHeader {
+    uint64_t magic;
+    uint32_t stride;
+    uint32_t reserved;
+};
+
+/**
+ * 可增长的文件映射, JournalWriter/JournalReader 内部使用
+ */
+class JournalFile {
+public:
+    JournalFile() = default;
+    JournalFile(const JournalFile&) = delete;
+    JournalFile& operator=(const JournalFile&) = delete;
+
+    JournalFile(JournalFile&& other) noexcept { swap(other); }
+    JournalFile& operator=(JournalFile&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~JournalFile() {
+        if (data_) {
+            munmap(data_, size_);
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    // 新建 (截断已有文件) 并映射 size 字节
+    static JournalFile create(const std::string& path, size_t size) {
+        JournalFile file;
+        file.path_ = path;
+        file.fd_ = ::open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644);
+        if (file.fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+        int err = file.resize(size);
+        if (err != 0) {
+            throw std::system_error(err, std::generic_category(), "allocate " + path);
+        }
+        return file;
+    }
+
+    // 只读映射整个文件
+    static JournalFile open(const std::string& path) {
+        JournalFile file;
+        file.path_ = path;
+        file.fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file.fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+        struct stat st;
+        if (fstat(file.fd_, &st) != 0) {
+            throw std::system_error(errno, std::generic_category(), "fstat " + path);
+        }
+        file.size_ = static_cast<size_t>(st.st_size);
+        if (file.size_ != 0) {
+            void* p = mmap(nullptr, file.size_, PROT_READ, MAP_SHARED, file.fd_, 0);
+            if (p == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category(), "mmap " + path);
+            }
+            file.data_ = p;
+        }
+        return file;
+    }
+
+    /**
+     * 把文件扩展到 size 字节并重新映射, 成功返回 0, 失败返回 errno (原映射保持不变)
+     * 用 posix_fallocate 预留磁盘空间, 磁盘满时在这里报错, 而不是写映射时收到 SIGBUS
+     */
+    int resize(size_t size) {
+        if (size > size_) {
+#ifdef __linux__
+            int err = posix_fallocate(fd_, off_t(size_), off_t(size - size_));
+            if (err != 0) {
+                return err;
+            }
+#else
+            if (ftruncate(fd_, off_t(size)) != 0) {
+                return errno;
+            }
+#endif
+        }
+
+        void* p;
+#ifdef __linux__
+        p = data_ ? mremap(data_, size_, size, MREMAP_MAYMOVE)
+                  : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+#else
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p != MAP_FAILED && data_) {
+            munmap(data_, size_);
+        }
+#endif
+        if (p == MAP_FAILED) {
+            return errno;
+        }
+        data_ = p;
+        size_ = size;
+        return 0;
+    }
+
+    // 把文件截断到 size 字节 (关闭写入者时去掉预留的空间)
+    void truncate(size_t size) {
+        if (size < size_ && ftruncate(fd_, off_t(size)) == 0) {
+            munmap(data_, size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+    }
+
+    void* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+
+private:
+    void swap(JournalFile& other) noexcept {
+        std::swap(fd_, other.fd_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(path_, other.path_);
+    }
+
+    int fd_ = -1;
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    std::string path_;
+};
+
+/**
+ * JournalWriter - 追加写入行情日志
+ *
+ * 文件按 capacity 条记录预分配并映射, 写满时容量翻倍 (posix_fallocate + mremap),
+ * append() 只是一次 memcpy 和一次 release store, 不分配堆内存也不需要 GIL.
+ * 扩展失败 (例如磁盘满) 后不再写入, 之后的消息计入 dropped().
+ * 只能由一个线程写入; 析构时把文件截断到实际长度.
+ */
+class JournalWriter {
+public:
+    /**
+     * @param path 日志路径, 已存在时被覆盖; 索引写到 path + ".idx"
+     * @param capacity 初始预分配的记录数
+     */
+    explicit JournalWriter(const std::string& path, uint64_t capacity = 1u << 18)
+        : capacity_(capacity ? capacity : 1),
+          file_(JournalFile::create(path, journal_bytes(capacity_))),
+          index_(JournalFile::create(path + ".idx", index_bytes(capacity_))),
+          start_wall_ns_(wall_ns()),
+          start_steady_(std::chrono::steady_clock::now()) {
+        header_ = new (file_.data()) JournalHeader();
+        header_->version = kJournalVersion;
+        header_->record_size = sizeof(JournalRecord);
+        header_->index_stride = kJournalIndexStride;
+        header_->count.store(0, std::memory_order_relaxed);
+        header_->start_wall_ns = start_wall_ns_;
+
+        auto* index_header = new (index_.data()) JournalIndexHeader();
+        index_header->magic = kJournalMagic;
+        index_header->stride = kJournalIndexStride;
+
+        // magic 最后写, 读者看到 magic 时其余字段已经有效
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = kJournalMagic;
+    }
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    ~JournalWriter() {
+        uint64_t count = count_;
+        file_.truncate(journal_bytes(count));
+        index_.truncate(index_bytes(count));
+    }
+
+    /**
+     * 追加一条 Kline/Trade/BookL1, 录制时间取 now_ns()
+     * @return 没有写入 (之前扩展文件失败) 时返回 false
+     */
+    template <class T>
+    bool append(const T& msg) {
+        return append(msg, now_ns());
+    }
+
+    /**
+     * 追加一条 Kline/Trade/BookL1
+     * @param recv_ns 录制时间, 小于上一条时记为上一条的时间, 保持索引有序
+     * @return 没有写入 (之前扩展文件失败) 时返回 false
+     */
+    template <class T>
+    bool append(const T& msg, uint64_t recv_ns) {
+        static_assert(std::is_same_v<T, Kline> || std::is_same_v<T, Trade> || std::is_same_v<T, BookL1>,
+                      "only Kline, Trade and BookL1 are journaled");
+        if (count_ == capacity_ && !grow()) {
+            ++dropped_;
+            return false;
+        }
+
+        recv_ns = std::max(recv_ns, last_ns_);
+        last_ns_ = recv_ns;
+        JournalRecord* record = records() + count_;
+        record->recv_ns = recv_ns;
+        record->data_type = static_cast<uint32_t>(type_of<T>());
+        record->reserved = 0;
+        memcpy(record->payload, &msg, sizeof(T));
+
+        if (count_ % kJournalIndexStride == 0) {
+            index_entries()[count_ / kJournalIndexStride] = recv_ns;
+        }
+        header_->count.store(++count_, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * 让内核开始把脏页写回磁盘, 不等待完成
+     */
+    void flush() {
+        msync(file_.data(), journal_bytes(count_), MS_ASYNC);
+        msync(index_.data(), index_bytes(count_), MS_ASYNC);
+    }
+
+    uint64_t size() const { return count_; }
+    uint64_t dropped() const { return dropped_; }
+    const std::string& path() const { return file_.path(); }
+
+    uint64_t start_wall_ns() const { return start_wall_ns_; }
+
+    // 当前录制时间: start_wall_ns() 加上 steady_clock 经过的纳秒数
+    uint64_t now_ns() const {
+        return start_wall_ns_ + static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_steady_).count());
+    }
+
+    static uint64_t wall_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+private:
+    template <class T>
+    static constexpr DataType type_of() {
+        if constexpr (std::is_same_v<T, Kline>) {
+            return DataType::KLINE;
+        } else if constexpr (std::is_same_v<T, Trade>) {
+            return DataType::TRADE;
+        } else {
+            return DataType::BOOK_L1;
+        }
+    }
+
+    static size_t journal_bytes(uint64_t records) {
+        return sizeof(JournalHeader) + size_t(records) * sizeof(JournalRecord);
+    }
+
+    static size_t index_bytes(uint64_t records) {
+        return sizeof(JournalIndexHeader) +
+               size_t((records + kJournalIndexStride - 1) / kJournalIndexStride) * sizeof(uint64_t);
+    }
+
+    bool grow() {
+        if (failed_) {
+            return false;
+        }
+        uint64_t capacity = capacity_ * 2;
+        if (file_.resize(journal_bytes(capacity)) != 0 || index_.resize(index_bytes(capacity)) != 0) {
+            failed_ = true;
+            return false;
+        }
+        header_ = static_cast<JournalHeader*>(file_.data());  // mremap 可能移动映射
+        capacity_ = capacity;
+        return true;
+    }
+
+    JournalRecord* records() {
+        return reinterpret_cast<JournalRecord*>(static_cast<char*>(file_.data()) + sizeof(JournalHeader));
+    }
+
+    uint64_t* index_entries() {
+        return reinterpret_cast<uint64_t*>(static_cast<char*>(index_.data()) + sizeof(JournalIndexHeader));
+    }
+
+    uint64_t capacity_;
+    JournalFile file_;
+    JournalFile index_;
+    JournalHeader* header_ = nullptr;
+    uint64_t start_wall_ns_;
+    std::chrono::steady_clock::time_point start_steady_;
+    uint64_t last_ns_ = 0;
+    uint64_t count_ = 0;
+    uint64_t dropped_ = 0;
+    bool failed_ = false;
+};
+
+/**
+ * JournalReader - 只读打开行情日志
+ *
+ * 读取打开时已经写完的记录; 正在录制的日志之后追加的记录需要重新打开才能看到.
+ */
+class JournalReader {
+public:
+    explicit JournalReader(const std::string& path)
+        : file_(JournalFile::open(path)), index_(JournalFile::open(path + ".idx")) {
+        if (file_.size() < sizeof(JournalHeader)) {
+            throw std::runtime_error(path + " is not a msgbus journal");
+        }
+        const auto* header = static_cast<const JournalHeader*>(file_.data());
+        if (header->magic != kJournalMagic || header->version != kJournalVersion ||
+            header->record_size != sizeof(JournalRecord)) {
+            throw std::runtime_error(path + " is not a msgbus journal of this version");
+        }
+        stride_ = header->index_stride;
+        start_wall_ns_ = header->start_wall_ns;
+
+        // 只用映射范围内已写完的记录
+        uint64_t mapped = (file_.size() - sizeof(JournalHeader)) / sizeof(JournalRecord);
+        count_ = std::min<uint64_t>(header->count.load(std::memory_order_acquire), mapped);
+
+        const auto* index_header = static_cast<const JournalIndexHeader*>(index_.data());
+        if (index_.size() < sizeof(JournalIndexHeader) || index_header->magic != kJournalMagic ||
+            index_header->stride != stride_) {
+            throw std::runtime_error(path + ".idx is not the index of " + path);
+        }
+        index_count_ = std::min<uint64_t>((count_ + stride_ - 1) / stride_,
+                                          (index_.size() - sizeof(JournalIndexHeader)) / sizeof(uint64_t));
+    }
+
+    uint64_t size() const { return count_; }
+
+    bool empty() const { return count_ == 0; }
+
+    // 开始录制时的 system_clock 时间 (纳秒)
+    uint64_t start_wall_ns() const { return start_wall_ns_; }
+
+    const JournalRecord& operator[](uint64_t i) const {
+        return records()[i];
+    }
+
+    const JournalRecord& at(uint64_t i) const {
+        if (i >= count_) {
+            throw std::out_of_range("journal record " + std::to_string(i) + " out of range");
+        }
+        return records()[i];
+    }
+
+    const JournalRecord* begin() const { return records(); }
+    const JournalRecord* end() const { return records() + count_; }
+
+    /**
+     * 第一条 recv_ns >= ns 的记录下标, 没有时返回 size()
+     * 先在索引上二分, 再从对应位置顺序查找最多 index_stride 条
+     */
+    uint64_t lower_bound(uint64_t ns) const {
+        const uint64_t* entries = reinterpret_cast<const uint64_t*>(
+            static_cast<const char*>(index_.data()) + sizeof(JournalIndexHeader));
+        uint64_t lo = 0;
+        uint64_t hi = index_count_;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (entries[mid] < ns) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        // entries[lo] 是第一个 >= ns 的索引项, 答案在前一个区间内或正好是它
+        uint64_t i = lo == 0 ? 0 : (lo - 1) * stride_;
+        while (i < count_ && records()[i].recv_ns < ns) {
+            ++i;
+        }
+        return i;
+    }
+
+private:
+    const JournalRecord* records() const {
+        return reinterpret_cast<const JournalRecord*>(static_cast<const char*>(file_.data()) +
+                                                      sizeof(JournalHeader));
+    }
+
+    JournalFile file_;
+    JournalFile index_;
+    uint64_t count_ = 0;
+    uint64_t index_count_ = 0;
+    uint64_t start_wall_ns_ = 0;
+    uint32_t stride_ = kJournalIndexStride;
+};
+
+} // namespace marketdata
@@ -50,6 +50,91 @@ struct BookL1 {
     }
 };
 
+// 紧凑版本: 用 SymbolRegistry 分配的 symbol_id 代替 char symbol[32],
+// 每条消息连同队列的 idx 都放得进一个 64 字节的缓存行, symbol 过滤只需比较一个整数
+
+// K线数据 (紧凑)
+struct CompactKline {
+    uint64_t timestamp;      // 时间戳 (纳秒)
+    double open;             // 开盘价
+    double high;             // 最高价
+    double low;              // 最低价
+    double close;            // 收盘价
+    double volume;           // 成交量
+    uint32_t symbol_id;      // 交易对ID
+
+    CompactKline() : timestamp(0), open(0), high(0), low(0), close(0), volume(0), symbol_id(0) {}
+};
+
+// 逐笔成交数据 (紧凑)
+struct CompactTrade {
+    uint64_t timestamp;      // 时间戳 (纳秒)
+    double price;            // 成交价格
+    double quantity;         // 成交数量
+    uint32_t symbol_id;      // 交易对ID
+    bool is_buyer_maker;     // 是否买方挂单
+
+    CompactTrade() : timestamp(0), price(0), quantity(0), symbol_id(0), is_buyer_maker(false) {}
+};
+
+// Level1 行情数据 (紧凑)
+struct CompactBookL1 {
+    uint64_t timestamp;      // 时间戳 (纳秒)
+    double bid_price;        // 买一价
+    double bid_quantity;     // 买一量
+    double ask_price;        // 卖一价
+    double ask_quantity;     // 卖一量
+    uint32_t symbol_id;      // 交易对ID
+
+    CompactBookL1() : timestamp(0), bid_price(0), bid_quantity(0),
+                      ask_price(0), ask_quantity(0), symbol_id(0) {}
+};
+
+// L2 盘口: 逐价位的增量和由 BookBuilder 生成的前 N 档快照, 与紧凑消息一样用 symbol_id
+
+// BookL2Update::flags
+constexpr uint8_t kBookL2Reset = 1;  // 先清空该交易对的盘口再应用 (全量快照的第一条)
+constexpr uint8_t kBookL2More = 2;   // 同一次更新还有后续价位, 应用完最后一条再发布
+
+// 盘口一个价位的增量 (L2)
+struct BookL2Update {
+    uint64_t timestamp;      // 时间戳 (纳秒)
+    uint64_t update_id;      // 交易所的更新序号, 一次更新的多个价位可以相同
+    double price;            // 价格
+    double quantity;         // 该价位的新挂单量, 0 表示删除该价位
+    uint32_t symbol_id;      // 交易对ID
+    bool is_bid;             // 买盘 (否则卖盘)
+    uint8_t flags;           // kBookL2Reset / kBookL2More
+
+    BookL2Update() : timestamp(0), update_id(0), price(0), quantity(0), symbol_id(0), is_bid(false), flags(0) {}
+};
+
+// 快照每侧的最大档数
+constexpr uint32_t kBookDepth = 10;
+
+// 盘口前 N 档快照
+struct BookSnapshot {
+    uint64_t timestamp;                // 时间戳 (纳秒), 最后应用的增量的时间
+    uint64_t update_id;                // 最后应用的增量的 update_id
+    uint32_t symbol_id;                // 交易对ID
+    uint16_t bid_levels;               // 有效的买盘档数
+    uint16_t ask_levels;               // 有效的卖盘档数
+    double bid_price[kBookDepth];      // 买盘, 从高到低
+    double bid_quantity[kBookDepth];
+    double ask_price[kBookDepth];      // 卖盘, 从低到高
+    double ask_quantity[kBookDepth];
+
+    BookSnapshot() : timestamp(0), update_id(0), symbol_id(0), bid_levels(0), ask_levels(0),
+                     bid_price{}, bid_quantity{}, ask_price{}, ask_quantity{} {}
+};
+
+// 拷贝交易对符号, 超长时截断并保证以 '\0' 结尾
+template <size_t N>
+inline void set_symbol(char (&dst)[N], const char* src) {
+    strncpy(dst, src, N - 1);
+    dst[N - 1] = '\0';
+}
+
 // 使用 variant 来统一表示不同类型的市场数据
 // variant 是零开销抽象,大小为 max(sizeof(Kline), sizeof(Trade), sizeof(BookL1)) + sizeof(size_t)
 using MarketData = std::variant<Kline, Trade, BookL1>;
@@ -58,7 +143,82 @@ using MarketData = std::variant<Kline, Trade, BookL1>;
 enum class DataType {
     KLINE = 0,
     TRADE = 1,
-    BOOK_L1 = 2
+    BOOK_L1 = 2,
+    COMPACT_KLINE = 3,
+    COMPACT_TRADE = 4,
+    COMPACT_BOOK_L1 = 5,
+    BOOK_L2 = 6,
+    BOOK_SNAPSHOT = 7
 };
 
+// 数据类型的个数
+constexpr int kDataTypeCount = 8;
+
+// 完整消息和紧凑消息互相转换, 名字由调用者通过 SymbolRegistry 查得
+inline CompactKline to_compact(const Kline& kline, uint32_t symbol_id) {
+    CompactKline compact;
+    compact.timestamp = kline.timestamp;
+    compact.open = kline.open;
+    compact.high = kline.high;
+    compact.low = kline.low;
+    compact.close = kline.close;
+    compact.volume = kline.volume;
+    compact.symbol_id = symbol_id;
+    return compact;
+}
+
+inline CompactTrade to_compact(const Trade& trade, uint32_t symbol_id) {
+    CompactTrade compact;
+    compact.timestamp = trade.timestamp;
+    compact.price = trade.price;
+    compact.quantity = trade.quantity;
+    compact.symbol_id = symbol_id;
+    compact.is_buyer_maker = trade.is_buyer_maker;
+    return compact;
+}
+
+inline CompactBookL1 to_compact(const BookL1& book, uint32_t symbol_id) {
+    CompactBookL1 compact;
+    compact.timestamp = book.timestamp;
+    compact.bid_price = book.bid_price;
+    compact.bid_quantity = book.bid_quantity;
+    compact.ask_price = book.ask_price;
+    compact.ask_quantity = book.ask_quantity;
+    compact.symbol_id = symbol_id;
+    return compact;
+}
+
+inline Kline from_compact(const CompactKline& compact, const char* symbol) {
+    Kline kline;
+    kline.timestamp = compact.timestamp;
+    kline.open = compact.open;
+    kline.high = compact.high;
+    kline.low = compact.low;
+    kline.close = compact.close;
+    kline.volume = compact.volume;
+    set_symbol(kline.symbol, symbol);
+    return kline;
+}
+
+inline Trade from_compact(const CompactTrade& compact, const char* symbol) {
+    Trade trade;
+    trade.timestamp = compact.timestamp;
+    trade.price = compact.price;
+    trade.quantity = compact.quantity;
+    trade.is_buyer_maker = compact.is_buyer_maker;
+    set_symbol(trade.symbol, symbol);
+    return trade;
+}
+
+inline BookL1 from_compact(const CompactBookL1& compact, const char* symbol) {
+    BookL1 book;
+    book.timestamp = compact.timestamp;
+    book.bid_price = compact.bid_price;
+    book.bid_quantity = compact.bid_quantity;
+    book.ask_price = compact.ask_price;
+    book.ask_quantity = compact.ask_quantity;
+    set_symbol(book.symbol, symbol);
+    return book;
+}
+
 } // namespace marketdata
@@ -1,55 +1,399 @@
 #pragma once
 
 #include "spmc.hpp"
+#include "journal.hpp"
 #include "market_data.hpp"
+#include "statistic.hpp"
+#include "subscription_filter.hpp"
+#include "symbol_registry.hpp"
+#include "thread_placement.hpp"
+#include "tsc_clock.hpp"
+#include "wait_strategy.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
+// Trade 末尾有 7 字节填充, 让队列把 idx 放进去, 一个 Trade 槽位正好是一条 cache line
+template <>
+struct SlotPayloadSize<marketdata::Trade>
+    : std::integral_constant<size_t, offsetof(marketdata::Trade, is_buyer_maker) + sizeof(bool)> {};
+
 namespace marketdata {
 
+// 每个队列默认的槽位数 (必须是 2 的幂)
+constexpr uint32_t kDefaultQueueSize = 512;
+
+// 每种数据类型 (以及每个 symbol 分组) 各自拥有一个队列, 容量在构造 hub 时决定
+template <class T>
+using MarketDataQueue = DynamicSPMCQueue<T>;
+
+static_assert(MarketDataQueue<Trade>::kBlockSize == 64, "a Trade slot should fill exactly one cache line");
+static_assert(MarketDataQueue<CompactKline>::kBlockSize == 64 && MarketDataQueue<CompactTrade>::kBlockSize == 64 &&
+              MarketDataQueue<CompactBookL1>::kBlockSize == 64, "a compact message slot should fill one cache line");
+static_assert(MarketDataQueue<BookL2Update>::kBlockSize == 64, "an L2 update slot should fill one cache line");
+
+// 紧凑消息和 L2 盘口消息用 symbol_id 代替 symbol 名字
+template <class T>
+constexpr bool is_compact_v = std::is_same_v<T, CompactKline> || std::is_same_v<T, CompactTrade> ||
+                              std::is_same_v<T, CompactBookL1> || std::is_same_v<T, BookL2Update> ||
+                              std::is_same_v<T, BookSnapshot>;
+
+// 消息类型对应的 DataType
+template <class T>
+constexpr DataType data_type_of() {
+    if constexpr (std::is_same_v<T, Kline>) {
+        return DataType::KLINE;
+    } else if constexpr (std::is_same_v<T, Trade>) {
+        return DataType::TRADE;
+    } else if constexpr (std::is_same_v<T, BookL1>) {
+        return DataType::BOOK_L1;
+    } else if constexpr (std::is_same_v<T, CompactKline>) {
+        return DataType::COMPACT_KLINE;
+    } else if constexpr (std::is_same_v<T, CompactTrade>) {
+        return DataType::COMPACT_TRADE;
+    } else if constexpr (std::is_same_v<T, CompactBookL1>) {
+        return DataType::COMPACT_BOOK_L1;
+    } else if constexpr (std::is_same_v<T, BookL2Update>) {
+        return DataType::BOOK_L2;
+    } else {
+        return DataType::BOOK_SNAPSHOT;
+    }
+}
+
 // Python callback 函数类型定义
-// 参数: DataType (数据类型), void* (数据指针指向 Kline/Trade/BookL1)
+// 参数: DataType (数据类型), void* (数据指针指向 Kline/Trade/BookL1 或对应的紧凑消息)
 using PyCallback = std::function<void(DataType, const void*)>;
 
+// 批量 callback 函数类型定义
+// 参数: DataType (数据类型), void* (指向连续的 Kline/Trade/BookL1 数组), size_t (消息数量)
+using PyBatchCallback = std::function<void(DataType, const void*, size_t)>;
+
+// Hub 选项
+struct HubOptions {
+    uint32_t symbol_groups = 1;               // 每种数据类型的队列数, symbol 按哈希分组
+    uint32_t queue_size = kDefaultQueueSize;  // 每个队列的槽位数, 必须是 2 的幂
+    bool huge_pages = true;                   // 队列不小于 2MB 时使用大页 (MAP_HUGETLB, 否则 THP)
+    int numa_node = -1;                       // >= 0 时队列内存绑定到该 NUMA 节点
+    std::string shm_name;                     // 非空时队列放在 POSIX 共享内存 "<shm_name>.<type>.<group>" 中
+    bool attach = false;                      // 以只读方式连接 shm_name 下已有的队列, 其余选项由创建者决定
+    bool replace_shm = false;                 // 先删除 shm_name 下同名的共享内存 (崩溃的创建者留下的), 否则已存在时抛异常
+    WaitStrategy producer_wait = WaitStrategy::YIELD;  // 无损订阅者跟不上, 队列写满时生产者的等待方式
+    uint32_t worker_threads = 0;              // > 0 时普通订阅复用这么多个消费线程, 而不是每个订阅一个线程
+    WaitStrategy worker_wait = WaitStrategy::SLEEP;  // 消费线程的等待策略 (不支持 BLOCKING)
+    ThreadPlacement worker_placement;         // 消费线程的 CPU/调度/NUMA 放置
+    uint32_t max_symbols = 4096;              // symbol 注册表容量 (紧凑消息的 symbol_id 上限)
+};
+
+// 订阅选项
+struct SubscribeOptions {
+    std::string symbol;                       // 只接收该交易对, 为空表示全部
+    WaitStrategy wait = WaitStrategy::SLEEP;  // 队列为空时的等待策略
+    ThreadPlacement placement;                // 订阅者线程的 CPU/调度/NUMA 放置
+    bool lossless = false;                    // 生产者等待该订阅者, 不会被套圈丢数据 (每个队列最多 16 个)
+    bool dedicated_thread = false;            // hub 有消费线程池时仍为该订阅单独创建线程
+    SubscriptionFilter filter;                // symbol 集合, 价格/数量/方向条件, 在 C++ 里判断
+};
+
+/**
+ * C++ 订阅者接口: 实现以下任意几个成员函数的类型都可以作为 Handler
+ *
+ *   struct MyStrategy {
+ *       void on_trade(const Trade& trade);
+ *       void on_kline(const Kline& kline);
+ *       void on_book(const BookL1& book);
+ *       void on_book_l2(const BookL2Update& update);
+ *       void on_book_snapshot(const BookSnapshot& snapshot);
+ *       void on_flush();  // 可选: 每轮读完已到达的消息后调用一次, 用于攒批后统一发出
+ *   };
+ *
+ * 紧凑消息同样分发给 on_kline/on_trade/on_book, 参数为 CompactKline/CompactTrade/CompactBookL1.
+ *
+ * MarketDataHub::subscribe(handler) 按值保存 handler, 订阅它实现了的所有数据类型,
+ * 编译期直接调用对应的 on_xxx, 不经过 std::function 和 void*.
+ */
+template <class H, class T = Kline, class = void>
+struct HandlesKline : std::false_type {};
+template <class H, class T>
+struct HandlesKline<H, T, std::void_t<decltype(std::declval<H&>().on_kline(std::declval<const T&>()))>>
+    : std::true_type {};
+
+template <class H, class T = Trade, class = void>
+struct HandlesTrade : std::false_type {};
+template <class H, class T>
+struct HandlesTrade<H, T, std::void_t<decltype(std::declval<H&>().on_trade(std::declval<const T&>()))>>
+    : std::true_type {};
+
+template <class H, class T = BookL1, class = void>
+struct HandlesBookL1 : std::false_type {};
+template <class H, class T>
+struct HandlesBookL1<H, T, std::void_t<decltype(std::declval<H&>().on_book(std::declval<const T&>()))>>
+    : std::true_type {};
+
+template <class H, class = void>
+struct HandlesBookL2 : std::false_type {};
+template <class H>
+struct HandlesBookL2<H, std::void_t<decltype(std::declval<H&>().on_book_l2(std::declval<const BookL2Update&>()))>>
+    : std::true_type {};
+
+template <class H, class = void>
+struct HandlesBookSnapshot : std::false_type {};
+template <class H>
+struct HandlesBookSnapshot<
+    H, std::void_t<decltype(std::declval<H&>().on_book_snapshot(std::declval<const BookSnapshot&>()))>>
+    : std::true_type {};
+
+template <class H, class = void>
+struct HasFlush : std::false_type {};
+template <class H>
+struct HasFlush<H, std::void_t<decltype(std::declval<H&>().on_flush())>> : std::true_type {};
+
+template <class H, class T>
+constexpr bool handles_v = std::is_same_v<T, Kline> || std::is_same_v<T, CompactKline> ? HandlesKline<H, T>::value
+                         : std::is_same_v<T, Trade> || std::is_same_v<T, CompactTrade> ? HandlesTrade<H, T>::value
+                         : std::is_same_v<T, BookL2Update>                             ? HandlesBookL2<H>::value
+                         : std::is_same_v<T, BookSnapshot>                             ? HandlesBookSnapshot<H>::value
+                                                                                      : HandlesBookL1<H, T>::value;
+
+// 把消息交给 handler 对应的 on_xxx
+template <class H, class T>
+inline void deliver(H& handler, const T& msg) {
+    if constexpr (std::is_same_v<T, Kline> || std::is_same_v<T, CompactKline>) {
+        handler.on_kline(msg);
+    } else if constexpr (std::is_same_v<T, Trade> || std::is_same_v<T, CompactTrade>) {
+        handler.on_trade(msg);
+    } else if constexpr (std::is_same_v<T, BookL2Update>) {
+        handler.on_book_l2(msg);
+    } else if constexpr (std::is_same_v<T, BookSnapshot>) {
+        handler.on_book_snapshot(msg);
+    } else {
+        handler.on_book(msg);
+    }
+}
+
+// MarketDataHub::record() 使用的 handler: 在订阅线程里把每条完整消息追加到行情日志
+struct JournalRecorder {
+    std::shared_ptr<JournalWriter> writer;
+
+    void on_kline(const Kline& kline) { writer->append(kline); }
+    void on_trade(const Trade& trade) { writer->append(trade); }
+    void on_book(const BookL1& book) { writer->append(book); }
+};
+
+// 订阅者运行时计数器, 只由订阅者线程写入, 单独占一条 cache line 避免和其他字段伪共享
+struct alignas(64) SubscriberCounters {
+    std::atomic<uint64_t> consumed{0};     // 从队列读出的消息数 (含被 symbol 过滤掉的)
+    std::atomic<uint64_t> delivered{0};    // 交给 callback 的消息数
+    std::atomic<uint64_t> lost{0};         // 被生产者套圈而丢失的消息数
+    std::atomic<uint64_t> callbacks{0};    // callback 调用次数
+    std::atomic<uint64_t> callback_ns{0};  // callback 总耗时
+    Histogram<> callback_latency;          // 每次 callback 耗时的分布 (纳秒), 固定约 58KB
+
+    // 单写者, 用 load + store 代替带 lock 前缀的 fetch_add
+    static void bump(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+// 订阅者统计快照, 由 MarketDataHub::stats() 返回
+struct SubscriberStats {
+    int id = 0;
+    DataType data_type = DataType::TRADE;
+    std::string symbol;
+    bool lossless = false;
+    uint64_t consumed = 0;     // 从队列读出的消息数 (含被 symbol 过滤掉的)
+    uint64_t delivered = 0;    // 交给 callback 的消息数
+    uint64_t lost = 0;         // 被生产者套圈而丢失的消息数
+    uint64_t lag = 0;          // 已发布但还没读的消息数, 接近 queue_size 说明快要被套圈
+    uint64_t callbacks = 0;    // callback 调用次数
+    uint64_t callback_ns = 0;  // callback 总耗时
+    uint64_t callback_p50_ns = 0;   // 单次 callback 耗时的分位数 (误差 < 1%)
+    uint64_t callback_p99_ns = 0;
+    uint64_t callback_p999_ns = 0;
+    uint64_t callback_max_ns = 0;
+    uint64_t uptime_ns = 0;    // 订阅至今的时间, 用于换算吞吐
+};
+
+// 依次对每种消息类型调用 f(TypeTag<T>{})
+template <class T>
+struct TypeTag {
+    using type = T;
+};
+
+template <class F>
+constexpr void for_each_message_type(F&& f) {
+    f(TypeTag<Kline>{});
+    f(TypeTag<Trade>{});
+    f(TypeTag<BookL1>{});
+    f(TypeTag<CompactKline>{});
+    f(TypeTag<CompactTrade>{});
+    f(TypeTag<CompactBookL1>{});
+    f(TypeTag<BookL2Update>{});
+    f(TypeTag<BookSnapshot>{});
+}
+
 // 订阅者信息
 struct Subscriber {
     int id;                          // 订阅者ID
-    DataType data_type;              // 订阅的数据类型
+    DataType data_type;              // 订阅的数据类型 (C++ handler 订阅多种类型时为其中第一种)
+    uint32_t type_mask;              // 要读取的数据类型, 每种类型一位 (1 << DataType)
+    SubscribeOptions options;        // 订阅选项
     PyCallback callback;             // Python回调函数
+    PyBatchCallback batch_callback;  // 批量回调, 设置后代替 callback
+    size_t max_batch = 0;            // 每次批量回调最多携带的消息数
+    bool conflate = false;           // 每个 symbol 只保留最新一条, 每轮只交付有变化的 symbol
     std::unique_ptr<std::thread> thread;  // 后台线程
-    bool running;                    // 线程运行状态
+    std::atomic<bool> running{false};  // 线程运行状态, 由 stop_subscriber() 在其他线程清除
+    uint64_t origin = 0;             // 各 Reader 起始位置之和, 用于计算 lag
+    int worker = -1;                 // 所在的消费线程池线程, -1 表示独立线程
+    MessageFilter filter;            // 由 options.symbol 和 options.filter 生成
+    std::chrono::steady_clock::time_point started;  // 订阅时间
+    SubscriberCounters counters;     // 消费/丢失/callback 计数
 
-    // 根据数据类型创建对应的 Reader
+    // 根据数据类型创建对应的 Reader, 每个订阅到的队列一个
     struct ReaderHolder {
-        SPMCQueue<MarketData, 512>::Reader reader;
+        std::vector<MarketDataQueue<Kline>::Reader> kline;
+        std::vector<MarketDataQueue<Trade>::Reader> trade;
+        std::vector<MarketDataQueue<BookL1>::Reader> book_l1;
+        std::vector<MarketDataQueue<CompactKline>::Reader> compact_kline;
+        std::vector<MarketDataQueue<CompactTrade>::Reader> compact_trade;
+        std::vector<MarketDataQueue<CompactBookL1>::Reader> compact_book_l1;
+        std::vector<MarketDataQueue<BookL2Update>::Reader> book_l2;
+        std::vector<MarketDataQueue<BookSnapshot>::Reader> book_snapshot;
+
+        template <class T>
+        std::vector<typename MarketDataQueue<T>::Reader>& get() {
+            if constexpr (std::is_same_v<T, Kline>) {
+                return kline;
+            } else if constexpr (std::is_same_v<T, Trade>) {
+                return trade;
+            } else if constexpr (std::is_same_v<T, BookL1>) {
+                return book_l1;
+            } else if constexpr (std::is_same_v<T, CompactKline>) {
+                return compact_kline;
+            } else if constexpr (std::is_same_v<T, CompactTrade>) {
+                return compact_trade;
+            } else if constexpr (std::is_same_v<T, CompactBookL1>) {
+                return compact_book_l1;
+            } else if constexpr (std::is_same_v<T, BookL2Update>) {
+                return book_l2;
+            } else {
+                return book_snapshot;
+            }
+        }
+
+        // 对每种类型的 Reader 数组调用 f
+        template <class F>
+        void for_each(F&& f) {
+            f(kline);
+            f(trade);
+            f(book_l1);
+            f(compact_kline);
+            f(compact_trade);
+            f(compact_book_l1);
+            f(book_l2);
+            f(book_snapshot);
+        }
     };
     std::unique_ptr<ReaderHolder> reader_holder;
 
-    Subscriber(int id, DataType type, PyCallback cb)
-        : id(id), data_type(type), callback(std::move(cb)),
-          running(false), reader_holder(std::make_unique<ReaderHolder>()) {}
+    Subscriber(int id, DataType type, SubscribeOptions options, PyCallback cb)
+        : id(id), data_type(type), type_mask(1u << static_cast<int>(type)), options(std::move(options)),
+          callback(std::move(cb)), filter(this->options.filter, this->options.symbol),
+          reader_holder(std::make_unique<ReaderHolder>()) {}
 };
 
 /**
  * MarketDataHub - 市场数据分发中心
  *
  * 职责:
- * 1. 维护一个 SPMCQueue<MarketData>
+ * 1. 按数据类型和 symbol 分组维护多个 SPMCQueue, 生产时直接路由到对应队列
  * 2. 提供 add() 接口给 Python 生产者调用
  * 3. 管理订阅者和后台线程
- * 4. 根据订阅类型过滤数据并调用 Python callback
+ * 4. 订阅者只读取自己订阅的队列, 并调用 Python callback
+ *
+ * symbol_groups > 1 时, 同一数据类型按 symbol 的哈希分到多个队列,
+ * 订阅单个 symbol 的消费者只需要读取其中一个队列.
+ * numa_node >= 0 时队列内存分配在该节点上, 一般选择生产者所在的节点.
+ * queue_size 决定每个队列能缓冲多少条消息, 突发行情下越大越不容易被套圈.
+ *
+ * 跨进程: 生产进程用 shm_name 创建 hub, 队列放在共享内存里; 其他进程用
+ * shm_name + attach 连接同一组队列, 只能订阅不能写入. 每个进程有自己的 GIL 和
+ * 订阅者线程, 行情只需要解码一次.
+ *
+ * 无损订阅 (SubscribeOptions::lossless) 用于录制和风控: 队列对该订阅者写满时生产者
+ * 按 producer_wait 等待而不是覆盖, try_add() 则直接返回 false. 一个卡住的无损订阅者
+ * 会卡住它所在队列的生产者.
+ *
+ * 紧凑消息 (CompactKline/CompactTrade/CompactBookL1) 有自己的队列, 用 symbols() 注册表分配的
+ * symbol_id 代替名字: 一条消息一个缓存行, 按 symbol_id % symbol_groups 分组, 订阅单个 symbol 时
+ * 只比较整数. 共享内存 hub 的注册表也在共享内存里, 连接的进程可以查到名字.
+ *
+ * 消费线程池 (HubOptions::worker_threads > 0): 普通的逐条 callback 订阅被分配到固定数量的
+ * 消费线程上, 每个线程对每个队列最多一个 Reader, 每条消息只读一次再分发给该线程上的所有
+ * 订阅. 线程数和队列的重复读取不再随订阅数增长. 批量, 无损, C++ handler 以及
+ * dedicated_thread 订阅仍使用独立线程; 池中订阅的 wait 和 placement 由 worker_* 选项决定.
  */
 class MarketDataHub {
 public:
-    MarketDataHub() : next_subscriber_id_(0) {}
+    explicit MarketDataHub(uint32_t symbol_groups = 1, int numa_node = -1)
+        : MarketDataHub(make_options(symbol_groups, numa_node)) {}
+
+    explicit MarketDataHub(const HubOptions& options)
+        : symbol_groups_(options.symbol_groups ? options.symbol_groups : 1),
+          queue_size_(options.queue_size),
+          read_only_(options.attach),
+          producer_wait_(options.producer_wait),
+          next_subscriber_id_(0) {
+        TscClock::instance();  // 在这里完成校准, 不放到第一次 callback 里
+
+        // 生产者阻塞等待时需要无损订阅者在读取后唤醒
+        if (producer_wait_ == WaitStrategy::BLOCKING) {
+            space_notifier_.add_blocking_subscriber();
+        }
+
+        if (options.attach) {
+            attach_queues(options.shm_name);
+        } else {
+            if (!queue_size_ || (queue_size_ & (queue_size_ - 1))) {
+                throw std::invalid_argument("queue_size must be a power of 2");
+            }
+            for (uint32_t i = 0; i < symbol_groups_; ++i) {
+                kline_queues_.push_back(make_queue<Kline>(options, i));
+                trade_queues_.push_back(make_queue<Trade>(options, i));
+                book_l1_queues_.push_back(make_queue<BookL1>(options, i));
+                compact_kline_queues_.push_back(make_queue<CompactKline>(options, i));
+                compact_trade_queues_.push_back(make_queue<CompactTrade>(options, i));
+                compact_book_l1_queues_.push_back(make_queue<CompactBookL1>(options, i));
+                book_l2_queues_.push_back(make_queue<BookL2Update>(options, i));
+                book_snapshot_queues_.push_back(make_queue<BookSnapshot>(options, i));
+            }
+            symbols_ = options.shm_name.empty()
+                ? std::make_unique<SymbolRegistry>(options.max_symbols)
+                : std::make_unique<SymbolRegistry>(options.max_symbols, RingMemory::createShared(
+                      options.shm_name + ".symbols", SymbolRegistry::storage_bytes(options.max_symbols), false,
+                      options.replace_shm));
+        }
+
+        start_workers(options);
+    }
 
     ~MarketDataHub() {
         // 停止所有订阅者线程
         stop_all();
+        stop_workers();
     }
 
     // 禁止拷贝和移动
@@ -61,237 +405,2673 @@ public:
      * @param data 市场数据 (Kline/Trade/BookL1)
      */
     void add(const MarketData& data) {
-        queue_.write(data);
+        std::visit([this](const auto& msg) { add(msg); }, data);
     }
 
     /**
-     * 订阅市场数据 (Python 消费者调用)
-     * @param data_type 订阅的数据类型
-     * @param callback Python 回调函数
-     * @return 订阅ID (用于后续取消订阅)
+     * 添加单条 Kline/Trade/BookL1, 写入该类型和 symbol 分组对应的队列
      */
-    int subscribe(DataType data_type, PyCallback callback) {
-        std::lock_guard<std::mutex> lock(mutex_);
-
-        int sub_id = next_subscriber_id_++;
-        auto subscriber = std::make_unique<Subscriber>(sub_id, data_type, std::move(callback));
-
-        // 为该订阅者创建 Reader
-        subscriber->reader_holder->reader = queue_.getReader();
-        subscriber->running = true;
+    template <class T>
+    void add(const T& msg) {
+        check_writable();
+        auto& queue = *queues<T>()[group_of(msg)];
+        wait_for_space(queue, 1);
+        queue.write(msg);
+        notifier(data_type_of<T>()).notify();
+    }
 
-        // 创建后台线程
-        subscriber->thread = std::make_unique<std::thread>(
-            &MarketDataHub::consumer_thread, this, sub_id
-        );
+    /**
+     * 不等待的 add(): 有无损订阅者还没读完时返回 false, 消息不写入
+     */
+    template <class T>
+    bool try_add(const T& msg) {
+        check_writable();
+        auto& queue = *queues<T>()[group_of(msg)];
+        if (!queue.tryWrite(msg)) {
+            return false;
+        }
+        notifier(data_type_of<T>()).notify();
+        return true;
+    }
 
-        subscribers_[sub_id] = std::move(subscriber);
+    /**
+     * symbol 所在队列能否再写入 n 条消息而不套圈无损订阅者 (没有无损订阅者时总是 true)
+     */
+    template <class T>
+    bool has_space(const char* symbol, uint32_t n = 1) {
+        return queues<T>()[group_for<T>(symbol)]->hasSpace(n);
+    }
 
-        return sub_id;
+    /**
+     * 按 producer_wait 等待, 直到 symbol 所在队列能再写入 n 条消息
+     */
+    template <class T>
+    void wait_for_space(const char* symbol, uint32_t n = 1) {
+        wait_for_space(*queues<T>()[group_for<T>(symbol)], n);
     }
 
     /**
-     * 取消订阅
-     * @param subscriber_id 订阅ID
+     * 批量添加同一类型的消息
+     * 连续属于同一 symbol 分组的消息一次写入队列, 只需要一次 write_idx 更新和 release fence
+     * @param msgs 消息数组
+     * @param n 消息数量
      */
-    void unsubscribe(int subscriber_id) {
-        std::lock_guard<std::mutex> lock(mutex_);
+    template <class T>
+    void add_batch(const T* msgs, size_t n) {
+        check_writable();
+        auto& qs = queues<T>();
+        if (symbol_groups_ == 1) {
+            write_run(*qs[0], msgs, n);
+            notifier(data_type_of<T>()).notify();
+            return;
+        }
 
-        auto it = subscribers_.find(subscriber_id);
-        if (it != subscribers_.end()) {
-            // 停止线程
-            it->second->running = false;
-            if (it->second->thread && it->second->thread->joinable()) {
-                it->second->thread->join();
+        size_t begin = 0;
+        while (begin < n) {
+            uint32_t group = group_of(msgs[begin]);
+            size_t end = begin + 1;
+            while (end < n && group_of(msgs[end]) == group) {
+                ++end;
             }
-            subscribers_.erase(it);
+            write_run(*qs[group], msgs + begin, end - begin);
+            begin = end;
         }
+        notifier(data_type_of<T>()).notify();
     }
 
     /**
-     * 停止所有订阅
+     * 零拷贝写入: 直接在队列槽位里填写消息, 不经过临时对象
+     * @param symbol 交易对符号, 用于路由并写入消息
+     * @param fill 填写其余字段的函数, 签名 void(T&); 槽位里是上一轮的旧数据, 需要设置所有字段
      */
-    void stop_all() {
-        std::lock_guard<std::mutex> lock(mutex_);
+    template <class T, class F>
+    void emplace(const char* symbol, F&& fill) {
+        static_assert(!is_compact_v<T>, "compact messages are emplaced by symbol_id");
+        check_writable();
+        auto& queue = *queues<T>()[symbol_group(symbol)];
+        wait_for_space(queue, 1);
+        T& msg = queue.claim();
+        set_symbol(msg.symbol, symbol);
+        fill(msg);
+        queue.commit();
+        notifier(data_type_of<T>()).notify();
+    }
 
-        for (auto& [id, subscriber] : subscribers_) {
-            subscriber->running = false;
-            if (subscriber->thread && subscriber->thread->joinable()) {
-                subscriber->thread->join();
-            }
+    /**
+     * 紧凑消息的零拷贝写入
+     * @param symbol_id symbol_id() 返回的交易对ID, 用于路由并写入消息
+     * @return symbol_id 未注册时返回 false, 不写入 (下游按 ID 建表, 不能收到注册表之外的 ID)
+     */
+    template <class T, class F>
+    bool emplace(uint32_t symbol_id, F&& fill) {
+        static_assert(is_compact_v<T>, "only compact messages carry a symbol_id");
+        check_writable();
+        if (!has_symbol_id(symbol_id)) {
+            return false;
         }
-        subscribers_.clear();
+        auto& queue = *queues<T>()[symbol_group(symbol_id)];
+        wait_for_space(queue, 1);
+        T& msg = queue.claim();
+        msg.symbol_id = symbol_id;
+        fill(msg);
+        queue.commit();
+        notifier(data_type_of<T>()).notify();
+        return true;
     }
 
     /**
-     * 获取当前订阅数量
+     * 按字段添加 Kline, 直接写入队列槽位
      */
-    size_t subscriber_count() const {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return subscribers_.size();
+    void add_kline(uint64_t timestamp, double open, double high, double low,
+                   double close, double volume, const char* symbol) {
+        emplace<Kline>(symbol, [&](Kline& kline) {
+            kline.timestamp = timestamp;
+            kline.open = open;
+            kline.high = high;
+            kline.low = low;
+            kline.close = close;
+            kline.volume = volume;
+        });
     }
 
-private:
     /**
-     * 消费者线程函数
-     * @param subscriber_id 订阅者ID
+     * 按字段添加 Trade, 直接写入队列槽位
      */
-    void consumer_thread(int subscriber_id) {
-        // 需要在循环外获取 subscriber 指针,避免每次循环都加锁
-        Subscriber* subscriber = nullptr;
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto it = subscribers_.find(subscriber_id);
-            if (it == subscribers_.end()) {
-                return;
-            }
-            subscriber = it->second.get();
+    void add_trade(uint64_t timestamp, double price, double quantity,
+                   const char* symbol, bool is_buyer_maker) {
+        emplace<Trade>(symbol, [&](Trade& trade) {
+            trade.timestamp = timestamp;
+            trade.price = price;
+            trade.quantity = quantity;
+            trade.is_buyer_maker = is_buyer_maker;
+        });
+    }
+
+    /**
+     * 按字段添加 BookL1, 直接写入队列槽位
+     */
+    void add_book_l1(uint64_t timestamp, double bid_price, double bid_quantity,
+                     double ask_price, double ask_quantity, const char* symbol) {
+        emplace<BookL1>(symbol, [&](BookL1& book) {
+            book.timestamp = timestamp;
+            book.bid_price = bid_price;
+            book.bid_quantity = bid_quantity;
+            book.ask_price = ask_price;
+            book.ask_quantity = ask_quantity;
+        });
+    }
+
+    /**
+     * 获取 symbol 所在的分组
+     */
+    uint32_t symbol_group(const char* symbol) const {
+        if (symbol_groups_ == 1) {
+            return 0;
         }
 
-        auto& reader = subscriber->reader_holder->reader;
-        DataType target_type = subscriber->data_type;
+        // FNV-1a, 最多取 set_symbol 保存的 31 个字符: 长名字和截断后写进消息的名字分到同一组
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < sizeof(Trade::symbol) - 1 && symbol[i] != '\0'; ++i) {
+            hash = (hash ^ static_cast<uint8_t>(symbol[i])) * 16777619u;
+        }
+        return hash % symbol_groups_;
+    }
 
-        while (subscriber->running) {
-            MarketData* data_ptr = reader.read();
-            if (!data_ptr) {
-                // 没有数据,短暂休眠避免CPU空转
-                std::this_thread::sleep_for(std::chrono::microseconds(1));
-                continue;
-            }
+    /**
+     * 获取紧凑消息的 symbol_id 所在的分组, ID 连续分配, 直接取模即可分散
+     */
+    uint32_t symbol_group(uint32_t symbol_id) const {
+        return symbol_groups_ == 1 ? 0 : symbol_id % symbol_groups_;
+    }
 
-            // 根据订阅类型过滤数据
-            DataType current_type = static_cast<DataType>(data_ptr->index());
-            if (current_type != target_type) {
-                continue;  // 不是订阅的类型,跳过
-            }
+    /**
+     * symbol 注册表: 名字和紧凑消息 symbol_id 的映射
+     */
+    SymbolRegistry& symbols() {
+        return *symbols_;
+    }
 
-            // 拷贝数据以避免数据竞争
-            // 生产者可能会覆写队列中的数据,所以需要拷贝一份
-            MarketData data_copy = *data_ptr;
+    /**
+     * symbol 的 ID, 第一次出现时注册; 只读连接的 hub 只能查找, 未注册时返回 kNoSymbol
+     */
+    uint32_t symbol_id(const char* symbol) {
+        return read_only_ ? symbols_->find(symbol) : symbols_->intern(symbol);
+    }
 
-            // 调用 Python callback
-            // 使用 std::visit 来安全地获取数据指针
-            std::visit([&](auto&& arg) {
-                using T = std::decay_t<decltype(arg)>;
-                subscriber->callback(current_type, &arg);
-            }, data_copy);
-        }
+    /**
+     * symbol_id 是否已在注册表中分配; 紧凑消息的 ID 必须满足它才能写入
+     */
+    bool has_symbol_id(uint32_t symbol_id) const {
+        return symbol_id < symbols_->size();
     }
 
-    SPMCQueue<MarketData, 512> queue_;  // 市场数据队列
-    std::unordered_map<int, std::unique_ptr<Subscriber>> subscribers_;  // 订阅者映射
-    mutable std::mutex mutex_;  // 保护 subscribers_
-    int next_subscriber_id_;    // 下一个订阅者ID
-};
+    /**
+     * 获取 symbol 分组数量
+     */
+    uint32_t symbol_groups() const {
+        return symbol_groups_;
+    }
 
-/**
- * MockCppProducer - C++ 模拟数据生产者
- *
- * 在纯 C++ 层生成数据，用于测试无 GIL 情况下的性能
- */
-class MockCppProducer {
-public:
-    MockCppProducer(MarketDataHub* hub)
-        : hub_(hub), running_(false), thread_(nullptr) {}
+    /**
+     * 每个队列的槽位数
+     */
+    uint32_t queue_size() const {
+        return queue_size_;
+    }
 
-    ~MockCppProducer() {
-        stop();
+    /**
+     * 是否以只读方式连接到其他进程的共享内存队列
+     */
+    bool read_only() const {
+        return read_only_;
     }
 
     /**
-     * 启动生产者线程
-     * @param num_messages 要生成的消息数量
-     * @param message_type 消息类型 (0=Trade, 1=Kline, 2=BookL1)
+     * 订阅市场数据 (Python 消费者调用)
+     * @param data_type 订阅的数据类型
+     * @param callback Python 回调函数
+     * @param options 订阅选项 (symbol 过滤, 等待策略)
+     * @return 订阅ID (用于后续取消订阅)
      */
-    void start(uint64_t num_messages, int message_type = 0) {
-        if (running_) return;
+    int subscribe(DataType data_type, PyCallback callback, const SubscribeOptions& options = {}) {
+        std::lock_guard<std::mutex> lock(mutex_);
 
-        running_ = true;
-        num_messages_ = num_messages;
-        message_type_ = message_type;
+        int sub_id = next_subscriber_id_++;
+        auto subscriber = std::make_unique<Subscriber>(sub_id, data_type, options, std::move(callback));
+        if (!workers_.empty() && !options.lossless && !options.dedicated_thread) {
+            add_to_pool(std::move(subscriber));
+        } else {
+            start_subscriber(std::move(subscriber));
+        }
+        return sub_id;
+    }
+
+    /**
+     * 批量订阅市场数据
+     * 后台线程每次把已到达的消息 (最多 max_batch 条) 取完后只调用一次 callback,
+     * 获取 GIL 和调用 Python 的开销随批次数而不是消息数增长
+     * @param data_type 订阅的数据类型
+     * @param callback 批量回调函数
+     * @param max_batch 每批最多消息数
+     * @param options 订阅选项 (symbol 过滤, 等待策略)
+     * @return 订阅ID (用于后续取消订阅)
+     */
+    int subscribe_batch(DataType data_type, PyBatchCallback callback, size_t max_batch = 1024,
+                        const SubscribeOptions& options = {}) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        int sub_id = next_subscriber_id_++;
+        auto subscriber = std::make_unique<Subscriber>(sub_id, data_type, options, nullptr);
+        subscriber->batch_callback = std::move(callback);
+        subscriber->max_batch = max_batch ? max_batch : 1;
+        start_subscriber(std::move(subscriber));
+        return sub_id;
+    }
+
+    /**
+     * 按 symbol 合并订阅 (latest-value cache), 适合 UI, 风控等只关心最新盘口的慢消费者
+     * 后台线程把已到达的消息全部读完, 每个 symbol 只保留最新一条, 然后把这一轮有更新的
+     * symbol 的最新值作为一批交给 callback (每个 symbol 一条, 按本轮首次更新的顺序).
+     * 与 Reader::readLast() 不同, 不同 symbol 交错在同一队列中时不会互相覆盖.
+     * @param data_type 订阅的数据类型, 通常是 BOOK_L1
+     * @param callback 批量回调函数
+     * @param options 订阅选项 (symbol 过滤, 等待策略, 线程放置)
+     * @return 订阅ID (用于后续取消订阅)
+     */
+    int subscribe_conflated(DataType data_type, PyBatchCallback callback, const SubscribeOptions& options = {}) {
+        std::lock_guard<std::mutex> lock(mutex_);
 
-        thread_ = std::make_unique<std::thread>(&MockCppProducer::producer_thread, this);
+        int sub_id = next_subscriber_id_++;
+        auto subscriber = std::make_unique<Subscriber>(sub_id, data_type, options, nullptr);
+        subscriber->batch_callback = std::move(callback);
+        subscriber->conflate = true;
+        start_subscriber(std::move(subscriber));
+        return sub_id;
     }
 
     /**
-     * 停止生产者线程
+     * 订阅 C++ handler: 后台线程按值持有 handler, 对每条消息直接调用 on_trade/on_kline/on_book
+     * 订阅 handler 实现了的所有数据类型; 同时订阅多种类型时不支持 BLOCKING 等待策略.
+     * callback_ns 统计只对 Python callback 计时, 不给 C++ handler 增加时钟开销.
+     * @param handler 实现了 on_kline/on_trade/on_book 中至少一个的对象 (完整或紧凑消息)
+     * @param options 订阅选项 (symbol 过滤, 等待策略, 线程放置, 无损)
+     * @return 订阅ID (用于后续取消订阅)
      */
-    void stop() {
-        running_ = false;
-        if (thread_ && thread_->joinable()) {
-            thread_->join();
+    template <class Handler>
+    int subscribe(Handler handler, const SubscribeOptions& options = {}) {
+        constexpr uint32_t mask = handler_type_mask<Handler>();
+        static_assert(mask != 0, "Handler must implement on_kline, on_trade or on_book");
+        if ((mask & (mask - 1)) && options.wait == WaitStrategy::BLOCKING) {
+            throw std::invalid_argument("BLOCKING wait needs a handler for a single data type");
         }
+        // 最低位对应的类型
+        const DataType first = static_cast<DataType>(__builtin_ctz(mask));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        int sub_id = next_subscriber_id_++;
+        auto subscriber = std::make_unique<Subscriber>(sub_id, first, options, nullptr);
+        subscriber->type_mask = mask;
+        start_subscriber(std::move(subscriber), [this, handler = std::move(handler)](Subscriber* sub) mutable {
+            consume_handler(*sub, handler);
+        });
+        return sub_id;
     }
 
     /**
-     * 等待生产完成
+     * PollReader - 拉取式读取, 不创建线程, 由调用者 (例如 asyncio 事件循环线程) 调用 poll()
+     *
+     * poll() 读不到消息时 arm 一个 eventfd, 生产者下一次发布时写它一次; 事件循环对 fileno()
+     * add_reader, 可读时再 poll() 直到读空. 过滤, 无损和 symbol 分组与普通订阅相同.
+     * 只有同一进程内的生产者会写 eventfd, 连接共享内存的 hub 需要自己定时 poll().
+     * 一个 PollReader 只能在一个线程里使用, 必须在 hub 销毁前销毁.
      */
-    void wait() {
-        if (thread_ && thread_->joinable()) {
-            thread_->join();
+    class PollReader {
+    public:
+        PollReader(MarketDataHub& hub, DataType data_type, const SubscribeOptions& options)
+            : hub_(hub), sub_(std::make_unique<Subscriber>(-1, data_type, options, nullptr)) {
+            for_each_message_type([&](auto tag) {
+                using T = typename decltype(tag)::type;
+                if (data_type_of<T>() == data_type) {
+                    hub_.attach_readers<T>(*sub_);
+                }
+            });
+            try {
+                slot_ = hub_.notifier(data_type).acquire_event();
+            } catch (...) {
+                hub_.detach_readers(*sub_);
+                throw;
+            }
+            sub_->started = std::chrono::steady_clock::now();
+        }
+
+        ~PollReader() {
+            hub_.notifier(sub_->data_type).release_event(slot_);
+            hub_.detach_readers(*sub_);
+            if (sub_->options.lossless) {
+                hub_.space_notifier_.notify();
+            }
+        }
+
+        PollReader(const PollReader&) = delete;
+        PollReader& operator=(const PollReader&) = delete;
+
+        DataType data_type() const {
+            return sub_->data_type;
+        }
+
+        /**
+         * poll() 返回 0 后, 有新消息时变为可读; 下一次 poll() 会清除可读状态
+         */
+        int fileno() const {
+            return hub_.notifier(sub_->data_type).event_fd(slot_);
+        }
+
+        /**
+         * 读取最多 max_n 条通过过滤的消息到 out, 不等待
+         * 返回 0 时已 arm eventfd; T 必须与 data_type() 对应, 否则抛出 std::invalid_argument
+         */
+        template <class T>
+        size_t poll(T* out, size_t max_n) {
+            if (data_type_of<T>() != sub_->data_type) {
+                throw std::invalid_argument("message type does not match the reader's data type");
+            }
+            WakeupNotifier& notifier = hub_.notifier(sub_->data_type);
+            if (armed_) {
+                notifier.disarm_event(slot_);
+                armed_ = false;
+            }
+
+            auto& readers = sub_->reader_holder->get<T>();
+            auto has_data = [&readers]() { return any_ready(readers); };
+            for (;;) {
+                size_t count = read_into(readers, out, max_n);
+                if (count != 0 || max_n == 0) {
+                    return count;
+                }
+                // 读空了: arm 之后再检查一次, 期间有新消息就继续读
+                if (notifier.arm_event(slot_, has_data)) {
+                    armed_ = true;
+                    return 0;
+                }
+            }
+        }
+
+        /**
+         * 统计快照, callbacks 为返回了消息的 poll() 次数
+         */
+        SubscriberStats stats() const {
+            const SubscriberCounters& counters = sub_->counters;
+            SubscriberStats stats;
+            stats.id = sub_->id;
+            stats.data_type = sub_->data_type;
+            stats.symbol = sub_->options.symbol;
+            stats.lossless = sub_->options.lossless;
+            stats.consumed = counters.consumed.load(std::memory_order_relaxed);
+            stats.delivered = counters.delivered.load(std::memory_order_relaxed);
+            stats.lost = counters.lost.load(std::memory_order_relaxed);
+            stats.callbacks = counters.callbacks.load(std::memory_order_relaxed);
+            stats.uptime_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - sub_->started).count());
+            uint64_t lag = published_sum(*sub_) - sub_->origin - (stats.consumed + stats.lost);
+            stats.lag = static_cast<int64_t>(lag) > 0 ? lag : 0;
+            return stats;
+        }
+
+    private:
+        // 与 consume_batch 相同的轮询读取, 被过滤掉的消息直接被下一条覆盖
+        template <class Readers, class T>
+        size_t read_into(Readers& readers, T* out, size_t max_n) {
+            const MessageFilter& filter = sub_->filter;
+            const bool filtered = filter.active();
+            SubscriberCounters& counters = sub_->counters;
+            size_t count = 0;
+            bool consumed = false;
+            bool got_data = true;
+            while (got_data && count < max_n) {
+                got_data = false;
+                for (auto& reader : readers) {
+                    if (count == max_n) {
+                        break;
+                    }
+                    size_t n = read_chunk(reader, counters, out + count, max_n - count);
+                    if (n == 0) {
+                        continue;
+                    }
+                    got_data = consumed = true;
+                    count += filtered ? filter_in_place(filter, out + count, n) : n;
+                }
+            }
+
+            if (consumed) {
+                if (sub_->options.lossless) {
+                    hub_.space_notifier_.notify();
+                }
+            }
+            if (count != 0) {
+                SubscriberCounters::bump(counters.delivered, count);
+                SubscriberCounters::bump(counters.callbacks, 1);
+            }
+            return count;
         }
+
+        MarketDataHub& hub_;
+        std::unique_ptr<Subscriber> sub_;  // 只用来持有 Reader, 过滤条件和计数, 没有线程
+        int slot_ = -1;                    // notifier 中的 eventfd 槽位
+        bool armed_ = false;
+    };
+
+    /**
+     * 创建拉取式 Reader, 不占用订阅线程 (每种数据类型最多 16 个)
+     * @param data_type 读取的数据类型
+     * @param options 订阅选项, 使用 symbol, filter 和 lossless, 忽略等待策略和线程放置
+     */
+    std::unique_ptr<PollReader> reader(DataType data_type, const SubscribeOptions& options = {}) {
+        return std::make_unique<PollReader>(*this, data_type, options);
     }
 
     /**
-     * 获取已生产的消息数量
+     * 把所有 Kline/Trade/BookL1 录制到行情日志 (见 journal.hpp), 由一个 C++ handler 订阅写入
+     * 默认无损, 录制跟不上时生产者等待而不是丢数据. unsubscribe() 后订阅线程退出时关闭日志.
+     * 每种类型各自保持生产顺序; 不同类型在不同队列里, 它们之间按订阅线程读到的顺序交错.
+     * @param path 日志路径, 已存在时被覆盖
+     * @param options 订阅选项 (symbol 过滤, 等待策略, 线程放置); 不支持 BLOCKING
+     * @return 订阅ID
      */
-    uint64_t messages_produced() const {
-        return messages_produced_;
+    int record(const std::string& path, const SubscribeOptions& options) {
+        return subscribe(JournalRecorder{std::make_shared<JournalWriter>(path)}, options);
     }
 
-private:
-    void producer_thread() {
-        messages_produced_ = 0;
+    int record(const std::string& path) {
+        SubscribeOptions options;
+        options.lossless = true;
+        return record(path, options);
+    }
 
-        for (uint64_t i = 0; i < num_messages_ && running_; ++i) {
-            if (message_type_ == 0) {
-                // 生成 Trade
-                Trade trade;
-                trade.timestamp = i;
-                trade.price = 50000.0 + (i % 100);
-                trade.quantity = 1.0;
-                trade.is_buyer_maker = (i % 2 == 0);
-                strncpy(trade.symbol, "BTCUSDT", sizeof(trade.symbol) - 1);
-                trade.symbol[sizeof(trade.symbol) - 1] = '\0';
-
-                hub_->add(MarketData(trade));
-            } else if (message_type_ == 1) {
-                // 生成 Kline
-                Kline kline;
-                kline.timestamp = i;
-                kline.open = 50000.0;
-                kline.high = 50100.0;
-                kline.low = 49900.0;
-                kline.close = 50000.0 + (i % 100);
-                kline.volume = 100.0;
-                strncpy(kline.symbol, "BTCUSDT", sizeof(kline.symbol) - 1);
-                kline.symbol[sizeof(kline.symbol) - 1] = '\0';
-
-                hub_->add(MarketData(kline));
-            } else {
-                // 生成 BookL1
-                BookL1 book;
-                book.timestamp = i;
-                book.bid_price = 50000.0;
-                book.bid_quantity = 10.0;
-                book.ask_price = 50001.0;
-                book.ask_quantity = 10.0;
-                strncpy(book.symbol, "BTCUSDT", sizeof(book.symbol) - 1);
-                book.symbol[sizeof(book.symbol) - 1] = '\0';
+    /**
+     * 取消订阅
+     * @param subscriber_id 订阅ID
+     */
+    void unsubscribe(int subscriber_id) {
+        std::unique_ptr<Subscriber> removed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
 
-                hub_->add(MarketData(book));
+            auto it = subscribers_.find(subscriber_id);
+            if (it == subscribers_.end()) {
+                return;
+            }
+            // 停止线程
+            stop_subscriber(*it->second);
+            removed = std::move(it->second);
+            subscribers_.erase(it);
+        }
+        release_subscriber(std::move(removed));
+    }
+
+    /**
+     * 停止所有订阅
+     */
+    void stop_all() {
+        std::vector<std::unique_ptr<Subscriber>> removed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            for (auto& [id, subscriber] : subscribers_) {
+                stop_subscriber(*subscriber);
+                removed.push_back(std::move(subscriber));
+            }
+            subscribers_.clear();
+        }
+        for (auto& subscriber : removed) {
+            release_subscriber(std::move(subscriber));
+        }
+    }
+
+    /**
+     * 获取订阅者因读得太慢而丢失的消息数
+     * @param subscriber_id 订阅ID
+     */
+    uint64_t dropped_count(int subscriber_id) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = subscribers_.find(subscriber_id);
+        if (it == subscribers_.end()) {
+            return 0;
+        }
+        return it->second->counters.lost.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 所有订阅者的统计快照: 消费数, 丢失数, 当前 lag 和 callback 耗时
+     * lag 接近 queue_size() 时订阅者即将被套圈, 可在真正丢数据前报警
+     */
+    std::vector<SubscriberStats> stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<SubscriberStats> result;
+        result.reserve(subscribers_.size());
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& [id, subscriber] : subscribers_) {
+            const SubscriberCounters& counters = subscriber->counters;
+            SubscriberStats stats;
+            stats.id = id;
+            stats.data_type = subscriber->data_type;
+            stats.symbol = subscriber->options.symbol;
+            stats.lossless = subscriber->options.lossless;
+            stats.consumed = counters.consumed.load(std::memory_order_relaxed);
+            stats.delivered = counters.delivered.load(std::memory_order_relaxed);
+            stats.lost = counters.lost.load(std::memory_order_relaxed);
+            stats.callbacks = counters.callbacks.load(std::memory_order_relaxed);
+            stats.callback_ns = counters.callback_ns.load(std::memory_order_relaxed);
+            stats.callback_p50_ns = counters.callback_latency.percentile(50);
+            stats.callback_p99_ns = counters.callback_latency.percentile(99);
+            stats.callback_p999_ns = counters.callback_latency.percentile(99.9);
+            stats.callback_max_ns = counters.callback_latency.max();
+            stats.uptime_ns = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - subscriber->started).count());
+
+            if (subscriber->worker >= 0) {
+                stats.lag = pool_lag(*workers_[subscriber->worker], *subscriber);
+            } else {
+                // 先读计数再读 write_idx, 计数只会落后; 偶尔出现的负值按 0 处理
+                uint64_t lag = published_sum(*subscriber) - subscriber->origin - (stats.consumed + stats.lost);
+                stats.lag = static_cast<int64_t>(lag) > 0 ? lag : 0;
+            }
+            result.push_back(std::move(stats));
+        }
+        return result;
+    }
+
+    /**
+     * 获取当前订阅数量
+     */
+    size_t subscriber_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return subscribers_.size();
+    }
+
+private:
+    template <class T>
+    std::vector<std::unique_ptr<MarketDataQueue<T>>>& queues() {
+        if constexpr (std::is_same_v<T, Kline>) {
+            return kline_queues_;
+        } else if constexpr (std::is_same_v<T, Trade>) {
+            return trade_queues_;
+        } else if constexpr (std::is_same_v<T, BookL1>) {
+            return book_l1_queues_;
+        } else if constexpr (std::is_same_v<T, CompactKline>) {
+            return compact_kline_queues_;
+        } else if constexpr (std::is_same_v<T, CompactTrade>) {
+            return compact_trade_queues_;
+        } else if constexpr (std::is_same_v<T, CompactBookL1>) {
+            return compact_book_l1_queues_;
+        } else if constexpr (std::is_same_v<T, BookL2Update>) {
+            return book_l2_queues_;
+        } else {
+            return book_snapshot_queues_;
+        }
+    }
+
+    // 消息所在的分组: 完整消息按名字哈希, 紧凑消息按 symbol_id
+    template <class T>
+    uint32_t group_of(const T& msg) const {
+        if constexpr (is_compact_v<T>) {
+            return symbol_group(msg.symbol_id);
+        } else {
+            return symbol_group(msg.symbol);
+        }
+    }
+
+    template <class T>
+    uint32_t group_for(const char* symbol) const {
+        if constexpr (is_compact_v<T>) {
+            return symbol_group(symbols_->find(symbol));
+        } else {
+            return symbol_group(symbol);
+        }
+    }
+
+    // handler 处理的数据类型, 每种类型一位
+    template <class Handler>
+    static constexpr uint32_t handler_type_mask() {
+        uint32_t mask = 0;
+        for_each_message_type([&mask](auto tag) {
+            using T = typename decltype(tag)::type;
+            if (handles_v<Handler, T>) {
+                mask |= 1u << static_cast<int>(data_type_of<T>());
+            }
+        });
+        return mask;
+    }
+
+    /**
+     * 分配一个队列: 先 mmap 环形缓冲区, 需要时在首次写入前 mbind 到 NUMA 节点
+     */
+    template <class T>
+    static std::unique_ptr<MarketDataQueue<T>> make_queue(const HubOptions& options, uint32_t group) {
+        size_t bytes = MarketDataQueue<T>::storageBytes(options.queue_size);
+        RingMemory mem = options.shm_name.empty()
+            ? RingMemory::anonymous(bytes, options.huge_pages)
+            : RingMemory::createShared(shm_queue_name<T>(options.shm_name, group), bytes, options.huge_pages,
+                                       options.replace_shm);
+        if (options.numa_node >= 0) {
+            std::string error = numa_bind_memory(mem.data(), mem.size(), options.numa_node);
+            if (!error.empty()) {
+                throw std::runtime_error(error);
+            }
+        }
+        return std::make_unique<MarketDataQueue<T>>(options.queue_size, std::move(mem));
+    }
+
+    static HubOptions make_options(uint32_t symbol_groups, int numa_node) {
+        HubOptions options;
+        options.symbol_groups = symbol_groups;
+        options.numa_node = numa_node;
+        return options;
+    }
+
+    /**
+     * 共享内存队列的名字, 例如 "/md.trade.0"
+     */
+    template <class T>
+    static std::string shm_queue_name(const std::string& shm_name, uint32_t group) {
+        static const char* const kTypeNames[] = {"kline", "trade", "book_l1", "compact_kline",
+                                                 "compact_trade", "compact_book_l1", "book_l2", "book_snapshot"};
+        return shm_name + "." + kTypeNames[static_cast<int>(data_type_of<T>())] + "." + std::to_string(group);
+    }
+
+    /**
+     * 只读连接 shm_name 下的全部队列, 分组数和队列大小取自创建者
+     */
+    void attach_queues(const std::string& shm_name) {
+        if (shm_name.empty()) {
+            throw std::invalid_argument("attach requires shm_name");
+        }
+
+        for (uint32_t group = 0;; ++group) {
+            RingMemory kline;
+            try {
+                kline = RingMemory::openShared(shm_queue_name<Kline>(shm_name, group));
+            } catch (const std::system_error& e) {
+                if (group > 0 && e.code() == std::errc::no_such_file_or_directory) {
+                    break;  // 已连接全部分组
+                }
+                throw;
+            }
+            kline_queues_.push_back(std::make_unique<MarketDataQueue<Kline>>(std::move(kline)));
+            trade_queues_.push_back(std::make_unique<MarketDataQueue<Trade>>(
+                RingMemory::openShared(shm_queue_name<Trade>(shm_name, group))));
+            book_l1_queues_.push_back(std::make_unique<MarketDataQueue<BookL1>>(
+                RingMemory::openShared(shm_queue_name<BookL1>(shm_name, group))));
+            compact_kline_queues_.push_back(std::make_unique<MarketDataQueue<CompactKline>>(
+                RingMemory::openShared(shm_queue_name<CompactKline>(shm_name, group))));
+            compact_trade_queues_.push_back(std::make_unique<MarketDataQueue<CompactTrade>>(
+                RingMemory::openShared(shm_queue_name<CompactTrade>(shm_name, group))));
+            compact_book_l1_queues_.push_back(std::make_unique<MarketDataQueue<CompactBookL1>>(
+                RingMemory::openShared(shm_queue_name<CompactBookL1>(shm_name, group))));
+            book_l2_queues_.push_back(std::make_unique<MarketDataQueue<BookL2Update>>(
+                RingMemory::openShared(shm_queue_name<BookL2Update>(shm_name, group))));
+            book_snapshot_queues_.push_back(std::make_unique<MarketDataQueue<BookSnapshot>>(
+                RingMemory::openShared(shm_queue_name<BookSnapshot>(shm_name, group))));
+        }
+
+        symbol_groups_ = static_cast<uint32_t>(kline_queues_.size());
+        queue_size_ = kline_queues_[0]->capacity();
+        symbols_ = std::make_unique<SymbolRegistry>(RingMemory::openShared(shm_name + ".symbols"));
+    }
+
+    /**
+     * 生产者等待无损订阅者腾出空间, 没有无损订阅者时只有一次 relaxed load
+     */
+    template <class T>
+    void wait_for_space(MarketDataQueue<T>& queue, uint32_t n) {
+        if (queue.hasSpace(n)) {
+            return;
+        }
+        IdleWaiter waiter(producer_wait_, space_notifier_);
+        queue.waitForSpace(n, [&] {
+            waiter.idle([&] { return queue.hasSpace(n); });
+        });
+    }
+
+    /**
+     * 把同一队列的一段消息分块批量写入, 每块不超过队列容量, 写入前等待无损订阅者
+     */
+    template <class T>
+    void write_run(MarketDataQueue<T>& queue, const T* msgs, size_t n) {
+        const uint32_t capacity = queue.capacity();
+        while (n > 0) {
+            uint32_t chunk = n < capacity ? static_cast<uint32_t>(n) : capacity;
+            wait_for_space(queue, chunk);
+            queue.writeBatch(msgs, chunk);
+            msgs += chunk;
+            n -= chunk;
+        }
+    }
+
+    void check_writable() const {
+        if (read_only_) {
+            throw std::logic_error("hub is attached read-only, only the creating process can publish");
+        }
+    }
+
+    /**
+     * 为订阅者创建 Reader 并启动后台线程, 调用者需持有 mutex_
+     */
+    void start_subscriber(std::unique_ptr<Subscriber> subscriber) {
+        start_subscriber(std::move(subscriber), [this](Subscriber* sub) { consumer_thread(sub); });
+    }
+
+    /**
+     * @param body 线程函数, 签名 void(Subscriber*)
+     */
+    template <class Body>
+    void start_subscriber(std::unique_ptr<Subscriber> subscriber, Body body) {
+        if (subscriber->options.lossless && read_only_) {
+            throw std::invalid_argument("lossless subscribers need a hub that owns its queues");
+        }
+
+        // 为该订阅者创建 Reader: 指定了 symbol 时只读它所在分组的队列
+        for_each_message_type([&](auto tag) {
+            using T = typename decltype(tag)::type;
+            if (subscriber->type_mask & (1u << static_cast<int>(data_type_of<T>()))) {
+                attach_readers<T>(*subscriber);
+            }
+        });
+        subscriber->running = true;
+        subscriber->started = std::chrono::steady_clock::now();
+
+        // BLOCKING 订阅者需要生产者在写入后唤醒
+        if (subscriber->options.wait == WaitStrategy::BLOCKING) {
+            notifier(subscriber->data_type).add_blocking_subscriber();
+        }
+
+        // 创建后台线程, 先应用 CPU/调度/NUMA 放置; 失败时抛出 std::runtime_error
+        Subscriber* sub = subscriber.get();
+        try {
+            subscriber->thread = start_placed_thread(subscriber->options.placement,
+                                                     [sub, body = std::move(body)]() mutable { body(sub); });
+        } catch (...) {
+            if (subscriber->options.wait == WaitStrategy::BLOCKING) {
+                notifier(subscriber->data_type).remove_blocking_subscriber();
+            }
+            detach_readers(*subscriber);
+            throw;
+        }
+
+        subscribers_[sub->id] = std::move(subscriber);
+    }
+
+    /**
+     * 销毁已停止的订阅, 调用者不能持有 mutex_
+     *
+     * 池中订阅的 callback 在工作线程不持锁时调用, 它可能正在分发摘除之前取到的一轮消息:
+     * 非工作线程等这一轮分发完再销毁. 在任一工作线程的 callback 里取消订阅时不能等待
+     * (调用者自己持有 dispatch_mutex, 两个工作线程互相等待会死锁), 交给所属工作线程在
+     * 下一轮结束时销毁.
+     */
+    void release_subscriber(std::unique_ptr<Subscriber> subscriber) {
+        if (subscriber->worker < 0) {
+            return;
+        }
+        PoolWorker& worker = *workers_[subscriber->worker];
+        if (on_worker_thread()) {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.retired.push_back(std::move(subscriber));
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> wait(worker.dispatch_mutex);
+        }
+        subscriber.reset();
+    }
+
+    // 当前线程是否是消费线程池的工作线程 (workers_ 在构造后不再变化)
+    bool on_worker_thread() const {
+        const auto self = std::this_thread::get_id();
+        for (const auto& worker : workers_) {
+            if (worker->thread && worker->thread->get_id() == self) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * 停止订阅者线程, 调用者需持有 mutex_
+     */
+    void stop_subscriber(Subscriber& subscriber) {
+        if (subscriber.worker >= 0) {
+            remove_from_pool(subscriber);
+            return;
+        }
+
+        subscriber.running = false;
+        if (subscriber.options.wait == WaitStrategy::BLOCKING) {
+            // 唤醒可能阻塞在 futex 上的线程
+            notifier(subscriber.data_type).wake_all();
+        }
+        if (subscriber.thread && subscriber.thread->joinable()) {
+            subscriber.thread->join();
+        }
+        if (subscriber.options.wait == WaitStrategy::BLOCKING) {
+            notifier(subscriber.data_type).remove_blocking_subscriber();
+        }
+        detach_readers(subscriber);
+    }
+
+    /**
+     * 消费线程池: 线程在一个队列上的 Reader 以及从它分发消息的订阅者
+     */
+    template <class T>
+    struct PoolRoute {
+        typename MarketDataQueue<T>::Reader reader;
+        std::vector<Subscriber*> subscribers;  // 为空时不读该队列
+        uint64_t version = 0;                  // subscribers 每次变化加一
+
+        // 以下只由工作线程访问: 本轮读到的消息和读取时的订阅列表, 不持锁分发
+        T data;
+        uint64_t lost = 0;
+        bool ready = false;
+        std::vector<Subscriber*> snapshot;
+        uint64_t snapshot_version = 0;
+    };
+
+    struct PoolWorker {
+        std::vector<PoolRoute<Kline>> kline;     // 按 symbol 分组下标
+        std::vector<PoolRoute<Trade>> trade;
+        std::vector<PoolRoute<BookL1>> book_l1;
+        std::vector<PoolRoute<CompactKline>> compact_kline;
+        std::vector<PoolRoute<CompactTrade>> compact_trade;
+        std::vector<PoolRoute<CompactBookL1>> compact_book_l1;
+        std::vector<PoolRoute<BookL2Update>> book_l2;
+        std::vector<PoolRoute<BookSnapshot>> book_snapshot;
+        std::mutex mutex;                        // 工作线程每轮读取时持有, 增删订阅和统计时持有
+        std::mutex dispatch_mutex;               // 工作线程每轮 (读取和分发) 持有, callback 运行期间不持有 mutex
+        std::vector<std::unique_ptr<Subscriber>> retired;  // 在工作线程的 callback 里取消的订阅, 受 mutex 保护
+        std::atomic<bool> running{false};
+        std::unique_ptr<std::thread> thread;
+        size_t subscriber_count = 0;             // 受 hub 的 mutex_ 保护, 用于分配订阅
+
+        template <class T>
+        std::vector<PoolRoute<T>>& routes() {
+            if constexpr (std::is_same_v<T, Kline>) {
+                return kline;
+            } else if constexpr (std::is_same_v<T, Trade>) {
+                return trade;
+            } else if constexpr (std::is_same_v<T, BookL1>) {
+                return book_l1;
+            } else if constexpr (std::is_same_v<T, CompactKline>) {
+                return compact_kline;
+            } else if constexpr (std::is_same_v<T, CompactTrade>) {
+                return compact_trade;
+            } else if constexpr (std::is_same_v<T, CompactBookL1>) {
+                return compact_book_l1;
+            } else if constexpr (std::is_same_v<T, BookL2Update>) {
+                return book_l2;
+            } else {
+                return book_snapshot;
+            }
+        }
+
+        // 对每种类型的 route 数组调用 f
+        template <class F>
+        void for_each(F&& f) {
+            f(kline);
+            f(trade);
+            f(book_l1);
+            f(compact_kline);
+            f(compact_trade);
+            f(compact_book_l1);
+            f(book_l2);
+            f(book_snapshot);
+        }
+    };
+
+    void start_workers(const HubOptions& options) {
+        if (options.worker_threads > 0 && options.worker_wait == WaitStrategy::BLOCKING) {
+            throw std::invalid_argument("worker_wait does not support BLOCKING");
+        }
+        worker_wait_ = options.worker_wait;
+
+        try {
+            for (uint32_t i = 0; i < options.worker_threads; ++i) {
+                auto worker = std::make_unique<PoolWorker>();
+                worker->for_each([this](auto& routes) { routes.resize(symbol_groups_); });
+                worker->running = true;
+
+                PoolWorker* w = worker.get();
+                worker->thread = start_placed_thread(options.worker_placement, [this, w] { worker_thread(w); });
+                workers_.push_back(std::move(worker));
+            }
+        } catch (...) {
+            stop_workers();  // 构造函数抛出时析构函数不会运行
+            throw;
+        }
+    }
+
+    void stop_workers() {
+        for (auto& worker : workers_) {
+            worker->running = false;
+            if (worker->thread && worker->thread->joinable()) {
+                worker->thread->join();
+            }
+        }
+        workers_.clear();
+    }
+
+    /**
+     * 把订阅交给订阅数最少的消费线程, 调用者需持有 mutex_
+     */
+    void add_to_pool(std::unique_ptr<Subscriber> subscriber) {
+        size_t index = 0;
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            if (workers_[i]->subscriber_count < workers_[index]->subscriber_count) {
+                index = i;
+            }
+        }
+        PoolWorker& worker = *workers_[index];
+
+        subscriber->running = true;
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            for_each_message_type([&](auto tag) {
+                using T = typename decltype(tag)::type;
+                if (subscriber->data_type == data_type_of<T>()) {
+                    join_routes<T>(worker, *subscriber);
+                }
+            });
+        }
+
+        subscriber->worker = static_cast<int>(index);
+        subscriber->started = std::chrono::steady_clock::now();
+        ++worker.subscriber_count;
+        subscribers_[subscriber->id] = std::move(subscriber);
+    }
+
+    template <class T>
+    void join_routes(PoolWorker& worker, Subscriber& subscriber) {
+        auto& routes = worker.routes<T>();
+        auto join = [&](uint32_t group) {
+            PoolRoute<T>& route = routes[group];
+            if (route.subscribers.empty()) {
+                // 该队列之前没人读, 从当前位置开始
+                route.reader = queues<T>()[group]->getReader();
+            }
+            route.subscribers.push_back(&subscriber);
+            ++route.version;
+        };
+
+        for (uint32_t group : subscriber_groups<T>(subscriber)) {
+            join(group);
+        }
+    }
+
+    /**
+     * 从消费线程上摘除订阅, 之后工作线程不会再开始它的 callback (正在分发的一轮由
+     * release_subscriber() 等待). 调用者需持有 mutex_
+     */
+    void remove_from_pool(Subscriber& subscriber) {
+        PoolWorker& worker = *workers_[subscriber.worker];
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            auto leave = [&subscriber](auto& routes) {
+                for (auto& route : routes) {
+                    auto& subs = route.subscribers;
+                    auto end = std::remove(subs.begin(), subs.end(), &subscriber);
+                    if (end != subs.end()) {
+                        subs.erase(end, subs.end());
+                        ++route.version;
+                    }
+                }
+            };
+            worker.for_each(leave);
+        }
+        --worker.subscriber_count;
+        subscriber.running = false;
+    }
+
+    /**
+     * 池中订阅的 lag: 它所在各队列上工作线程 Reader 的 lag 之和
+     */
+    static uint64_t pool_lag(PoolWorker& worker, const Subscriber& subscriber) {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        uint64_t lag = 0;
+        auto add = [&](auto& routes) {
+            for (auto& route : routes) {
+                const auto& subs = route.subscribers;
+                if (std::find(subs.begin(), subs.end(), &subscriber) != subs.end()) {
+                    lag += route.reader.lag();
+                }
+            }
+        };
+        worker.for_each(add);
+        return lag;
+    }
+
+    /**
+     * 消费线程: 每轮从每个有订阅的队列读一条消息, 分发给该队列上的所有订阅
+     *
+     * 持有 mutex 读取并记下订阅列表, 放开 mutex 之后再调用 callback, 因此 callback 里可以
+     * subscribe/unsubscribe/stats. 整轮持有 dispatch_mutex (先于 mutex 获取, 与 callback 里
+     * 再取 mutex 的顺序一致), 其他线程取消订阅后只要等到 dispatch_mutex, 就不会再有用到旧列表的 callback.
+     */
+    void worker_thread(PoolWorker* worker) {
+        // worker_wait 不是 BLOCKING, notifier 和 has_data 都不会被用到
+        IdleWaiter waiter(worker_wait_, notifier(DataType::TRADE));
+        std::vector<std::unique_ptr<Subscriber>> retired;
+
+        while (worker->running.load(std::memory_order_relaxed)) {
+            bool got_data = false;
+            std::unique_lock<std::mutex> dispatching(worker->dispatch_mutex);
+            {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                // 此前在工作线程 callback 里取消的订阅已经不在任何订阅列表中
+                retired.swap(worker->retired);
+                worker->for_each([&got_data](auto& routes) { got_data |= poll_routes(routes); });
+            }
+
+            if (got_data) {
+                worker->for_each([](auto& routes) { dispatch_routes(routes); });
+            }
+            dispatching.unlock();
+            retired.clear();
+
+            if (got_data) {
+                waiter.reset();
+            } else {
+                waiter.idle([] { return false; });
+            }
+        }
+    }
+
+    // 持有 worker 的 mutex 调用: 每个有订阅的队列读一条, 记下当前的订阅列表
+    template <class T>
+    static bool poll_routes(std::vector<PoolRoute<T>>& routes) {
+        bool got_data = false;
+        for (auto& route : routes) {
+            route.ready = false;
+            if (route.subscribers.empty()) {
+                continue;
+            }
+            auto result = route.reader.readCopy(route.data);
+            if (!result) {
+                continue;
+            }
+            route.ready = true;
+            route.lost = result.lost;
+            if (route.snapshot_version != route.version) {
+                route.snapshot = route.subscribers;
+                route.snapshot_version = route.version;
+            }
+            got_data = true;
+        }
+        return got_data;
+    }
+
+    // 不持有 mutex 调用: 一次读取, 分发给读取时的所有订阅
+    template <class T>
+    static void dispatch_routes(std::vector<PoolRoute<T>>& routes) {
+        for (auto& route : routes) {
+            if (!route.ready) {
+                continue;
+            }
+            for (Subscriber* subscriber : route.snapshot) {
+                // 本轮前面的 callback 可能已经取消了它
+                if (!subscriber->running.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                SubscriberCounters& counters = subscriber->counters;
+                SubscriberCounters::bump(counters.consumed, 1);
+                if (route.lost) {
+                    SubscriberCounters::bump(counters.lost, route.lost);
+                }
+
+                if (subscriber->filter.active() && !subscriber->filter.matches(route.data)) {
+                    continue;
+                }
+                SubscriberCounters::bump(counters.delivered, 1);
+                timed_call(counters, [&] { subscriber->callback(subscriber->data_type, &route.data); });
+            }
+        }
+    }
+
+    /**
+     * 订阅者所读各队列的 write_idx 之和
+     */
+    static uint64_t published_sum(const Subscriber& subscriber) {
+        uint64_t sum = 0;
+        auto add = [&sum](const auto& readers) {
+            for (const auto& reader : readers) {
+                sum += reader.q->published();
+            }
+        };
+        subscriber.reader_holder->for_each(add);
+        return sum;
+    }
+
+    /**
+     * 调用 callback 并计时
+     */
+    template <class F>
+    static void timed_call(SubscriberCounters& counters, F&& call) {
+        // rdtsc 比 steady_clock::now() 便宜得多, 不会把时钟本身的开销算进 callback 耗时
+        const TscClock& clock = TscClock::instance();
+        uint64_t begin = TscClock::now();
+        call();
+        uint64_t elapsed = clock.ns(TscClock::now_serialized() - begin);
+        SubscriberCounters::bump(counters.callbacks, 1);
+        SubscriberCounters::bump(counters.callback_ns, elapsed);
+        counters.callback_latency.add(elapsed);
+    }
+
+    /**
+     * 释放无损订阅者占用的 gating cursor, 之后生产者不再等待它
+     */
+    void detach_readers(Subscriber& subscriber) {
+        auto release = [](auto& readers) {
+            for (auto& reader : readers) {
+                reader.q->releaseReader(reader);
+            }
+        };
+        subscriber.reader_holder->for_each(release);
+    }
+
+    WakeupNotifier& notifier(DataType data_type) {
+        return notifiers_[static_cast<int>(data_type)];
+    }
+
+    /**
+     * 订阅者要读的分组: 没有 symbol 条件时是全部分组, 否则只是这些 symbol 所在的分组.
+     * 紧凑消息要先把名字解析成 symbol_id, 只读连接的 hub 上未注册的 symbol 抛出 invalid_argument
+     */
+    template <class T>
+    std::vector<uint32_t> subscriber_groups(Subscriber& subscriber) {
+        std::vector<uint32_t> groups;
+        MessageFilter& filter = subscriber.filter;
+        if (!filter.by_symbol()) {
+            for (uint32_t group = 0; group < symbol_groups_; ++group) {
+                groups.push_back(group);
+            }
+            return groups;
+        }
+
+        std::vector<uint32_t> ids;
+        for (const auto& symbol : filter.symbols()) {
+            uint32_t group;
+            if constexpr (is_compact_v<T>) {
+                uint32_t id = symbol_id(symbol.c_str());
+                if (id == kNoSymbol) {
+                    throw std::invalid_argument("symbol " + symbol + " is not registered by the producer");
+                }
+                ids.push_back(id);
+                group = symbol_group(id);
+            } else {
+                group = symbol_group(symbol.c_str());
+            }
+            if (std::find(groups.begin(), groups.end(), group) == groups.end()) {
+                groups.push_back(group);
+            }
+        }
+        if constexpr (is_compact_v<T>) {
+            filter.set_symbol_ids(ids);
+        }
+        return groups;
+    }
+
+    template <class T>
+    void attach_readers(Subscriber& subscriber) {
+        auto& readers = subscriber.reader_holder->get<T>();
+        auto& qs = queues<T>();
+        auto reader_of = [&subscriber](MarketDataQueue<T>& q) {
+            return subscriber.options.lossless ? q.getGatingReader() : q.getReader();
+        };
+        try {
+            for (uint32_t group : subscriber_groups<T>(subscriber)) {
+                readers.push_back(reader_of(*qs[group]));
+            }
+        } catch (...) {
+            // 某个队列的 gating cursor 用完了, 归还已经拿到的
+            detach_readers(subscriber);
+            throw;
+        }
+        for (const auto& reader : readers) {
+            subscriber.origin += reader.next_idx - 1;
+        }
+    }
+
+    /**
+     * 是否有任一 Reader 可读 (不消费数据)
+     */
+    template <class Readers>
+    static bool any_ready(const Readers& readers) {
+        for (const auto& reader : readers) {
+            if (!reader.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 批量读取时每个 Reader 一次最多读的条数, 多个 Reader 之间仍然轮流读
+    static constexpr size_t kReadChunk = 64;
+
+    /**
+     * 从一个 Reader 读最多 min(max_n, kReadChunk) 条到 out, 并记录 consumed / lost
+     * readCopyBatch() 只在读完上次看到的 write_idx 之后才重新加载它, 并预取后面的槽位
+     */
+    template <class Reader, class T>
+    static size_t read_chunk(Reader& reader, SubscriberCounters& counters, T* out, size_t max_n) {
+        auto result = reader.readCopyBatch(out, static_cast<uint32_t>(std::min(max_n, kReadChunk)));
+        if (result.count != 0) {
+            SubscriberCounters::bump(counters.consumed, result.count);
+        }
+        if (result.lost != 0) {
+            SubscriberCounters::bump(counters.lost, result.lost);
+        }
+        return result.count;
+    }
+
+    /**
+     * 原地去掉 msgs[0, n) 中不匹配过滤条件的消息, 返回剩下的条数
+     */
+    template <class T>
+    static size_t filter_in_place(const MessageFilter& filter, T* msgs, size_t n) {
+        size_t kept = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (filter.matches(msgs[i])) {
+                if (kept != i) {
+                    msgs[kept] = msgs[i];
+                }
+                ++kept;
+            }
+        }
+        return kept;
+    }
+
+    /**
+     * 消费者线程函数
+     * @param subscriber 订阅者, 线程运行期间由 subscribers_ 持有
+     */
+    void consumer_thread(Subscriber* subscriber) {
+        switch (subscriber->data_type) {
+            case DataType::KLINE:
+                consume<Kline>(*subscriber);
+                break;
+            case DataType::TRADE:
+                consume<Trade>(*subscriber);
+                break;
+            case DataType::BOOK_L1:
+                consume<BookL1>(*subscriber);
+                break;
+            case DataType::COMPACT_KLINE:
+                consume<CompactKline>(*subscriber);
+                break;
+            case DataType::COMPACT_TRADE:
+                consume<CompactTrade>(*subscriber);
+                break;
+            case DataType::COMPACT_BOOK_L1:
+                consume<CompactBookL1>(*subscriber);
+                break;
+            case DataType::BOOK_L2:
+                consume<BookL2Update>(*subscriber);
+                break;
+            case DataType::BOOK_SNAPSHOT:
+                consume<BookSnapshot>(*subscriber);
+                break;
+        }
+    }
+
+    /**
+     * 轮流读取订阅者的各个队列并调用 callback
+     */
+    template <class T>
+    void consume(Subscriber& subscriber) {
+        if (subscriber.conflate) {
+            consume_conflated<T>(subscriber);
+            return;
+        }
+        if (subscriber.batch_callback) {
+            consume_batch<T>(subscriber);
+            return;
+        }
+
+        auto& readers = subscriber.reader_holder->get<T>();
+        const DataType data_type = subscriber.data_type;
+        const MessageFilter& filter = subscriber.filter;
+        const bool filtered = filter.active();
+        const bool lossless = subscriber.options.lossless;
+        SubscriberCounters& counters = subscriber.counters;
+        IdleWaiter waiter(subscriber.options.wait, notifier(data_type));
+        auto has_data = [&readers]() { return any_ready(readers); };
+
+        // readCopy() 先拷贝再校验 idx, 生产者覆写中的数据不会被交给回调
+        T data;
+        while (subscriber.running.load(std::memory_order_relaxed)) {
+            bool got_data = false;
+            for (auto& reader : readers) {
+                auto result = reader.readCopy(data);
+                if (!result) {
+                    continue;
+                }
+                got_data = true;
+                SubscriberCounters::bump(counters.consumed, 1);
+
+                // 读得太慢被生产者套圈, 记录丢失的消息数
+                if (result.status == MarketDataQueue<T>::ReadStatus::OVERRUN) {
+                    SubscriberCounters::bump(counters.lost, result.lost);
+                }
+
+                // 分组内可能有其他 symbol, 只有设置了过滤条件时才需要判断
+                if (filtered && !filter.matches(data)) {
+                    continue;
+                }
+
+                // 调用 Python callback
+                SubscriberCounters::bump(counters.delivered, 1);
+                timed_call(counters, [&] { subscriber.callback(data_type, &data); });
+            }
+
+            if (got_data) {
+                if (lossless) {
+                    space_notifier_.notify();  // 生产者可能在等我们腾出空间
+                }
+                waiter.reset();
+            } else {
+                // 没有数据, 按订阅的等待策略空闲等待
+                waiter.idle(has_data);
+            }
+        }
+    }
+
+    /**
+     * C++ handler 订阅: 依次读取 handler 处理的每种类型的队列, 直接调用 on_xxx
+     */
+    template <class Handler>
+    void consume_handler(Subscriber& subscriber, Handler& handler) {
+        const MessageFilter& filter = subscriber.filter;
+        const bool filtered = filter.active();
+        const bool lossless = subscriber.options.lossless;
+        SubscriberCounters& counters = subscriber.counters;
+        Subscriber::ReaderHolder& holder = *subscriber.reader_holder;
+        IdleWaiter waiter(subscriber.options.wait, notifier(subscriber.data_type));
+        auto has_data = [&holder]() {
+            bool ready = false;
+            holder.for_each([&ready](const auto& readers) { ready = ready || any_ready(readers); });
+            return ready;
+        };
+
+        // 每种类型的每个 Reader 各读一段 (最多 kReadChunk 条), 返回是否读到了数据
+        auto poll = [&](auto& readers, auto& chunk) {
+            bool got_data = false;
+            for (auto& reader : readers) {
+                size_t n = read_chunk(reader, counters, chunk.data(), chunk.size());
+                if (n == 0) {
+                    continue;
+                }
+                got_data = true;
+                if (filtered) {
+                    n = filter_in_place(filter, chunk.data(), n);
+                }
+                SubscriberCounters::bump(counters.delivered, n);
+                for (size_t i = 0; i < n; ++i) {
+                    deliver(handler, chunk[i]);
+                }
+            }
+            return got_data;
+        };
+
+        std::tuple<std::array<Kline, kReadChunk>, std::array<Trade, kReadChunk>, std::array<BookL1, kReadChunk>,
+                   std::array<CompactKline, kReadChunk>, std::array<CompactTrade, kReadChunk>,
+                   std::array<CompactBookL1, kReadChunk>, std::array<BookL2Update, kReadChunk>,
+                   std::array<BookSnapshot, kReadChunk>> scratch;
+        while (subscriber.running.load(std::memory_order_relaxed)) {
+            bool got_data = false;
+            for_each_message_type([&](auto tag) {
+                using T = typename decltype(tag)::type;
+                if constexpr (handles_v<Handler, T>) {
+                    got_data |= poll(holder.get<T>(), std::get<std::array<T, kReadChunk>>(scratch));
+                }
+            });
+
+            if (got_data) {
+                if constexpr (HasFlush<Handler>::value) {
+                    handler.on_flush();
+                }
+                if (lossless) {
+                    space_notifier_.notify();
+                }
+                waiter.reset();
+            } else {
+                waiter.idle(has_data);
+            }
+        }
+    }
+
+    /**
+     * 批量模式: 把所有队列中已到达的消息 (最多 max_batch 条) 收集到缓冲区, 再调用一次 callback
+     */
+    template <class T>
+    void consume_batch(Subscriber& subscriber) {
+        auto& readers = subscriber.reader_holder->get<T>();
+        const DataType data_type = subscriber.data_type;
+        const MessageFilter& filter = subscriber.filter;
+        const bool filtered = filter.active();
+        IdleWaiter waiter(subscriber.options.wait, notifier(data_type));
+        auto has_data = [&readers]() { return any_ready(readers); };
+        const size_t max_batch = subscriber.max_batch;
+        const bool lossless = subscriber.options.lossless;
+        SubscriberCounters& counters = subscriber.counters;
+
+        std::vector<T> batch(max_batch);
+        while (subscriber.running.load(std::memory_order_relaxed)) {
+            size_t count = 0;
+            bool got_data = true;
+            while (got_data && count < max_batch) {
+                got_data = false;
+                for (auto& reader : readers) {
+                    if (count == max_batch) {
+                        break;
+                    }
+
+                    size_t n = read_chunk(reader, counters, batch.data() + count, max_batch - count);
+                    if (n == 0) {
+                        continue;
+                    }
+                    got_data = true;
+                    // 不要的消息直接被后面的覆盖
+                    count += filtered ? filter_in_place(filter, batch.data() + count, n) : n;
+                }
+            }
+
+            if (count == 0) {
+                // 没有数据, 按订阅的等待策略空闲等待
+                waiter.idle(has_data);
+                continue;
+            }
+            waiter.reset();
+            if (lossless) {
+                space_notifier_.notify();
+            }
+
+            SubscriberCounters::bump(counters.delivered, count);
+            timed_call(counters, [&] { subscriber.batch_callback(data_type, batch.data(), count); });
+        }
+    }
+
+    // 合并表的槽位: 紧凑消息的 symbol_id, 完整消息名字在注册表中的 ID; 注册不了时返回 kNoSymbol
+    template <class T>
+    uint32_t conflation_slot(const T& data) {
+        if constexpr (is_compact_v<T>) {
+            return data.symbol_id;
+        } else {
+            try {
+                return symbol_id(data.symbol);
+            } catch (const std::length_error&) {
+                return kNoSymbol;
+            }
+        }
+    }
+
+    /**
+     * 合并模式: 读完已到达的消息, 按 symbol 写入最新值槽位, 再交付本轮有变化的槽位
+     */
+    template <class T>
+    void consume_conflated(Subscriber& subscriber) {
+        auto& readers = subscriber.reader_holder->get<T>();
+        const DataType data_type = subscriber.data_type;
+        const MessageFilter& filter = subscriber.filter;
+        const bool filtered = filter.active();
+        const bool lossless = subscriber.options.lossless;
+        SubscriberCounters& counters = subscriber.counters;
+        IdleWaiter waiter(subscriber.options.wait, notifier(data_type));
+        auto has_data = [&readers]() { return any_ready(readers); };
+
+        // 按 symbol_id 索引, 只增不减, 大小以注册表为界: 完整消息的名字先在注册表中查找或注册
+        std::vector<T> latest;
+        std::vector<uint8_t> dirty;
+        std::vector<uint32_t> changed;  // 本轮有更新的槽位, 按首次更新的顺序
+        std::vector<T> batch;
+
+        // 每轮最多读一圈, 行情持续涌入时也能按时交付
+        const size_t max_reads = size_t(queue_size_) * readers.size();
+
+        T data;
+        while (subscriber.running.load(std::memory_order_relaxed)) {
+            size_t reads = 0;
+            bool got_data = true;
+            while (got_data && reads < max_reads) {
+                got_data = false;
+                for (auto& reader : readers) {
+                    auto result = reader.readCopy(data);
+                    if (!result) {
+                        continue;
+                    }
+                    got_data = true;
+                    ++reads;
+                    SubscriberCounters::bump(counters.consumed, 1);
+                    if (result.lost) {
+                        SubscriberCounters::bump(counters.lost, result.lost);
+                    }
+
+                    if (filtered && !filter.matches(data)) {
+                        continue;
+                    }
+
+                    // 未注册的 ID, 以及注册表已满 (或只读) 时注册不了的名字, 像被过滤一样丢弃
+                    const uint32_t slot = conflation_slot(data);
+                    if (!has_symbol_id(slot)) {
+                        continue;
+                    }
+                    if (slot >= latest.size()) {
+                        latest.resize(size_t(slot) + 1);
+                        dirty.resize(size_t(slot) + 1, 0);
+                    }
+                    latest[slot] = data;
+                    if (!dirty[slot]) {
+                        dirty[slot] = 1;
+                        changed.push_back(slot);
+                    }
+                }
+            }
+
+            if (reads && lossless) {
+                space_notifier_.notify();
+            }
+            if (changed.empty()) {
+                if (reads) {
+                    waiter.reset();
+                } else {
+                    waiter.idle(has_data);
+                }
+                continue;
+            }
+            waiter.reset();
+
+            batch.clear();
+            for (uint32_t slot : changed) {
+                batch.push_back(latest[slot]);
+                dirty[slot] = 0;
+            }
+            changed.clear();
+
+            SubscriberCounters::bump(counters.delivered, batch.size());
+            timed_call(counters, [&] { subscriber.batch_callback(data_type, batch.data(), batch.size()); });
+        }
+    }
+
+    uint32_t symbol_groups_;  // symbol 分组数量
+    uint32_t queue_size_;     // 每个队列的槽位数
+    bool read_only_;          // 连接到其他进程的共享内存队列, 不能写入
+    WaitStrategy producer_wait_;      // 队列对无损订阅者写满时生产者的等待方式
+    WakeupNotifier space_notifier_;   // 无损订阅者读取后唤醒 BLOCKING 的生产者
+    WaitStrategy worker_wait_ = WaitStrategy::SLEEP;  // 消费线程池的等待策略
+    std::vector<std::unique_ptr<MarketDataQueue<Kline>>> kline_queues_;    // 每个分组一个 Kline 队列
+    std::vector<std::unique_ptr<MarketDataQueue<Trade>>> trade_queues_;    // 每个分组一个 Trade 队列
+    std::vector<std::unique_ptr<MarketDataQueue<BookL1>>> book_l1_queues_; // 每个分组一个 BookL1 队列
+    std::vector<std::unique_ptr<MarketDataQueue<CompactKline>>> compact_kline_queues_;
+    std::vector<std::unique_ptr<MarketDataQueue<CompactTrade>>> compact_trade_queues_;
+    std::vector<std::unique_ptr<MarketDataQueue<CompactBookL1>>> compact_book_l1_queues_;
+    std::vector<std::unique_ptr<MarketDataQueue<BookL2Update>>> book_l2_queues_;
+    std::vector<std::unique_ptr<MarketDataQueue<BookSnapshot>>> book_snapshot_queues_;
+    std::unique_ptr<SymbolRegistry> symbols_;  // 紧凑消息的 symbol 名字 <-> ID
+    WakeupNotifier notifiers_[kDataTypeCount];  // 每种数据类型一个, 唤醒 BLOCKING 订阅者
+    std::unordered_map<int, std::unique_ptr<Subscriber>> subscribers_;  // 订阅者映射
+    mutable std::mutex mutex_;  // 保护 subscribers_
+    int next_subscriber_id_;    // 下一个订阅者ID
+    std::vector<std::unique_ptr<PoolWorker>> workers_;  // 消费线程池, 为空时每个订阅一个线程
+};
+
+/**
+ * MockCppProducer - C++ 模拟数据生产者
+ *
+ * 在纯 C++ 层生成数据，用于测试无 GIL 情况下的性能
+ */
+class MockCppProducer {
+public:
+    MockCppProducer(MarketDataHub* hub)
+        : hub_(hub), thread_(nullptr) {}
+
+    ~MockCppProducer() {
+        stop();
+    }
+
+    /**
+     * 启动生产者线程
+     * @param num_messages 要生成的消息数量
+     * @param message_type 消息类型 (0=Trade, 1=Kline, 2=BookL1)
+     * @param placement 生产者线程的 CPU/调度/NUMA 放置, 失败时抛出 std::runtime_error
+     */
+    void start(uint64_t num_messages, int message_type = 0, const ThreadPlacement& placement = {}) {
+        if (running_) return;
+        if (hub_->read_only()) {
+            throw std::logic_error("cannot produce into a read-only hub");
+        }
+
+        running_ = true;
+        num_messages_ = num_messages;
+        message_type_ = message_type;
+
+        try {
+            thread_ = start_placed_thread(placement, [this] { producer_thread(); });
+        } catch (...) {
+            running_ = false;
+            throw;
+        }
+    }
+
+    /**
+     * 停止生产者线程
+     */
+    void stop() {
+        running_ = false;
+        if (thread_ && thread_->joinable()) {
+            thread_->join();
+        }
+    }
+
+    /**
+     * 等待生产完成
+     */
+    void wait() {
+        if (thread_ && thread_->joinable()) {
+            thread_->join();
+        }
+    }
+
+    /**
+     * 获取已生产的消息数量
+     */
+    uint64_t messages_produced() const {
+        return messages_produced_;
+    }
+
+private:
+    void producer_thread() {
+        messages_produced_ = 0;
+
+        for (uint64_t i = 0; i < num_messages_ && running_.load(std::memory_order_relaxed); ++i) {
+            // 直接在队列槽位中填写数据, 不构造临时对象
+            if (message_type_ == 0) {
+                // 生成 Trade
+                hub_->emplace<Trade>("BTCUSDT", [i](Trade& trade) {
+                    trade.timestamp = i;
+                    trade.price = 50000.0 + (i % 100);
+                    trade.quantity = 1.0;
+                    trade.is_buyer_maker = (i % 2 == 0);
+                });
+            } else if (message_type_ == 1) {
+                // 生成 Kline
+                hub_->emplace<Kline>("BTCUSDT", [i](Kline& kline) {
+                    kline.timestamp = i;
+                    kline.open = 50000.0;
+                    kline.high = 50100.0;
+                    kline.low = 49900.0;
+                    kline.close = 50000.0 + (i % 100);
+                    kline.volume = 100.0;
+                });
+            } else {
+                // 生成 BookL1
+                hub_->emplace<BookL1>("BTCUSDT", [i](BookL1& book) {
+                    book.timestamp = i;
+                    book.bid_price = 50000.0;
+                    book.bid_quantity = 10.0;
+                    book.ask_price = 50001.0;
+                    book.ask_quantity = 10.0;
+                });
+            }
+
+            ++messages_produced_;
+        }
+    }
+
+    MarketDataHub* hub_;
+    std::atomic<bool> running_{false};  // stop() 在调用者线程清除, 生产者线程读取
+    std::unique_ptr<std::thread> thread_;
+    uint64_t num_messages_;
+    int message_type_;
+    std::atomic<uint64_t> messages_produced_{0};
+};
+
+/**
+ * ReplayProducer - 把 MarketDataHub::record() 录制的行情日志重新写入 hub
+ *
+ * 按记录顺序回放, 消息内容 (含原始 timestamp) 与录制时相同.
+ * speed = 0 时尽快回放, 用于压测; speed > 0 时按录制时间 (recv_ns, 单调不减) 的间隔回放,
+ * 1.0 为原速, 2.0 为两倍速. 落后于计划时间时不等待, 直到追上.
+ */
+class ReplayProducer {
+public:
+    explicit ReplayProducer(MarketDataHub* hub) : hub_(hub) {}
+
+    ~ReplayProducer() {
+        stop();
+    }
+
+    ReplayProducer(const ReplayProducer&) = delete;
+    ReplayProducer& operator=(const ReplayProducer&) = delete;
+
+    /**
+     * 打开日志并启动回放线程; 日志无效时在调用线程抛出异常
+     * @param path 日志路径
+     * @param speed 回放速度, 0 表示不控制节奏
+     * @param placement 回放线程的 CPU/调度/NUMA 放置
+     */
+    void start(const std::string& path, double speed = 0.0, const ThreadPlacement& placement = {}) {
+        if (running_) return;
+        if (hub_->read_only()) {
+            throw std::logic_error("cannot produce into a read-only hub");
+        }
+        if (speed < 0) {
+            throw std::invalid_argument("replay speed must be >= 0");
+        }
+        wait();  // 回收上一次已结束的回放线程
+
+        journal_ = std::make_unique<JournalReader>(path);
+        speed_ = speed;
+        messages_produced_ = 0;
+        running_ = true;
+        try {
+            thread_ = start_placed_thread(placement, [this] { producer_thread(); });
+        } catch (...) {
+            running_ = false;
+            throw;
+        }
+    }
+
+    /**
+     * 停止回放线程
+     */
+    void stop() {
+        running_ = false;
+        wait();
+    }
+
+    /**
+     * 等待回放完成
+     */
+    void wait() {
+        if (thread_ && thread_->joinable()) {
+            thread_->join();
+        }
+    }
+
+    /**
+     * 已回放的消息数量
+     */
+    uint64_t messages_produced() const {
+        return messages_produced_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 当前日志的记录数, start() 之前为 0
+     */
+    uint64_t journal_size() const {
+        return journal_ ? journal_->size() : 0;
+    }
+
+private:
+    void producer_thread() {
+        const JournalReader& journal = *journal_;
+        const auto begin = std::chrono::steady_clock::now();
+        const uint64_t base_ns = journal.empty() ? 0 : journal[0].recv_ns;
+
+        uint64_t produced = 0;
+        for (const JournalRecord& record : journal) {
+            if (!running_.load(std::memory_order_relaxed)) {
+                break;
+            }
+            if (speed_ > 0 && record.recv_ns > base_ns) {
+                auto offset = std::chrono::nanoseconds(static_cast<int64_t>((record.recv_ns - base_ns) / speed_));
+                wait_until(begin + offset);
+            }
+
+            switch (record.type()) {
+                case DataType::KLINE:
+                    hub_->add(record.as<Kline>());
+                    break;
+                case DataType::TRADE:
+                    hub_->add(record.as<Trade>());
+                    break;
+                case DataType::BOOK_L1:
+                    hub_->add(record.as<BookL1>());
+                    break;
+                default:
+                    continue;  // 未知类型 (更新版本写入的日志), 跳过
+            }
+            messages_produced_.store(++produced, std::memory_order_relaxed);
+        }
+        running_ = false;
+    }
+
+    // 远的时候先睡眠, 最后 100us 自旋, 回放间隔不受 timer slack 影响
+    static void wait_until(std::chrono::steady_clock::time_point deadline) {
+        constexpr auto kSpinWindow = std::chrono::microseconds(100);
+        auto now = std::chrono::steady_clock::now();
+        if (deadline - now > 2 * kSpinWindow) {
+            std::this_thread::sleep_until(deadline - kSpinWindow);
+        }
+        while (std::chrono::steady_clock::now() < deadline) {
+            cpu_relax();
+        }
+    }
+
+    MarketDataHub* hub_;
+    std::unique_ptr<JournalReader> journal_;
+    double speed_ = 0.0;
+    std::atomic<bool> running_{false};  // stop() 在调用者线程清除, 回放结束时由回放线程清除
+    std::unique_ptr<std::thread> thread_;
+    std::atomic<uint64_t> messages_produced_{0};
+};
+
+/**
+ * 暂存环中的一条消息: 数据类型加任意一种消息的原始内容
+ * BookSnapshot 比其他消息大得多, 不经过暂存环 (只由 BookBuilder 写入)
+ */
+struct StagedMessage {
+    DataType data_type;
+    alignas(8) unsigned char payload[std::max({sizeof(Kline), sizeof(Trade), sizeof(BookL1), sizeof(CompactKline),
+                                               sizeof(CompactTrade), sizeof(CompactBookL1), sizeof(BookL2Update)})];
+
+    template <class T>
+    void store(const T& msg) {
+        static_assert(std::is_trivially_copyable_v<T>, "staged messages are raw copies");
+        static_assert(sizeof(T) <= sizeof(payload), "message is too large to be staged");
+        data_type = data_type_of<T>();
+        std::memcpy(payload, &msg, sizeof(T));
+    }
+
+    // payload 中保存的消息, T 必须与 data_type 对应
+    template <class T>
+    const T& as() const {
+        return *reinterpret_cast<const T*>(payload);
+    }
+};
+
+struct IngressOptions {
+    uint32_t port_capacity = 4096;                     // 每个生产者暂存环的槽位数, 必须是 2 的幂
+    uint32_t batch = 64;                               // sequencer 每轮从一个暂存环最多转发的条数
+    WaitStrategy producer_wait = WaitStrategy::YIELD;  // 暂存环满时 Port::add() 的等待方式
+    WaitStrategy sequencer_wait = WaitStrategy::PAUSE_SPIN;  // 所有暂存环都为空时 sequencer 的等待方式
+    ThreadPlacement placement;                         // sequencer 线程的 CPU/调度/NUMA 放置
+};
+
+/**
+ * MultiProducerIngress - 多个生产者线程无锁地向同一个 hub 写入
+ *
+ * hub 的每个队列只允许一个写入者. 每个生产者线程用 open_port() 拿到自己的 Port,
+ * Port 内部是一个单写单读的暂存环 (SPMCQueue + 一个 gating Reader, 满了等待而不是覆盖).
+ * 一个 sequencer 线程轮流从各个暂存环取出消息写入 hub, 它是 hub 唯一的写入者;
+ * 运行期间其他线程不能再直接调用 hub 的 add().
+ *
+ * 顺序保证:
+ *   - 同一个 Port 的消息按 add() 的顺序进入 hub, 不同类型之间也是如此
+ *   - 不同 Port 之间没有先后保证: sequencer 每轮从每个 Port 最多取 batch 条,
+ *     一个 Port 的突发最多让其他 Port 多等一轮
+ *   - add() 返回时消息只是进入了暂存环; stop() 会先转发完已经 add() 的消息
+ *
+ * 生产者之间不共享任何写入的缓存行, 每条消息多一次拷贝和 sequencer 的一次转发.
+ */
+class MultiProducerIngress {
+public:
+    static constexpr uint32_t kMaxPorts = 64;
+
+    /**
+     * 一个生产者线程的入口, 只能由一个线程使用
+     */
+    class Port {
+    public:
+        Port(MultiProducerIngress& ingress, uint32_t capacity)
+            : ingress_(ingress), ring_(capacity), reader_(ring_.getGatingReader()) {}
+
+        ~Port() {
+            ring_.releaseReader(reader_);
+        }
+
+        Port(const Port&) = delete;
+        Port& operator=(const Port&) = delete;
+
+        /**
+         * 写入暂存环, 满了按 producer_wait 等待 sequencer 腾出空间
+         */
+        template <class T>
+        void add(const T& msg) {
+            if (!ring_.hasSpace()) {
+                IdleWaiter waiter(ingress_.options_.producer_wait, ingress_.space_notifier_);
+                ring_.waitForSpace(1, [&] {
+                    waiter.idle([&] { return ring_.hasSpace(); });
+                });
+            }
+            publish(msg);
+        }
+
+        void add(const MarketData& data) {
+            std::visit([this](const auto& msg) { add(msg); }, data);
+        }
+
+        /**
+         * 不等待的 add(): 暂存环满时返回 false, 消息不写入
+         */
+        template <class T>
+        bool try_add(const T& msg) {
+            if (!ring_.hasSpace()) {
+                return false;
+            }
+            publish(msg);
+            return true;
+        }
+
+        // 消息最终写入的 hub
+        MarketDataHub* hub() const {
+            return ingress_.hub_;
+        }
+
+    private:
+        friend class MultiProducerIngress;
+
+        template <class T>
+        void publish(const T& msg) {
+            ring_.claim().store(msg);
+            ring_.commit();
+            ingress_.data_notifier_.notify();
+        }
+
+        MultiProducerIngress& ingress_;
+        DynamicSPMCQueue<StagedMessage> ring_;
+        DynamicSPMCQueue<StagedMessage>::Reader reader_;  // 只由 sequencer 线程使用
+    };
+
+    /**
+     * 创建并启动 sequencer 线程; placement 失败时抛出 std::runtime_error
+     */
+    explicit MultiProducerIngress(MarketDataHub* hub, const IngressOptions& options = {})
+        : hub_(hub), options_(options) {
+        if (hub_->read_only()) {
+            throw std::logic_error("cannot produce into a read-only hub");
+        }
+        if (!options_.port_capacity || (options_.port_capacity & (options_.port_capacity - 1))) {
+            throw std::invalid_argument("port_capacity must be a power of 2");
+        }
+        if (options_.batch == 0) {
+            throw std::invalid_argument("batch must be > 0");
+        }
+        if (options_.producer_wait == WaitStrategy::BLOCKING) {
+            space_notifier_.add_blocking_subscriber();
+        }
+        if (options_.sequencer_wait == WaitStrategy::BLOCKING) {
+            data_notifier_.add_blocking_subscriber();
+        }
+
+        running_ = true;
+        thread_ = start_placed_thread(options_.placement, [this] { sequencer_thread(); });
+    }
+
+    ~MultiProducerIngress() {
+        stop();
+    }
+
+    MultiProducerIngress(const MultiProducerIngress&) = delete;
+    MultiProducerIngress& operator=(const MultiProducerIngress&) = delete;
+
+    /**
+     * 为一个生产者线程创建 Port, 可以在运行期间调用; Port 由 ingress 持有, 超过 kMaxPorts 时抛出异常
+     */
+    Port& open_port() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t n = port_count_.load(std::memory_order_relaxed);
+        if (n == kMaxPorts) {
+            throw std::runtime_error("too many ingress ports (max " + std::to_string(kMaxPorts) + ")");
+        }
+        ports_[n] = std::make_unique<Port>(*this, options_.port_capacity);
+        port_count_.store(n + 1, std::memory_order_release);
+        return *ports_[n];
+    }
+
+    /**
+     * 转发完已经 add() 的消息后停止 sequencer; 之后 Port::add() 不再被转发
+     */
+    void stop() {
+        running_ = false;
+        data_notifier_.wake_all();
+        if (thread_ && thread_->joinable()) {
+            thread_->join();
+        }
+    }
+
+    /**
+     * 已写入 hub 的消息数量
+     */
+    uint64_t messages_forwarded() const {
+        return messages_forwarded_.load(std::memory_order_relaxed);
+    }
+
+    uint32_t port_count() const {
+        return port_count_.load(std::memory_order_acquire);
+    }
+
+private:
+    void sequencer_thread() {
+        IdleWaiter waiter(options_.sequencer_wait, data_notifier_);
+        auto has_data = [this] {
+            for (uint32_t i = 0; i < port_count(); ++i) {
+                if (!ports_[i]->reader_.empty()) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        auto forward = [this](const StagedMessage& msg) {
+            switch (msg.data_type) {
+                case DataType::KLINE:
+                    hub_->add(msg.as<Kline>());
+                    break;
+                case DataType::TRADE:
+                    hub_->add(msg.as<Trade>());
+                    break;
+                case DataType::BOOK_L1:
+                    hub_->add(msg.as<BookL1>());
+                    break;
+                case DataType::COMPACT_KLINE:
+                    hub_->add(msg.as<CompactKline>());
+                    break;
+                case DataType::COMPACT_TRADE:
+                    hub_->add(msg.as<CompactTrade>());
+                    break;
+                case DataType::COMPACT_BOOK_L1:
+                    hub_->add(msg.as<CompactBookL1>());
+                    break;
+                case DataType::BOOK_L2:
+                    hub_->add(msg.as<BookL2Update>());
+                    break;
+                case DataType::BOOK_SNAPSHOT:
+                    break;  // 不能暂存
+            }
+        };
+
+        uint64_t forwarded = 0;
+        for (;;) {
+            // 先读标志再转发, stop() 之前 add() 的消息都会在最后一轮被转发
+            const bool stopping = !running_.load(std::memory_order_acquire);
+            const uint32_t ports = port_count();
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < ports; ++i) {
+                // gating Reader 在 drain() 返回后才放行这些槽位, 直接从暂存环转发不用拷贝
+                n += ports_[i]->reader_.drain(forward, options_.batch);
+            }
+
+            if (n != 0) {
+                forwarded += n;
+                messages_forwarded_.store(forwarded, std::memory_order_relaxed);
+                space_notifier_.notify();  // 生产者可能在等暂存环的空间
+                waiter.reset();
+            } else if (stopping) {
+                break;
+            } else {
+                waiter.idle(has_data);
             }
-
-            ++messages_produced_;
         }
     }
 
     MarketDataHub* hub_;
-    bool running_;
+    IngressOptions options_;
+    std::array<std::unique_ptr<Port>, kMaxPorts> ports_;
+    std::atomic<uint32_t> port_count_{0};  // ports_ 的前 port_count_ 个已创建, 只增不减
+    std::mutex mutex_;                     // 串行化 open_port()
+    WakeupNotifier data_notifier_;         // 生产者 -> sequencer: 暂存环有新消息
+    WakeupNotifier space_notifier_;        // sequencer -> 生产者: 暂存环有空间了
+    std::atomic<bool> running_{false};
     std::unique_ptr<std::thread> thread_;
-    uint64_t num_messages_;
-    int message_type_;
-    std::atomic<uint64_t> messages_produced_{0};
+    std::atomic<uint64_t> messages_forwarded_{0};
+};
+
+struct KlineAggregatorOptions {
+    // K线周期 (纳秒), 默认 1s / 1m / 5m
+    std::vector<uint64_t> intervals_ns = {1000000000ull, 60000000000ull, 300000000000ull};
+    bool publish_updates = false;  // 每笔成交后也发布未收盘的 K线 (同一根 K线的 timestamp 不变)
+    // trade 订阅的 symbol/filter/等待策略/线程放置; 默认无损, 丢成交会让 K线出错. 不支持 BLOCKING
+    SubscribeOptions subscribe = [] {
+        SubscribeOptions options;
+        options.lossless = true;
+        return options;
+    }();
+    MultiProducerIngress::Port* port = nullptr;  // 非空时经这个 Port 发布 K线, 否则直接写 hub
+};
+
+/**
+ * KlineAggregator - 在 C++ 订阅线程里由逐笔成交增量生成 K线
+ *
+ * 订阅 Trade 和 CompactTrade, 为每个交易对 x 每个周期维护一根按事件时间 (Trade.timestamp)
+ * 对齐的 OHLCV, 收盘时写回 hub:
+ *   - Trade "BTCUSDT" 生成 Kline "BTCUSDT@1m", CompactTrade 生成 CompactKline, symbol_id 为 "名字@1m" 的 ID
+ *   - Kline.timestamp 是这根 K线的开盘时间 (周期的整数倍), 成交量为区间内成交数量之和
+ *   - 同一交易对下一个区间的成交, 或任一交易对的成交时间越过周期边界时, K线收盘;
+ *     没有成交的区间不生成 K线
+ *   - 属于该交易对已收盘区间的成交 (乱序迟到) 计入 late_trades() 后丢弃. 不同队列
+ *     (symbol 分组, 完整/紧凑) 之间没有顺序, 紧挨周期边界的成交可能因此算作迟到
+ *   - stop() 时未收盘的 K线不发布
+ *   - 每个交易对占用 1 + 周期数个注册表 ID; 注册表满了之后新交易对的成交计入 dropped_trades()
+ *   - "名字@周期" 超过 sizeof(Kline::symbol) - 1 个字符时不生成这个周期的 K线, 成交计入
+ *     dropped_trades(), 不会以截断的名字发布
+ *
+ * 没有设置 port 时聚合器直接调用 hub 的 add(), 必须是 hub 唯一的 Kline 写入者;
+ * hub 同时还有其他写入者时, 用 MultiProducerIngress 给聚合器一个 Port.
+ * 成交也经同一个 ingress 写入且订阅是无损的时, sequencer 和聚合器会互相等待, Port 要足够大.
+ */
+class KlineAggregator {
+public:
+    /**
+     * 订阅成交并开始聚合; 选项无效时抛出异常
+     */
+    explicit KlineAggregator(MarketDataHub* hub, KlineAggregatorOptions options = {})
+        : hub_(hub), options_(std::move(options)) {
+        if (hub_->read_only()) {
+            throw std::logic_error("cannot produce into a read-only hub");
+        }
+        if (options_.intervals_ns.empty()) {
+            throw std::invalid_argument("at least one interval is needed");
+        }
+        for (uint64_t interval : options_.intervals_ns) {
+            if (interval == 0) {
+                throw std::invalid_argument("kline interval must be > 0");
+            }
+            labels_.push_back(interval_label(interval));
+        }
+        subscriber_id_ = hub_->subscribe(Builder(this), options_.subscribe);
+    }
+
+    ~KlineAggregator() {
+        stop();
+    }
+
+    KlineAggregator(const KlineAggregator&) = delete;
+    KlineAggregator& operator=(const KlineAggregator&) = delete;
+
+    /**
+     * 取消成交订阅, 等待订阅线程退出
+     */
+    void stop() {
+        if (subscriber_id_ >= 0) {
+            hub_->unsubscribe(subscriber_id_);
+            subscriber_id_ = -1;
+        }
+    }
+
+    /**
+     * 已收盘并发布的 K线数量
+     */
+    uint64_t bars_closed() const {
+        return bars_closed_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 已发布的未收盘 K线数量 (publish_updates)
+     */
+    uint64_t updates_published() const {
+        return updates_published_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 因属于已收盘区间被丢弃的成交数量
+     */
+    uint64_t late_trades() const {
+        return late_trades_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 因 symbol_id 不在注册表中, 注册表已满无法注册名字, 或输出名字过长而丢弃的成交数量
+     */
+    uint64_t dropped_trades() const {
+        return dropped_trades_.load(std::memory_order_relaxed);
+    }
+
+    const std::vector<uint64_t>& intervals_ns() const {
+        return options_.intervals_ns;
+    }
+
+    /**
+     * 周期的名字, 用作输出 symbol 的后缀: 1s, 1m, 5m, 1h, 1d, 250ms; 不是整毫秒时为 "123ns"
+     */
+    static std::string interval_label(uint64_t interval_ns) {
+        static const std::pair<uint64_t, const char*> units[] = {
+            {86400000000000ull, "d"}, {3600000000000ull, "h"}, {60000000000ull, "m"},
+            {1000000000ull, "s"}, {1000000ull, "ms"}};
+        for (const auto& [unit, suffix] : units) {
+            if (interval_ns % unit == 0) {
+                return std::to_string(interval_ns / unit) + suffix;
+            }
+        }
+        return std::to_string(interval_ns) + "ns";
+    }
+
+private:
+    // 一个交易对在一个周期上正在累积的 K线
+    struct Bar {
+        bool open = false;
+        uint64_t start = 0;         // 开盘时间
+        uint64_t closed_until = 0;  // 上一根已收盘 K线的结束时间, 更早的成交算迟到
+        double open_price = 0, high = 0, low = 0, close = 0, volume = 0;
+        uint32_t out_id = kNoSymbol;  // 紧凑输出的 symbol_id
+        char name[32] = {};           // 输出 symbol, 第一次开盘时生成
+        bool name_too_long = false;   // 输出 symbol 放不进 Kline::symbol, 这根 K线永不开盘
+    };
+
+    // 订阅线程按值持有的 handler, K线状态只在订阅线程里访问
+    class Builder {
+    public:
+        explicit Builder(KlineAggregator* owner)
+            : owner_(owner), next_close_(owner->options_.intervals_ns.size(), 0) {}
+
+        void on_trade(const Trade& trade) {
+            process<false>(intern(trade.symbol), trade.timestamp, trade.price, trade.quantity);
+        }
+
+        void on_trade(const CompactTrade& trade) {
+            process<true>(trade.symbol_id, trade.timestamp, trade.price, trade.quantity);
+        }
+
+    private:
+        template <bool Compact>
+        void process(uint32_t symbol_id, uint64_t ts, double price, double quantity) {
+            // 表的大小以注册表为界, 不按消息里的 ID 任意增长
+            if (!owner_->hub_->has_symbol_id(symbol_id)) {
+                owner_->dropped_trades_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            const std::vector<uint64_t>& intervals = owner_->options_.intervals_ns;
+            const size_t n = intervals.size();
+            std::vector<Bar>& bars = bars_[Compact];
+            if ((size_t(symbol_id) + 1) * n > bars.size()) {
+                bars.resize(std::max((size_t(symbol_id) + 1) * n, bars.size() * 2));
+            }
+
+            bool late = false;
+            bool dropped = false;
+            for (size_t i = 0; i < n; ++i) {
+                const uint64_t interval = intervals[i];
+                const uint64_t start = ts - ts % interval;
+                if (ts >= next_close_[i]) {
+                    close_before(i, ts);
+                    next_close_[i] = start + interval;
+                }
+
+                Bar& bar = bars[size_t(symbol_id) * n + i];
+                if (start < bar.closed_until || (bar.open && start < bar.start)) {
+                    late = true;
+                    continue;
+                }
+                if (bar.open && start > bar.start) {
+                    close(bar, interval, Compact);
+                }
+                if (!bar.open) {
+                    if (bar.name[0] == '\0' && !name_bar<Compact>(bar, symbol_id, i)) {
+                        dropped = true;  // 下一笔成交再尝试注册
+                        continue;
+                    }
+                    bar.open = true;
+                    bar.start = start;
+                    bar.open_price = bar.high = bar.low = price;
+                    bar.volume = 0;
+                }
+                bar.high = std::max(bar.high, price);
+                bar.low = std::min(bar.low, price);
+                bar.close = price;
+                bar.volume += quantity;
+
+                if (owner_->options_.publish_updates) {
+                    emit<Compact>(bar);
+                    owner_->updates_published_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            if (late) {
+                owner_->late_trades_.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (dropped) {
+                owner_->dropped_trades_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // 第 i 个周期上开盘时间 + 周期 <= ts 的 K线全部收盘
+        void close_before(size_t i, uint64_t ts) {
+            const size_t n = owner_->options_.intervals_ns.size();
+            const uint64_t interval = owner_->options_.intervals_ns[i];
+            for (int compact = 0; compact < 2; ++compact) {
+                std::vector<Bar>& bars = bars_[compact];
+                for (size_t j = i; j < bars.size(); j += n) {
+                    Bar& bar = bars[j];
+                    if (bar.open && bar.start + interval <= ts) {
+                        close(bar, interval, compact);
+                    }
+                }
+            }
+        }
+
+        void close(Bar& bar, uint64_t interval, bool compact) {
+            compact ? emit<true>(bar) : emit<false>(bar);
+            bar.open = false;
+            bar.closed_until = bar.start + interval;
+            owner_->bars_closed_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // 生成输出 symbol; 名字过长或紧凑输出的名字注册失败时返回 false, bar 保持未命名
+        template <bool Compact>
+        bool name_bar(Bar& bar, uint32_t symbol_id, size_t i) {
+            if (bar.name_too_long) {
+                return false;
+            }
+            std::string name = std::string(owner_->hub_->symbols().name(symbol_id)) + "@" + owner_->labels_[i];
+            if (name.size() > sizeof(Kline::symbol) - 1) {
+                bar.name_too_long = true;  // 截断后会和别的交易对或周期重名
+                return false;
+            }
+            if (Compact) {
+                bar.out_id = intern(name.c_str());
+                if (bar.out_id == kNoSymbol) {
+                    return false;
+                }
+            }
+            set_symbol(bar.name, name.c_str());
+            return true;
+        }
+
+        // 在订阅线程里注册名字; 注册表已满时返回 kNoSymbol, 异常不能离开订阅线程
+        uint32_t intern(const char* name) {
+            try {
+                return owner_->hub_->symbol_id(name);
+            } catch (const std::length_error&) {
+                return kNoSymbol;
+            }
+        }
+
+        template <bool Compact>
+        void emit(const Bar& bar) {
+            if constexpr (Compact) {
+                CompactKline kline;
+                fill(kline, bar);
+                kline.symbol_id = bar.out_id;
+                owner_->publish(kline);
+            } else {
+                Kline kline;
+                fill(kline, bar);
+                set_symbol(kline.symbol, bar.name);
+                owner_->publish(kline);
+            }
+        }
+
+        template <class K>
+        static void fill(K& kline, const Bar& bar) {
+            kline.timestamp = bar.start;
+            kline.open = bar.open_price;
+            kline.high = bar.high;
+            kline.low = bar.low;
+            kline.close = bar.close;
+            kline.volume = bar.volume;
+        }
+
+        KlineAggregator* owner_;
+        std::vector<Bar> bars_[2];         // [完整, 紧凑], 下标 symbol_id * 周期数 + 周期
+        std::vector<uint64_t> next_close_;  // 每个周期当前区间的结束时间
+    };
+
+    template <class K>
+    void publish(const K& kline) {
+        if (options_.port) {
+            options_.port->add(kline);
+        } else {
+            hub_->add(kline);
+        }
+    }
+
+    MarketDataHub* hub_;
+    KlineAggregatorOptions options_;
+    std::vector<std::string> labels_;  // 每个周期的后缀
+    int subscriber_id_ = -1;
+    std::atomic<uint64_t> bars_closed_{0};
+    std::atomic<uint64_t> updates_published_{0};
+    std::atomic<uint64_t> late_trades_{0};
+    std::atomic<uint64_t> dropped_trades_{0};
+};
+
+struct BookBuilderOptions {
+    uint32_t depth = kBookDepth;     // 快照每侧的档数, 1 .. kBookDepth
+    bool publish_l1 = true;          // 买一或卖一变化时发布 CompactBookL1
+    bool publish_full_l1 = false;    // 同时发布带名字的 BookL1
+    bool publish_snapshots = true;   // 前 depth 档变化时发布 BookSnapshot
+    // L2 订阅的 symbol/filter/等待策略/线程放置; 默认无损, 丢增量会让盘口出错
+    SubscribeOptions subscribe = [] {
+        SubscribeOptions options;
+        options.lossless = true;
+        return options;
+    }();
+};
+
+/**
+ * BookBuilder - 在 C++ 订阅线程里由 L2 增量维护每个交易对的盘口
+ *
+ * 订阅 BookL2Update, 把每个价位的新数量写进该交易对的盘口, 然后按需发布:
+ *   - 买一或卖一 (价格或数量) 变化时发布 CompactBookL1 (以及 BookL1)
+ *   - 前 depth 档有变化时发布 BookSnapshot
+ * 带 kBookL2More 的增量只应用不发布, 一次更新的多个价位在最后一条之后只发布一次.
+ * update_id 小于已应用的最大 update_id 的增量计入 stale_updates() 后丢弃;
+ * 带 kBookL2Reset 的增量 (重新同步的全量快照) 总是被应用.
+ *
+ * 每侧是一个按价格排序的数组, 最优价在数组末尾: 绝大多数增量落在最优价附近,
+ * 插入和删除只移动末尾的几个元素, 前 N 档是最后 N 个元素, 都在相邻的缓存行里.
+ *
+ * BookBuilder 直接写入 hub, 必须是 hub 唯一的 BookSnapshot 写入者;
+ * 发布 L1 时也必须是唯一的 (Compact)BookL1 写入者.
+ */
+class BookBuilder {
+public:
+    /**
+     * 订阅 L2 增量并开始维护盘口; 选项无效时抛出异常
+     */
+    explicit BookBuilder(MarketDataHub* hub, BookBuilderOptions options = {})
+        : hub_(hub), options_(std::move(options)) {
+        if (hub_->read_only()) {
+            throw std::logic_error("cannot produce into a read-only hub");
+        }
+        if (options_.depth == 0 || options_.depth > kBookDepth) {
+            throw std::invalid_argument("book depth must be 1 .. " + std::to_string(kBookDepth));
+        }
+        subscriber_id_ = hub_->subscribe(Builder(this), options_.subscribe);
+    }
+
+    ~BookBuilder() {
+        stop();
+    }
+
+    BookBuilder(const BookBuilder&) = delete;
+    BookBuilder& operator=(const BookBuilder&) = delete;
+
+    /**
+     * 取消 L2 订阅, 等待订阅线程退出
+     */
+    void stop() {
+        if (subscriber_id_ >= 0) {
+            hub_->unsubscribe(subscriber_id_);
+            subscriber_id_ = -1;
+        }
+    }
+
+    /**
+     * 已应用的增量数量
+     */
+    uint64_t updates_applied() const {
+        return updates_applied_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 因 update_id 过期被丢弃的增量数量
+     */
+    uint64_t stale_updates() const {
+        return stale_updates_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 因 symbol_id 不在注册表中被丢弃的增量数量
+     */
+    uint64_t invalid_updates() const {
+        return invalid_updates_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 已发布的 L1 数量 (CompactBookL1, 同时发布的 BookL1 不重复计数)
+     */
+    uint64_t l1_published() const {
+        return l1_published_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 已发布的快照数量
+     */
+    uint64_t snapshots_published() const {
+        return snapshots_published_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Level {
+        double price;
+        double quantity;
+    };
+
+    // 一个交易对的盘口, 每侧最优价在末尾
+    struct Book {
+        std::vector<Level> bids;  // 价格从低到高
+        std::vector<Level> asks;  // 价格从高到低
+        uint64_t update_id = 0;
+        bool l1_changed = false;   // 自上次发布以来
+        bool top_changed = false;
+    };
+
+    // 订阅线程按值持有的 handler, 盘口只在订阅线程里访问
+    class Builder {
+    public:
+        explicit Builder(BookBuilder* owner) : owner_(owner) {}
+
+        void on_book_l2(const BookL2Update& update) {
+            // 盘口表的大小以注册表为界, 不按消息里的 ID 任意增长
+            if (!owner_->hub_->has_symbol_id(update.symbol_id)) {
+                owner_->invalid_updates_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (update.symbol_id >= books_.size()) {
+                books_.resize(std::max(size_t(update.symbol_id) + 1, books_.size() * 2));
+            }
+            Book& book = books_[update.symbol_id];
+            if (update.flags & kBookL2Reset) {
+                book.l1_changed = book.top_changed = true;
+                book.bids.clear();
+                book.asks.clear();
+            } else if (update.update_id < book.update_id) {
+                owner_->stale_updates_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            book.update_id = update.update_id;
+
+            size_t rank = update.is_bid ? apply<true>(book.bids, update.price, update.quantity)
+                                        : apply<false>(book.asks, update.price, update.quantity);
+            book.l1_changed |= rank == 0;
+            book.top_changed |= rank < owner_->options_.depth;
+            owner_->updates_applied_.fetch_add(1, std::memory_order_relaxed);
+
+            if (!(update.flags & kBookL2More)) {
+                publish(book, update);
+            }
+        }
+
+    private:
+        // 价格 a 比 b 差 (离最优价更远)
+        template <bool Bid>
+        static bool worse(double a, double b) {
+            return Bid ? a < b : a > b;
+        }
+
+        /**
+         * 设置一个价位的数量, 0 表示删除; 返回该价位离最优价的档数 (0 为最优), 没有变化时返回 SIZE_MAX
+         */
+        template <bool Bid>
+        static size_t apply(std::vector<Level>& levels, double price, double quantity) {
+            auto it = std::lower_bound(levels.begin(), levels.end(), price,
+                                       [](const Level& level, double p) { return worse<Bid>(level.price, p); });
+            const size_t better = size_t(levels.end() - it);  // 不比 price 差的档数
+            if (it != levels.end() && it->price == price) {
+                if (quantity == 0) {
+                    levels.erase(it);
+                } else if (it->quantity != quantity) {
+                    it->quantity = quantity;
+                } else {
+                    return SIZE_MAX;
+                }
+                return better - 1;
+            }
+            if (quantity == 0) {
+                return SIZE_MAX;
+            }
+            levels.insert(it, Level{price, quantity});
+            return better;
+        }
+
+        void publish(Book& book, const BookL2Update& update) {
+            const BookBuilderOptions& options = owner_->options_;
+            if (book.l1_changed && options.publish_l1) {
+                CompactBookL1 l1;
+                l1.timestamp = update.timestamp;
+                l1.symbol_id = update.symbol_id;
+                if (!book.bids.empty()) {
+                    l1.bid_price = book.bids.back().price;
+                    l1.bid_quantity = book.bids.back().quantity;
+                }
+                if (!book.asks.empty()) {
+                    l1.ask_price = book.asks.back().price;
+                    l1.ask_quantity = book.asks.back().quantity;
+                }
+                owner_->hub_->add(l1);
+                if (options.publish_full_l1) {
+                    owner_->hub_->add(from_compact(l1, owner_->hub_->symbols().name(update.symbol_id)));
+                }
+                owner_->l1_published_.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (book.top_changed && options.publish_snapshots) {
+                // 直接填写队列槽位, 不在栈上拼一份 BookSnapshot 再拷贝
+                owner_->hub_->emplace<BookSnapshot>(update.symbol_id, [&](BookSnapshot& snapshot) {
+                    snapshot.timestamp = update.timestamp;
+                    snapshot.update_id = book.update_id;
+                    snapshot.bid_levels = copy_top(book.bids, options.depth, snapshot.bid_price, snapshot.bid_quantity);
+                    snapshot.ask_levels = copy_top(book.asks, options.depth, snapshot.ask_price, snapshot.ask_quantity);
+                });
+                owner_->snapshots_published_.fetch_add(1, std::memory_order_relaxed);
+            }
+            book.l1_changed = book.top_changed = false;
+        }
+
+        // 从最优价开始拷贝最多 depth 档, 其余档位清零
+        static uint16_t copy_top(const std::vector<Level>& levels, uint32_t depth, double* prices, double* quantities) {
+            const size_t n = std::min<size_t>(depth, levels.size());
+            for (size_t i = 0; i < n; ++i) {
+                const Level& level = levels[levels.size() - 1 - i];
+                prices[i] = level.price;
+                quantities[i] = level.quantity;
+            }
+            for (size_t i = n; i < kBookDepth; ++i) {
+                prices[i] = 0;
+                quantities[i] = 0;
+            }
+            return static_cast<uint16_t>(n);
+        }
+
+        BookBuilder* owner_;
+        std::vector<Book> books_;  // 下标为 symbol_id
+    };
+
+    MarketDataHub* hub_;
+    BookBuilderOptions options_;
+    int subscriber_id_ = -1;
+    std::atomic<uint64_t> updates_applied_{0};
+    std::atomic<uint64_t> stale_updates_{0};
+    std::atomic<uint64_t> invalid_updates_{0};
+    std::atomic<uint64_t> l1_published_{0};
+    std::atomic<uint64_t> snapshots_published_{0};
 };
 
 } // namespace marketdata
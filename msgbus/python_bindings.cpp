@@ -1,61 +1,218 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/functional.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
+#include <limits>
 #include "market_data.hpp"
 #include "market_data_hub.hpp"
+#include "udp_bridge.hpp"
 
 namespace py = pybind11;
 using namespace marketdata;
 
+// Kline/Trade/BookL1 转换为 Python dict
+py::dict to_dict(const Kline& kline) {
+    py::dict result;
+    result["timestamp"] = kline.timestamp;
+    result["open"] = kline.open;
+    result["high"] = kline.high;
+    result["low"] = kline.low;
+    result["close"] = kline.close;
+    result["volume"] = kline.volume;
+    result["symbol"] = std::string(kline.symbol, strnlen(kline.symbol, sizeof(kline.symbol)));
+    return result;
+}
+
+py::dict to_dict(const Trade& trade) {
+    py::dict result;
+    result["timestamp"] = trade.timestamp;
+    result["price"] = trade.price;
+    result["quantity"] = trade.quantity;
+    result["symbol"] = std::string(trade.symbol, strnlen(trade.symbol, sizeof(trade.symbol)));
+    result["is_buyer_maker"] = trade.is_buyer_maker;
+    return result;
+}
+
+py::dict to_dict(const BookL1& book) {
+    py::dict result;
+    result["timestamp"] = book.timestamp;
+    result["bid_price"] = book.bid_price;
+    result["bid_quantity"] = book.bid_quantity;
+    result["ask_price"] = book.ask_price;
+    result["ask_quantity"] = book.ask_quantity;
+    result["symbol"] = std::string(book.symbol, strnlen(book.symbol, sizeof(book.symbol)));
+    return result;
+}
+
+// 紧凑消息只带 symbol_id, 不构造名字字符串; 需要名字时用 hub.symbol_name(id)
+py::dict to_dict(const CompactKline& kline) {
+    py::dict result;
+    result["timestamp"] = kline.timestamp;
+    result["open"] = kline.open;
+    result["high"] = kline.high;
+    result["low"] = kline.low;
+    result["close"] = kline.close;
+    result["volume"] = kline.volume;
+    result["symbol_id"] = kline.symbol_id;
+    return result;
+}
+
+py::dict to_dict(const CompactTrade& trade) {
+    py::dict result;
+    result["timestamp"] = trade.timestamp;
+    result["price"] = trade.price;
+    result["quantity"] = trade.quantity;
+    result["symbol_id"] = trade.symbol_id;
+    result["is_buyer_maker"] = trade.is_buyer_maker;
+    return result;
+}
+
+py::dict to_dict(const CompactBookL1& book) {
+    py::dict result;
+    result["timestamp"] = book.timestamp;
+    result["bid_price"] = book.bid_price;
+    result["bid_quantity"] = book.bid_quantity;
+    result["ask_price"] = book.ask_price;
+    result["ask_quantity"] = book.ask_quantity;
+    result["symbol_id"] = book.symbol_id;
+    return result;
+}
+
+py::dict to_dict(const BookL2Update& update) {
+    py::dict result;
+    result["timestamp"] = update.timestamp;
+    result["update_id"] = update.update_id;
+    result["price"] = update.price;
+    result["quantity"] = update.quantity;
+    result["symbol_id"] = update.symbol_id;
+    result["is_bid"] = update.is_bid;
+    result["flags"] = update.flags;
+    return result;
+}
+
+// 快照的每侧是 [(price, quantity), ...], 从最优价开始
+py::list book_side(const double* prices, const double* quantities, uint16_t levels) {
+    py::list side(levels);
+    for (uint16_t i = 0; i < levels; ++i) {
+        side[i] = py::make_tuple(prices[i], quantities[i]);
+    }
+    return side;
+}
+
+py::dict to_dict(const BookSnapshot& snapshot) {
+    py::dict result;
+    result["timestamp"] = snapshot.timestamp;
+    result["update_id"] = snapshot.update_id;
+    result["symbol_id"] = snapshot.symbol_id;
+    result["bids"] = book_side(snapshot.bid_price, snapshot.bid_quantity, snapshot.bid_levels);
+    result["asks"] = book_side(snapshot.ask_price, snapshot.ask_quantity, snapshot.ask_levels);
+    return result;
+}
+
+// 传给 Python callback 的数据类型名
+const char* data_type_name(DataType data_type) {
+    switch (data_type) {
+        case DataType::KLINE:
+            return "kline";
+        case DataType::TRADE:
+            return "trade";
+        case DataType::BOOK_L1:
+            return "book_l1";
+        case DataType::COMPACT_KLINE:
+            return "compact_kline";
+        case DataType::COMPACT_TRADE:
+            return "compact_trade";
+        case DataType::COMPACT_BOOK_L1:
+            return "compact_book_l1";
+        case DataType::BOOK_L2:
+            return "book_l2";
+        case DataType::BOOK_SNAPSHOT:
+            return "book_snapshot";
+    }
+    return "unknown";
+}
+
+// 一批消息转换为 list[dict], as_numpy=true 时为对应结构化 dtype 的 NumPy 数组
+template <class T>
+py::object to_batch(const T* msgs, size_t count, bool as_numpy) {
+    if (as_numpy) {
+        // 结构化数组的内存布局与 C++ 结构体一致, 整批一次 memcpy, 不逐字段转换
+        // (消费线程的批量缓冲区会被复用, 所以数组持有自己的一份内存)
+        return py::array_t<T>(static_cast<py::ssize_t>(count), msgs);
+    }
+
+    py::list result(count);
+    for (size_t i = 0; i < count; ++i) {
+        result[i] = to_dict(msgs[i]);
+    }
+    return result;
+}
+
+py::dict to_dict(const SubscriberStats& stats) {
+    py::dict d;
+    d["data_type"] = data_type_name(stats.data_type);
+    d["symbol"] = stats.symbol;
+    d["lossless"] = stats.lossless;
+    d["consumed"] = stats.consumed;
+    d["delivered"] = stats.delivered;
+    d["lost"] = stats.lost;
+    d["lag"] = stats.lag;
+    d["callbacks"] = stats.callbacks;
+    d["callback_ns"] = stats.callback_ns;
+    d["callback_p50_ns"] = stats.callback_p50_ns;
+    d["callback_p99_ns"] = stats.callback_p99_ns;
+    d["callback_p999_ns"] = stats.callback_p999_ns;
+    d["callback_max_ns"] = stats.callback_max_ns;
+    d["uptime_ns"] = stats.uptime_ns;
+    return d;
+}
+
 // Python callback wrapper
 // 这个wrapper负责处理GIL(Global Interpreter Lock)
+// 在 free-threaded (3.13t) 解释器上 gil_scoped_acquire 只是挂上本线程的 thread state,
+// 各订阅线程的 callback 真正并行执行, 同一个 callback 被多个订阅共用时需要自己保证线程安全
 class PyCallbackWrapper {
 public:
     PyCallbackWrapper(py::object callback) : callback_(callback) {}
+    PyCallbackWrapper(const PyCallbackWrapper&) = default;
+
+    // unsubscribe / stop_all 在释放 GIL 后销毁订阅者, 引用计数必须在持有 thread state 时减少
+    ~PyCallbackWrapper() {
+        py::gil_scoped_acquire acquire;
+        callback_ = py::object();
+    }
 
     void operator()(DataType data_type, const void* data_ptr) {
         // 获取 GIL (因为要调用Python代码)
         py::gil_scoped_acquire acquire;
 
         try {
+            // 创建Python对象并传递给回调
             switch (data_type) {
-                case DataType::KLINE: {
-                    const Kline* kline = static_cast<const Kline*>(data_ptr);
-                    // 创建Python对象并传递给回调
-                    py::dict result;
-                    result["timestamp"] = kline->timestamp;
-                    result["open"] = kline->open;
-                    result["high"] = kline->high;
-                    result["low"] = kline->low;
-                    result["close"] = kline->close;
-                    result["volume"] = kline->volume;
-                    result["symbol"] = std::string(kline->symbol, strnlen(kline->symbol, sizeof(kline->symbol)));
-                    callback_("kline", result);
-                    break;
-                }
-                case DataType::TRADE: {
-                    const Trade* trade = static_cast<const Trade*>(data_ptr);
-                    py::dict result;
-                    result["timestamp"] = trade->timestamp;
-                    result["price"] = trade->price;
-                    result["quantity"] = trade->quantity;
-                    result["symbol"] = std::string(trade->symbol, strnlen(trade->symbol, sizeof(trade->symbol)));
-                    result["is_buyer_maker"] = trade->is_buyer_maker;
-                    callback_("trade", result);
-                    break;
-                }
-                case DataType::BOOK_L1: {
-                    const BookL1* book = static_cast<const BookL1*>(data_ptr);
-                    py::dict result;
-                    result["timestamp"] = book->timestamp;
-                    result["bid_price"] = book->bid_price;
-                    result["bid_quantity"] = book->bid_quantity;
-                    result["ask_price"] = book->ask_price;
-                    result["ask_quantity"] = book->ask_quantity;
-                    result["symbol"] = std::string(book->symbol, strnlen(book->symbol, sizeof(book->symbol)));
-                    callback_("book_l1", result);
-                    break;
-                }
+                case DataType::KLINE:
+                    callback_(data_type_name(data_type), to_dict(*static_cast<const Kline*>(data_ptr)));
+                    break;
+                case DataType::TRADE:
+                    callback_(data_type_name(data_type), to_dict(*static_cast<const Trade*>(data_ptr)));
+                    break;
+                case DataType::BOOK_L1:
+                    callback_(data_type_name(data_type), to_dict(*static_cast<const BookL1*>(data_ptr)));
+                    break;
+                case DataType::COMPACT_KLINE:
+                    callback_(data_type_name(data_type), to_dict(*static_cast<const CompactKline*>(data_ptr)));
+                    break;
+                case DataType::COMPACT_TRADE:
+                    callback_(data_type_name(data_type), to_dict(*static_cast<const CompactTrade*>(data_ptr)));
+                    break;
+                case DataType::COMPACT_BOOK_L1:
+                    callback_(data_type_name(data_type), to_dict(*static_cast<const CompactBookL1*>(data_ptr)));
+                    break;
+                case DataType::BOOK_L2:
+                    callback_(data_type_name(data_type), to_dict(*static_cast<const BookL2Update*>(data_ptr)));
+                    break;
+                case DataType::BOOK_SNAPSHOT:
+                    callback_(data_type_name(data_type), to_dict(*static_cast<const BookSnapshot*>(data_ptr)));
+                    break;
             }
         } catch (const std::exception& e) {
             // 捕获异常避免C++线程崩溃
@@ -67,7 +224,259 @@ private:
     py::object callback_;
 };
 
+// 批量 callback wrapper
+// 每批只获取一次 GIL, 调用一次 Python callback(data_type, batch)
+// batch 为 list[dict], as_numpy=true 时为对应结构化 dtype 的 NumPy 数组
+class PyBatchCallbackWrapper {
+public:
+    PyBatchCallbackWrapper(py::object callback, bool as_numpy)
+        : callback_(callback), as_numpy_(as_numpy) {}
+    PyBatchCallbackWrapper(const PyBatchCallbackWrapper&) = default;
+
+    ~PyBatchCallbackWrapper() {
+        py::gil_scoped_acquire acquire;
+        callback_ = py::object();
+    }
+
+    void operator()(DataType data_type, const void* data_ptr, size_t count) {
+        py::gil_scoped_acquire acquire;
+
+        try {
+            switch (data_type) {
+                case DataType::KLINE:
+                    callback_(data_type_name(data_type), to_batch(static_cast<const Kline*>(data_ptr), count));
+                    break;
+                case DataType::TRADE:
+                    callback_(data_type_name(data_type), to_batch(static_cast<const Trade*>(data_ptr), count));
+                    break;
+                case DataType::BOOK_L1:
+                    callback_(data_type_name(data_type), to_batch(static_cast<const BookL1*>(data_ptr), count));
+                    break;
+                case DataType::COMPACT_KLINE:
+                    callback_(data_type_name(data_type), to_batch(static_cast<const CompactKline*>(data_ptr), count));
+                    break;
+                case DataType::COMPACT_TRADE:
+                    callback_(data_type_name(data_type), to_batch(static_cast<const CompactTrade*>(data_ptr), count));
+                    break;
+                case DataType::COMPACT_BOOK_L1:
+                    callback_(data_type_name(data_type),
+                              to_batch(static_cast<const CompactBookL1*>(data_ptr), count));
+                    break;
+                case DataType::BOOK_L2:
+                    callback_(data_type_name(data_type), to_batch(static_cast<const BookL2Update*>(data_ptr), count));
+                    break;
+                case DataType::BOOK_SNAPSHOT:
+                    callback_(data_type_name(data_type), to_batch(static_cast<const BookSnapshot*>(data_ptr), count));
+                    break;
+            }
+        } catch (const std::exception& e) {
+            py::print("Error in batch callback:", e.what());
+        }
+    }
+
+private:
+    template <class T>
+    py::object to_batch(const T* msgs, size_t count) const {
+        return ::to_batch(msgs, count, as_numpy_);
+    }
+
+    py::object callback_;
+    bool as_numpy_;
+};
+
+// hub.reader() 返回的对象: 在调用线程 (asyncio 事件循环) 上拉取消息, 不创建线程
+// poll() 很短, 不释放 GIL; close() 后立即归还 eventfd 槽位和无损 cursor
+class PyPollReader {
+public:
+    PyPollReader(MarketDataHub& hub, DataType data_type, const SubscribeOptions& options)
+        : reader_(hub.reader(data_type, options)) {}
+
+    py::object poll(size_t max_n, bool as_numpy) {
+        auto& reader = get();
+        switch (reader.data_type()) {
+            case DataType::KLINE:
+                return poll_as<Kline>(reader, max_n, as_numpy);
+            case DataType::TRADE:
+                return poll_as<Trade>(reader, max_n, as_numpy);
+            case DataType::BOOK_L1:
+                return poll_as<BookL1>(reader, max_n, as_numpy);
+            case DataType::COMPACT_KLINE:
+                return poll_as<CompactKline>(reader, max_n, as_numpy);
+            case DataType::COMPACT_TRADE:
+                return poll_as<CompactTrade>(reader, max_n, as_numpy);
+            case DataType::COMPACT_BOOK_L1:
+                return poll_as<CompactBookL1>(reader, max_n, as_numpy);
+            case DataType::BOOK_L2:
+                return poll_as<BookL2Update>(reader, max_n, as_numpy);
+            case DataType::BOOK_SNAPSHOT:
+                return poll_as<BookSnapshot>(reader, max_n, as_numpy);
+        }
+        return py::list();
+    }
+
+    int fileno() {
+        int fd = get().fileno();
+        if (fd < 0) {
+            throw std::runtime_error("eventfd wakeups are only available on Linux");
+        }
+        return fd;
+    }
+
+    DataType data_type() {
+        return get().data_type();
+    }
+
+    py::dict stats() {
+        return to_dict(get().stats());
+    }
+
+    void close() {
+        reader_.reset();
+    }
+
+    bool closed() const {
+        return !reader_;
+    }
+
+private:
+    MarketDataHub::PollReader& get() {
+        if (!reader_) {
+            throw py::value_error("reader is closed");
+        }
+        return *reader_;
+    }
+
+    template <class T>
+    py::object poll_as(MarketDataHub::PollReader& reader, size_t max_n, bool as_numpy) {
+        // 缓冲区在多次 poll 之间复用, to_batch 复制出去 (消息都是 8 字节对齐的平凡类型)
+        static_assert(alignof(T) <= alignof(uint64_t), "poll buffer is uint64_t aligned");
+        size_t words = (max_n * sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        if (buffer_.size() < words) {
+            buffer_.resize(words);
+        }
+        T* msgs = reinterpret_cast<T*>(buffer_.data());
+        size_t count = reader.poll(msgs, max_n);
+        return to_batch(msgs, count, as_numpy);
+    }
+
+    std::unique_ptr<MarketDataHub::PollReader> reader_;
+    std::vector<uint64_t> buffer_;
+};
+
+// 紧凑消息和 L2 消息的 symbol_id 必须已经注册, 否则抛出 ValueError (其他类型不检查)
+template <class T>
+void check_symbol_id(MarketDataHub& hub, const T& msg) {
+    if constexpr (is_compact_v<T>) {
+        if (!hub.has_symbol_id(msg.symbol_id)) {
+            throw py::value_error("symbol_id " + std::to_string(msg.symbol_id) +
+                                  " is not registered, get ids from hub.symbol_id(name)");
+        }
+    }
+}
+
+// 元素大小等于 sizeof(T) 的缓冲区, 其格式必须描述与注册的 NumPy dtype 相同的字段 (名字, 类型, 偏移),
+// 否则抛出 ValueError. 同一格式字符串只解析一次 (调用时持有 GIL)
+template <class T>
+void check_buffer_format(const py::buffer_info& info) {
+    static std::string accepted_format;
+    if (info.format == accepted_format) {
+        return;
+    }
+    bool matches = false;
+    try {
+        matches = py::dtype(info).equal(py::dtype::of<T>());
+    } catch (const std::exception&) {
+        // 格式字符串 NumPy 不认识, 或不是结构化类型, 按不匹配处理
+    }
+    if (!matches) {
+        throw py::value_error("buffer format '" + info.format + "' does not match " +
+                              std::string(py::str(py::dtype::of<T>())) + ", use the msgbus.*_dtype of the message");
+    }
+    accepted_format = info.format;
+}
+
+// 从实现了 buffer protocol 的对象 (NumPy 结构化数组, bytes, memoryview 等) 批量写入
+// 对齐的内存直接当作 T 数组交给 hub, 不经过 std::vector<T> 转换; 没有按 alignof(T) 对齐时
+// (例如 bytes 切片) 先复制一份
+template <class T>
+void add_batch_from_buffer(MarketDataHub& hub, const py::buffer& buffer) {
+    py::buffer_info info = buffer.request();
+
+    // 只接受 C 连续的内存
+    py::ssize_t expected_stride = info.itemsize;
+    for (py::ssize_t dim = info.ndim - 1; dim >= 0; --dim) {
+        if (info.shape[dim] > 1 && info.strides[dim] != expected_stride) {
+            throw py::value_error("buffer must be C-contiguous");
+        }
+        expected_stride *= info.shape[dim];
+    }
+
+    // 元素要么就是 T (例如 msgbus.trade_dtype 数组), 要么是原始字节
+    if (info.itemsize != 1 && info.itemsize != static_cast<py::ssize_t>(sizeof(T))) {
+        throw py::value_error("buffer item size " + std::to_string(info.itemsize) +
+                              " does not match the message size (" + std::to_string(sizeof(T)) + " bytes)");
+    }
+    if (info.itemsize != 1) {
+        check_buffer_format<T>(info);
+    }
+
+    size_t bytes = static_cast<size_t>(info.size) * static_cast<size_t>(info.itemsize);
+    if (bytes % sizeof(T) != 0) {
+        throw py::value_error("buffer size is not a multiple of the message size (" +
+                              std::to_string(sizeof(T)) + " bytes)");
+    }
+
+    const T* msgs = static_cast<const T*>(info.ptr);
+    size_t n = bytes / sizeof(T);
+    std::vector<T> aligned;
+    if (reinterpret_cast<uintptr_t>(info.ptr) % alignof(T) != 0) {
+        aligned.resize(n);
+        memcpy(aligned.data(), info.ptr, bytes);
+        msgs = aligned.data();
+    }
+    // 先检查所有 symbol_id 再写入, 不会只发布一半
+    for (size_t i = 0; i < n; ++i) {
+        check_symbol_id(hub, msgs[i]);
+    }
+    py::gil_scoped_release release;
+    hub.add_batch(msgs, n);
+}
+
+// 无损订阅者跟不上时先释放 GIL 再等待空间, 否则持有 GIL 的生产者会卡住需要 GIL 的 Python 回调
+template <class T>
+void wait_for_space_without_gil(MarketDataHub& hub, const char* symbol) {
+    if (!hub.has_space<T>(symbol)) {
+        py::gil_scoped_release release;
+        hub.wait_for_space<T>(symbol);
+    }
+}
+
+// 紧凑消息按 symbol_id 路由: 先不等待地写, 队列满时释放 GIL 再按 producer_wait 等待
+template <class T>
+void add_compact(MarketDataHub& hub, const T& msg) {
+    check_symbol_id(hub, msg);
+    if (!hub.try_add(msg)) {
+        py::gil_scoped_release release;
+        hub.add(msg);
+    }
+}
+
+// 同 add_compact: 暂存环满时才释放 GIL 等待 sequencer
+template <class T>
+void add_to_port(MultiProducerIngress::Port& port, const T& msg) {
+    check_symbol_id(*port.hub(), msg);
+    if (!port.try_add(msg)) {
+        py::gil_scoped_release release;
+        port.add(msg);
+    }
+}
+
+// pybind11 2.13 起可以声明模块不依赖 GIL, free-threaded 解释器导入时不会重新启用 GIL
+#if PYBIND11_VERSION_HEX >= 0x020D0000
+PYBIND11_MODULE(_core, m, py::mod_gil_not_used()) {
+#else
 PYBIND11_MODULE(_core, m) {
+#endif
     m.doc() = "msgbus C++ core module - High performance SPMC market data distribution";
 
     // 绑定 DataType 枚举
@@ -75,8 +484,101 @@ PYBIND11_MODULE(_core, m) {
         .value("KLINE", DataType::KLINE)
         .value("TRADE", DataType::TRADE)
         .value("BOOK_L1", DataType::BOOK_L1)
+        .value("COMPACT_KLINE", DataType::COMPACT_KLINE)
+        .value("COMPACT_TRADE", DataType::COMPACT_TRADE)
+        .value("COMPACT_BOOK_L1", DataType::COMPACT_BOOK_L1)
+        .value("BOOK_L2", DataType::BOOK_L2)
+        .value("BOOK_SNAPSHOT", DataType::BOOK_SNAPSHOT)
+        .export_values();
+
+    // 绑定 WaitStrategy 枚举
+    py::enum_<WaitStrategy>(m, "WaitStrategy")
+        .value("BUSY_SPIN", WaitStrategy::BUSY_SPIN)
+        .value("PAUSE_SPIN", WaitStrategy::PAUSE_SPIN)
+        .value("YIELD", WaitStrategy::YIELD)
+        .value("SLEEP", WaitStrategy::SLEEP)
+        .value("BLOCKING", WaitStrategy::BLOCKING)
         .export_values();
 
+    // 绑定 Side 枚举
+    py::enum_<Side>(m, "Side")
+        .value("ANY", Side::ANY)
+        .value("BUY", Side::BUY)
+        .value("SELL", Side::SELL)
+        .export_values();
+
+    // 绑定 SubscriptionFilter
+    py::class_<SubscriptionFilter>(m, "SubscriptionFilter",
+        "Filter evaluated in C++ by the subscriber thread, before the GIL is taken")
+        .def(py::init([](std::vector<std::string> symbols, double min_price, double max_price,
+                         double min_quantity, double max_quantity, Side side) {
+            SubscriptionFilter filter;
+            filter.symbols = std::move(symbols);
+            filter.min_price = min_price;
+            filter.max_price = max_price;
+            filter.min_quantity = min_quantity;
+            filter.max_quantity = max_quantity;
+            filter.side = side;
+            return filter;
+        }), py::arg("symbols") = std::vector<std::string>(),
+           py::arg("min_price") = -std::numeric_limits<double>::infinity(),
+           py::arg("max_price") = std::numeric_limits<double>::infinity(),
+           py::arg("min_quantity") = -std::numeric_limits<double>::infinity(),
+           py::arg("max_quantity") = std::numeric_limits<double>::infinity(),
+           py::arg("side") = Side::ANY,
+           "Args:\n"
+           "  symbols: Only these symbols (only their queues are read), empty = all\n"
+           "  min_price, max_price: Bounds on Trade.price, Kline.close or the BookL1 side's price\n"
+           "  min_quantity, max_quantity: Bounds on Trade.quantity, Kline.volume or the BookL1 side's quantity\n"
+           "  side: Trade aggressor side (BUY = buyer took liquidity) or BookL1 side (BUY = bid);\n"
+           "        ANY passes a BookL1 if either side is within the bounds")
+        .def_readwrite("symbols", &SubscriptionFilter::symbols)
+        .def_readwrite("min_price", &SubscriptionFilter::min_price)
+        .def_readwrite("max_price", &SubscriptionFilter::max_price)
+        .def_readwrite("min_quantity", &SubscriptionFilter::min_quantity)
+        .def_readwrite("max_quantity", &SubscriptionFilter::max_quantity)
+        .def_readwrite("side", &SubscriptionFilter::side);
+
+    // 绑定 ThreadPlacement
+    py::class_<ThreadPlacement>(m, "ThreadPlacement",
+        "CPU affinity, SCHED_FIFO priority and NUMA node for a hub thread")
+        .def(py::init([](std::vector<int> cpus, int sched_priority, int numa_node) {
+            ThreadPlacement placement;
+            placement.cpus = std::move(cpus);
+            placement.sched_priority = sched_priority;
+            placement.numa_node = numa_node;
+            return placement;
+        }), py::arg("cpus") = std::vector<int>(), py::arg("sched_priority") = 0, py::arg("numa_node") = -1,
+           "Args:\n"
+           "  cpus: CPUs the thread may run on (empty = all CPUs of numa_node, or unrestricted)\n"
+           "  sched_priority: > 0 switches the thread to SCHED_FIFO with this priority\n"
+           "  numa_node: >= 0 prefers this node for the thread's memory")
+        .def_readwrite("cpus", &ThreadPlacement::cpus)
+        .def_readwrite("sched_priority", &ThreadPlacement::sched_priority)
+        .def_readwrite("numa_node", &ThreadPlacement::numa_node);
+
+    // 注册 NumPy 结构化 dtype, 字段和内存布局与 C++ 结构体一致
+    PYBIND11_NUMPY_DTYPE(Kline, timestamp, open, high, low, close, volume, symbol);
+    PYBIND11_NUMPY_DTYPE(Trade, timestamp, price, quantity, symbol, is_buyer_maker);
+    PYBIND11_NUMPY_DTYPE(BookL1, timestamp, bid_price, bid_quantity, ask_price, ask_quantity, symbol);
+    m.attr("kline_dtype") = py::dtype::of<Kline>();
+    m.attr("trade_dtype") = py::dtype::of<Trade>();
+    m.attr("book_l1_dtype") = py::dtype::of<BookL1>();
+    PYBIND11_NUMPY_DTYPE(CompactKline, timestamp, open, high, low, close, volume, symbol_id);
+    PYBIND11_NUMPY_DTYPE(CompactTrade, timestamp, price, quantity, symbol_id, is_buyer_maker);
+    PYBIND11_NUMPY_DTYPE(CompactBookL1, timestamp, bid_price, bid_quantity, ask_price, ask_quantity, symbol_id);
+    m.attr("compact_kline_dtype") = py::dtype::of<CompactKline>();
+    m.attr("compact_trade_dtype") = py::dtype::of<CompactTrade>();
+    m.attr("compact_book_l1_dtype") = py::dtype::of<CompactBookL1>();
+    PYBIND11_NUMPY_DTYPE(BookL2Update, timestamp, update_id, price, quantity, symbol_id, is_bid, flags);
+    PYBIND11_NUMPY_DTYPE(BookSnapshot, timestamp, update_id, symbol_id, bid_levels, ask_levels,
+                         bid_price, bid_quantity, ask_price, ask_quantity);
+    m.attr("book_l2_dtype") = py::dtype::of<BookL2Update>();
+    m.attr("book_snapshot_dtype") = py::dtype::of<BookSnapshot>();
+    m.attr("BOOK_L2_RESET") = kBookL2Reset;
+    m.attr("BOOK_L2_MORE") = kBookL2More;
+    m.attr("BOOK_DEPTH") = kBookDepth;
+
     // 绑定 Kline 结构体
     py::class_<Kline>(m, "Kline")
         .def(py::init<>())
@@ -88,10 +590,7 @@ PYBIND11_MODULE(_core, m) {
         .def_readwrite("volume", &Kline::volume)
         .def_property("symbol",
             [](const Kline& k) { return std::string(k.symbol); },
-            [](Kline& k, const std::string& s) {
-                strncpy(k.symbol, s.c_str(), sizeof(k.symbol) - 1);
-                k.symbol[sizeof(k.symbol) - 1] = '\0';
-            });
+            [](Kline& k, const std::string& s) { set_symbol(k.symbol, s.c_str()); });
 
     // 绑定 Trade 结构体
     py::class_<Trade>(m, "Trade")
@@ -102,10 +601,7 @@ PYBIND11_MODULE(_core, m) {
         .def_readwrite("is_buyer_maker", &Trade::is_buyer_maker)
         .def_property("symbol",
             [](const Trade& t) { return std::string(t.symbol); },
-            [](Trade& t, const std::string& s) {
-                strncpy(t.symbol, s.c_str(), sizeof(t.symbol) - 1);
-                t.symbol[sizeof(t.symbol) - 1] = '\0';
-            });
+            [](Trade& t, const std::string& s) { set_symbol(t.symbol, s.c_str()); });
 
     // 绑定 BookL1 结构体
     py::class_<BookL1>(m, "BookL1")
@@ -117,20 +613,127 @@ PYBIND11_MODULE(_core, m) {
         .def_readwrite("ask_quantity", &BookL1::ask_quantity)
         .def_property("symbol",
             [](const BookL1& b) { return std::string(b.symbol); },
-            [](BookL1& b, const std::string& s) {
-                strncpy(b.symbol, s.c_str(), sizeof(b.symbol) - 1);
-                b.symbol[sizeof(b.symbol) - 1] = '\0';
-            });
+            [](BookL1& b, const std::string& s) { set_symbol(b.symbol, s.c_str()); });
+
+    // 绑定紧凑消息结构体, symbol_id 来自 hub.symbol_id(name)
+    py::class_<CompactKline>(m, "CompactKline")
+        .def(py::init<>())
+        .def_readwrite("timestamp", &CompactKline::timestamp)
+        .def_readwrite("open", &CompactKline::open)
+        .def_readwrite("high", &CompactKline::high)
+        .def_readwrite("low", &CompactKline::low)
+        .def_readwrite("close", &CompactKline::close)
+        .def_readwrite("volume", &CompactKline::volume)
+        .def_readwrite("symbol_id", &CompactKline::symbol_id);
+
+    py::class_<CompactTrade>(m, "CompactTrade")
+        .def(py::init<>())
+        .def_readwrite("timestamp", &CompactTrade::timestamp)
+        .def_readwrite("price", &CompactTrade::price)
+        .def_readwrite("quantity", &CompactTrade::quantity)
+        .def_readwrite("symbol_id", &CompactTrade::symbol_id)
+        .def_readwrite("is_buyer_maker", &CompactTrade::is_buyer_maker);
+
+    py::class_<CompactBookL1>(m, "CompactBookL1")
+        .def(py::init<>())
+        .def_readwrite("timestamp", &CompactBookL1::timestamp)
+        .def_readwrite("bid_price", &CompactBookL1::bid_price)
+        .def_readwrite("bid_quantity", &CompactBookL1::bid_quantity)
+        .def_readwrite("ask_price", &CompactBookL1::ask_price)
+        .def_readwrite("ask_quantity", &CompactBookL1::ask_quantity)
+        .def_readwrite("symbol_id", &CompactBookL1::symbol_id);
+
+    py::class_<BookL2Update>(m, "BookL2Update",
+        "New quantity of one price level (0 removes it); flags: BOOK_L2_RESET, BOOK_L2_MORE")
+        .def(py::init<>())
+        .def_readwrite("timestamp", &BookL2Update::timestamp)
+        .def_readwrite("update_id", &BookL2Update::update_id)
+        .def_readwrite("price", &BookL2Update::price)
+        .def_readwrite("quantity", &BookL2Update::quantity)
+        .def_readwrite("symbol_id", &BookL2Update::symbol_id)
+        .def_readwrite("is_bid", &BookL2Update::is_bid)
+        .def_readwrite("flags", &BookL2Update::flags);
+
+    py::class_<BookSnapshot>(m, "BookSnapshot", "Top BOOK_DEPTH levels per side, best price first")
+        .def(py::init<>())
+        .def_readwrite("timestamp", &BookSnapshot::timestamp)
+        .def_readwrite("update_id", &BookSnapshot::update_id)
+        .def_readwrite("symbol_id", &BookSnapshot::symbol_id)
+        .def_property_readonly("bids", [](const BookSnapshot& s) {
+            return book_side(s.bid_price, s.bid_quantity, s.bid_levels);
+        })
+        .def_property_readonly("asks", [](const BookSnapshot& s) {
+            return book_side(s.ask_price, s.ask_quantity, s.ask_levels);
+        });
+
+    // 绑定拉取式 Reader
+    py::class_<PyPollReader>(m, "Reader", "Pull-based reader returned by MarketDataHub.reader()")
+        .def("poll", &PyPollReader::poll, py::arg("max_n") = 1024, py::arg("as_numpy") = false,
+             "Read up to max_n messages without blocking: list[dict], or a NumPy array with as_numpy=True.\n"
+             "An empty result arms the eventfd returned by fileno().")
+        .def("fileno", &PyPollReader::fileno,
+             "eventfd that becomes readable after poll() returned nothing and new data arrives")
+        .def_property_readonly("data_type", &PyPollReader::data_type)
+        .def_property_readonly("closed", &PyPollReader::closed)
+        .def("stats", &PyPollReader::stats,
+             "Counters as in MarketDataHub.stats(); callbacks counts the polls that returned data")
+        .def("close", &PyPollReader::close, "Release the reader's queues and eventfd slot")
+        .def("__enter__", [](py::object self) { return self; })
+        .def("__exit__", [](PyPollReader& reader, py::args) { reader.close(); });
 
     // 绑定 MarketDataHub
     py::class_<MarketDataHub>(m, "MarketDataHub")
-        .def(py::init<>())
+        .def(py::init([](uint32_t symbol_groups, int numa_node, uint32_t queue_size, bool huge_pages,
+                         const std::string& shm_name, WaitStrategy producer_wait, uint32_t worker_threads,
+                         WaitStrategy worker_wait, const ThreadPlacement& worker_placement, uint32_t max_symbols,
+                         bool replace_shm) {
+            HubOptions options;
+            options.symbol_groups = symbol_groups;
+            options.queue_size = queue_size;
+            options.huge_pages = huge_pages;
+            options.numa_node = numa_node;
+            options.shm_name = shm_name;
+            options.producer_wait = producer_wait;
+            options.worker_threads = worker_threads;
+            options.worker_wait = worker_wait;
+            options.worker_placement = worker_placement;
+            options.max_symbols = max_symbols;
+            options.replace_shm = replace_shm;
+            return std::make_unique<MarketDataHub>(options);
+        }), py::arg("symbol_groups") = 1, py::arg("numa_node") = -1, py::arg("queue_size") = kDefaultQueueSize,
+             py::arg("huge_pages") = true, py::arg("shm_name") = "", py::arg("producer_wait") = WaitStrategy::YIELD,
+             py::arg("worker_threads") = 0, py::arg("worker_wait") = WaitStrategy::SLEEP,
+             py::arg("worker_placement") = ThreadPlacement(), py::arg("max_symbols") = 4096,
+             py::arg("replace_shm") = false,
+             "Create a hub with one queue per data type and symbol group\n"
+             "Args:\n"
+             "  symbol_groups: Number of queues per data type, symbols are hashed into groups\n"
+             "  numa_node: Allocate the queues on this NUMA node (usually the producer's), -1 = no binding\n"
+             "  queue_size: Slots per queue, must be a power of 2\n"
+             "  huge_pages: Back queues of 2MB or more with huge pages (MAP_HUGETLB, else THP)\n"
+             "  shm_name: Put the queues in POSIX shared memory (e.g. \"/md\") so other processes can attach\n"
+             "  producer_wait: How add_*() waits when a lossless subscriber is a full queue behind\n"
+             "  worker_threads: Run subscribe() callbacks on this many shared consumer threads, 0 = one thread each\n"
+             "  worker_wait: How the shared consumer threads idle (BLOCKING is not supported)\n"
+             "  worker_placement: Pinning of the shared consumer threads\n"
+             "  max_symbols: Capacity of the symbol registry used by the compact message types\n"
+             "  replace_shm: Unlink shared-memory objects left under shm_name by a crashed creator;\n"
+             "               by default an existing object makes the constructor raise")
+        .def_static("attach", [](const std::string& shm_name) {
+            HubOptions options;
+            options.shm_name = shm_name;
+            options.attach = true;
+            return std::make_unique<MarketDataHub>(options);
+        }, py::arg("shm_name"),
+           "Attach read-only to the shared-memory queues of a hub created in another process\n"
+           "with the same shm_name. The attached hub can subscribe but not publish.")
         .def("add_kline", [](MarketDataHub& hub, const Kline& kline, bool release_gil) {
             if (release_gil) {
                 py::gil_scoped_release release;
-                hub.add(MarketData(kline));
+                hub.add(kline);
             } else {
-                hub.add(MarketData(kline));
+                wait_for_space_without_gil<Kline>(hub, kline.symbol);
+                hub.add(kline);
             }
         }, py::arg("kline"), py::arg("release_gil") = false,
            "Add Kline data to the hub\n"
@@ -138,9 +741,10 @@ PYBIND11_MODULE(_core, m) {
         .def("add_trade", [](MarketDataHub& hub, const Trade& trade, bool release_gil) {
             if (release_gil) {
                 py::gil_scoped_release release;
-                hub.add(MarketData(trade));
+                hub.add(trade);
             } else {
-                hub.add(MarketData(trade));
+                wait_for_space_without_gil<Trade>(hub, trade.symbol);
+                hub.add(trade);
             }
         }, py::arg("trade"), py::arg("release_gil") = false,
            "Add Trade data to the hub\n"
@@ -148,35 +752,97 @@ PYBIND11_MODULE(_core, m) {
         .def("add_book_l1", [](MarketDataHub& hub, const BookL1& book, bool release_gil) {
             if (release_gil) {
                 py::gil_scoped_release release;
-                hub.add(MarketData(book));
+                hub.add(book);
             } else {
-                hub.add(MarketData(book));
+                wait_for_space_without_gil<BookL1>(hub, book.symbol);
+                hub.add(book);
             }
         }, py::arg("book"), py::arg("release_gil") = false,
            "Add BookL1 data to the hub\n"
            "Note: `release_gil=True` can reduce GIL blocking for consumer callbacks, but adds overhead per call.")
+        .def("add_kline", [](MarketDataHub& hub, uint64_t timestamp, double open, double high,
+                             double low, double close, double volume, const std::string& symbol) {
+            wait_for_space_without_gil<Kline>(hub, symbol.c_str());
+            hub.add_kline(timestamp, open, high, low, close, volume, symbol.c_str());
+        }, py::arg("timestamp"), py::arg("open"), py::arg("high"), py::arg("low"),
+           py::arg("close"), py::arg("volume"), py::arg("symbol"),
+           "Add a Kline from its fields, written directly into the queue slot (no Kline object needed)")
+        .def("add_trade", [](MarketDataHub& hub, uint64_t timestamp, double price, double quantity,
+                             const std::string& symbol, bool is_buyer_maker) {
+            wait_for_space_without_gil<Trade>(hub, symbol.c_str());
+            hub.add_trade(timestamp, price, quantity, symbol.c_str(), is_buyer_maker);
+        }, py::arg("timestamp"), py::arg("price"), py::arg("quantity"), py::arg("symbol"),
+           py::arg("is_buyer_maker") = false,
+           "Add a Trade from its fields, written directly into the queue slot (no Trade object needed)")
+        .def("add_book_l1", [](MarketDataHub& hub, uint64_t timestamp, double bid_price, double bid_quantity,
+                               double ask_price, double ask_quantity, const std::string& symbol) {
+            wait_for_space_without_gil<BookL1>(hub, symbol.c_str());
+            hub.add_book_l1(timestamp, bid_price, bid_quantity, ask_price, ask_quantity, symbol.c_str());
+        }, py::arg("timestamp"), py::arg("bid_price"), py::arg("bid_quantity"),
+           py::arg("ask_price"), py::arg("ask_quantity"), py::arg("symbol"),
+           "Add a BookL1 from its fields, written directly into the queue slot (no BookL1 object needed)")
+        .def("try_add", [](MarketDataHub& hub, const Kline& kline) { return hub.try_add(kline); },
+             py::arg("kline"),
+             "Add a Kline without waiting: returns False (and drops nothing) if a lossless\n"
+             "subscriber has not caught up and the queue is full")
+        .def("try_add", [](MarketDataHub& hub, const Trade& trade) { return hub.try_add(trade); },
+             py::arg("trade"), "Add a Trade without waiting, False if the queue is full")
+        .def("try_add", [](MarketDataHub& hub, const BookL1& book) { return hub.try_add(book); },
+             py::arg("book"), "Add a BookL1 without waiting, False if the queue is full")
+        .def("symbol_id", [](MarketDataHub& hub, const std::string& symbol) {
+            return hub.symbol_id(symbol.c_str());
+        }, py::arg("symbol"),
+           "ID of `symbol` for the compact message types, registering it on first use.\n"
+           "An attached hub only looks symbols up and returns 2**32 - 1 for unknown ones.")
+        .def("symbol_name", [](MarketDataHub& hub, uint32_t symbol_id) {
+            return std::string(hub.symbols().name(symbol_id));
+        }, py::arg("symbol_id"), "Name of a registered symbol id, '' if there is none")
+        .def("symbol_count", [](MarketDataHub& hub) { return hub.symbols().size(); },
+             "Number of registered symbols; ids are 0 .. symbol_count() - 1")
+        .def("add_compact", &add_compact<CompactKline>, py::arg("kline"),
+             "Add a CompactKline, routed by symbol_id")
+        .def("add_compact", &add_compact<CompactTrade>, py::arg("trade"),
+             "Add a CompactTrade, routed by symbol_id")
+        .def("add_compact", &add_compact<CompactBookL1>, py::arg("book"),
+             "Add a CompactBookL1, routed by symbol_id")
+        .def("add_compact_klines", &add_batch_from_buffer<CompactKline>, py::arg("klines"),
+             "Add a batch of CompactKline messages from a buffer of dtype msgbus.compact_kline_dtype")
+        .def("add_compact_trades", &add_batch_from_buffer<CompactTrade>, py::arg("trades"),
+             "Add a batch of CompactTrade messages from a buffer of dtype msgbus.compact_trade_dtype")
+        .def("add_compact_books_l1", &add_batch_from_buffer<CompactBookL1>, py::arg("books"),
+             "Add a batch of CompactBookL1 messages from a buffer of dtype msgbus.compact_book_l1_dtype")
+        .def("add_book_l2", &add_compact<BookL2Update>, py::arg("update"),
+             "Add a BookL2Update, routed by symbol_id")
+        .def("add_books_l2", &add_batch_from_buffer<BookL2Update>, py::arg("updates"),
+             "Add a batch of BookL2Update messages from a buffer of dtype msgbus.book_l2_dtype.\n"
+             "L2 feeds should use this: one GIL release and batched queue writes per batch.")
+        .def("add_klines", &add_batch_from_buffer<Kline>, py::arg("klines"),
+           "Add a batch of Kline messages from a buffer, e.g. a NumPy array of dtype msgbus.kline_dtype.\n"
+           "The memory is published as-is with one GIL release and batched queue writes.")
         .def("add_klines", [](MarketDataHub& hub, const std::vector<Kline>& klines) {
             py::gil_scoped_release release;
-            for (const auto& kline : klines) {
-                hub.add(MarketData(kline));
-            }
+            hub.add_batch(klines.data(), klines.size());
         }, py::arg("klines"),
            "Add a batch of Kline messages (releases the GIL once for the whole batch).")
+        .def("add_trades", &add_batch_from_buffer<Trade>, py::arg("trades"),
+           "Add a batch of Trade messages from a buffer, e.g. a NumPy array of dtype msgbus.trade_dtype.\n"
+           "The memory is published as-is with one GIL release and batched queue writes.")
         .def("add_trades", [](MarketDataHub& hub, const std::vector<Trade>& trades) {
             py::gil_scoped_release release;
-            for (const auto& trade : trades) {
-                hub.add(MarketData(trade));
-            }
+            hub.add_batch(trades.data(), trades.size());
         }, py::arg("trades"),
            "Add a batch of Trade messages (releases the GIL once for the whole batch).")
+        .def("add_books_l1", &add_batch_from_buffer<BookL1>, py::arg("books"),
+           "Add a batch of BookL1 messages from a buffer, e.g. a NumPy array of dtype msgbus.book_l1_dtype.\n"
+           "The memory is published as-is with one GIL release and batched queue writes.")
         .def("add_books_l1", [](MarketDataHub& hub, const std::vector<BookL1>& books) {
             py::gil_scoped_release release;
-            for (const auto& book : books) {
-                hub.add(MarketData(book));
-            }
+            hub.add_batch(books.data(), books.size());
         }, py::arg("books"),
            "Add a batch of BookL1 messages (releases the GIL once for the whole batch).")
-        .def("subscribe", [](MarketDataHub& hub, DataType data_type, py::object callback) {
+        .def("subscribe", [](MarketDataHub& hub, DataType data_type, py::object callback, const std::string& symbol,
+                             WaitStrategy wait, const ThreadPlacement& placement, bool lossless,
+                             bool dedicated_thread, const SubscriptionFilter& filter) {
             // 创建 C++ callback wrapper
             auto wrapper = std::make_shared<PyCallbackWrapper>(callback);
             PyCallback cpp_callback = [wrapper](DataType dt, const void* ptr) {
@@ -185,10 +851,89 @@ PYBIND11_MODULE(_core, m) {
 
             // 释放 GIL 让 C++ 线程可以运行
             py::gil_scoped_release release;
-            return hub.subscribe(data_type, std::move(cpp_callback));
-        }, py::arg("data_type"), py::arg("callback"),
+            SubscribeOptions options;
+            options.symbol = symbol;
+            options.wait = wait;
+            options.placement = placement;
+            options.lossless = lossless;
+            options.dedicated_thread = dedicated_thread;
+            options.filter = filter;
+            return hub.subscribe(data_type, std::move(cpp_callback), options);
+        }, py::arg("data_type"), py::arg("callback"), py::arg("symbol") = "",
+           py::arg("wait") = WaitStrategy::SLEEP, py::arg("placement") = ThreadPlacement(),
+           py::arg("lossless") = false, py::arg("dedicated_thread") = false,
+           py::arg("filter") = SubscriptionFilter(),
            "Subscribe to market data with a callback function\n"
-           "Callback signature: callback(data_type: str, data: dict)")
+           "Callback signature: callback(data_type: str, data: dict)\n"
+           "If `symbol` is given, only that symbol's queue is read.\n"
+           "For the COMPACT_* types the symbol is resolved to its id once and messages are\n"
+           "filtered with an integer compare; their dicts carry `symbol_id` instead of `symbol`.\n"
+           "`wait` selects how the subscriber thread idles when no data is available.\n"
+           "`placement` pins the subscriber thread (CPUs, SCHED_FIFO priority, NUMA node).\n"
+           "`lossless=True` makes the producer wait for this subscriber instead of overwriting\n"
+           "messages it has not read yet (for recorders and risk checks).\n"
+           "On a hub with worker_threads, the callback runs on a shared consumer thread (wait and\n"
+           "placement are ignored) unless `lossless` or `dedicated_thread=True` is given.\n"
+           "`filter` (msgbus.SubscriptionFilter) restricts delivery to a symbol set and price/quantity/side\n"
+           "bounds; it is checked in C++, rejected messages never take the GIL.")
+        .def("symbol_groups", &MarketDataHub::symbol_groups,
+             "Get the number of symbol groups (queues per data type)")
+        .def("queue_size", &MarketDataHub::queue_size,
+             "Get the number of slots per queue")
+        .def("read_only", &MarketDataHub::read_only,
+             "True if this hub is attached to another process's shared-memory queues")
+        .def("subscribe_batch", [](MarketDataHub& hub, DataType data_type, py::object callback,
+                                   size_t max_batch, const std::string& symbol, bool as_numpy,
+                                   WaitStrategy wait, const ThreadPlacement& placement, bool lossless,
+                                   const SubscriptionFilter& filter) {
+            auto wrapper = std::make_shared<PyBatchCallbackWrapper>(callback, as_numpy);
+            PyBatchCallback cpp_callback = [wrapper](DataType dt, const void* ptr, size_t count) {
+                (*wrapper)(dt, ptr, count);
+            };
+
+            SubscribeOptions options;
+            options.symbol = symbol;
+            options.wait = wait;
+            options.placement = placement;
+            options.lossless = lossless;
+            options.filter = filter;
+
+            py::gil_scoped_release release;
+            return hub.subscribe_batch(data_type, std::move(cpp_callback), max_batch, options);
+        }, py::arg("data_type"), py::arg("callback"), py::arg("max_batch") = 1024, py::arg("symbol") = "",
+           py::arg("as_numpy") = false, py::arg("wait") = WaitStrategy::SLEEP,
+           py::arg("placement") = ThreadPlacement(), py::arg("lossless") = false,
+           py::arg("filter") = SubscriptionFilter(),
+           "Subscribe with batched delivery: everything available (up to `max_batch` messages)\n"
+           "is drained first, then the callback runs once with the GIL taken once.\n"
+           "Callback signature: callback(data_type: str, data: list[dict])\n"
+           "With `as_numpy=True`, data is a NumPy array of kline_dtype/trade_dtype/book_l1_dtype.\n"
+           "`lossless=True` makes the producer wait for this subscriber, see subscribe().\n"
+           "`filter` is applied while the batch is collected, only matching messages are delivered.")
+        .def("subscribe_conflated", [](MarketDataHub& hub, DataType data_type, py::object callback,
+                                       const std::string& symbol, bool as_numpy, WaitStrategy wait,
+                                       const ThreadPlacement& placement, const SubscriptionFilter& filter) {
+            auto wrapper = std::make_shared<PyBatchCallbackWrapper>(callback, as_numpy);
+            PyBatchCallback cpp_callback = [wrapper](DataType dt, const void* ptr, size_t count) {
+                (*wrapper)(dt, ptr, count);
+            };
+
+            SubscribeOptions options;
+            options.symbol = symbol;
+            options.wait = wait;
+            options.placement = placement;
+            options.filter = filter;
+
+            py::gil_scoped_release release;
+            return hub.subscribe_conflated(data_type, std::move(cpp_callback), options);
+        }, py::arg("data_type"), py::arg("callback"), py::arg("symbol") = "", py::arg("as_numpy") = false,
+           py::arg("wait") = WaitStrategy::SLEEP, py::arg("placement") = ThreadPlacement(),
+           py::arg("filter") = SubscriptionFilter(),
+           "Subscribe with per-symbol conflation (latest-value cache), e.g. for UIs and risk views.\n"
+           "Everything available is drained, only the newest message per symbol is kept, and the\n"
+           "callback gets one batch with the latest value of each symbol that changed since the\n"
+           "previous call. Interleaved symbols never hide each other's updates.\n"
+           "Callback signature: callback(data_type: str, data: list[dict]) (NumPy array with as_numpy=True)")
         .def("unsubscribe", [](MarketDataHub& hub, int subscriber_id) {
             py::gil_scoped_release release;
             hub.unsubscribe(subscriber_id);
@@ -198,7 +943,321 @@ PYBIND11_MODULE(_core, m) {
             hub.stop_all();
         }, "Stop all subscriptions")
         .def("subscriber_count", &MarketDataHub::subscriber_count,
-             "Get current subscriber count");
+             "Get current subscriber count")
+        .def("dropped_count", &MarketDataHub::dropped_count, py::arg("subscriber_id"),
+             "Number of messages a subscriber lost because the producer lapped it")
+        .def("stats", [](const MarketDataHub& hub) {
+            std::vector<SubscriberStats> snapshot;
+            {
+                py::gil_scoped_release release;
+                snapshot = hub.stats();
+            }
+
+            py::dict result;
+            for (const auto& stats : snapshot) {
+                result[py::int_(stats.id)] = to_dict(stats);
+            }
+            return result;
+        },
+           "Per-subscriber counters, keyed by subscriber id:\n"
+           "  consumed: messages read from the queues (including ones filtered out by symbol)\n"
+           "  delivered: messages handed to the callback\n"
+           "  lost: messages overwritten before the subscriber read them\n"
+           "  lag: messages published but not read yet; close to queue_size() means about to be lapped\n"
+           "  callbacks, callback_ns: number of callback calls and total time spent in them\n"
+           "  callback_p50_ns, callback_p99_ns, callback_p999_ns, callback_max_ns: per-call latency\n"
+           "    percentiles from a fixed-size log-bucketed histogram (within 1%)\n"
+           "  uptime_ns: time since subscribing, to turn the counters into rates")
+        .def("reader", [](MarketDataHub& hub, DataType data_type, const std::string& symbol, bool lossless,
+                          const SubscriptionFilter& filter) {
+            SubscribeOptions options;
+            options.symbol = symbol;
+            options.lossless = lossless;
+            options.filter = filter;
+            return std::make_unique<PyPollReader>(hub, data_type, options);
+        }, py::arg("data_type"), py::arg("symbol") = "", py::arg("lossless") = false,
+           py::arg("filter") = SubscriptionFilter(), py::keep_alive<0, 1>(),
+           "Create a pull-based reader that runs on the calling thread, e.g. an asyncio event loop.\n"
+           "reader.poll(max_n) returns what is available without blocking. Once poll() comes back\n"
+           "empty, reader.fileno() (an eventfd) becomes readable when the next message is published,\n"
+           "so the loop can `loop.add_reader(reader.fileno(), ...)` and poll again until empty.\n"
+           "The producer signals at most once per idle -> busy transition. `symbol`, `lossless` and\n"
+           "`filter` behave as in subscribe(). Up to 16 readers per data type; close() releases one.")
+        .def("record", [](MarketDataHub& hub, const std::string& path, const std::string& symbol, bool lossless,
+                          WaitStrategy wait, const ThreadPlacement& placement, const SubscriptionFilter& filter) {
+            SubscribeOptions options;
+            options.symbol = symbol;
+            options.lossless = lossless;
+            options.wait = wait;
+            options.placement = placement;
+            options.filter = filter;
+
+            py::gil_scoped_release release;
+            return hub.record(path, options);
+        }, py::arg("path"), py::arg("symbol") = "", py::arg("lossless") = true,
+           py::arg("wait") = WaitStrategy::SLEEP, py::arg("placement") = ThreadPlacement(),
+           py::arg("filter") = SubscriptionFilter(),
+           "Record every Kline/Trade/BookL1 into an append-only memory-mapped journal at `path`\n"
+           "(plus an index at path + '.idx'). A C++ subscriber thread writes the records; it never\n"
+           "takes the GIL or allocates per message. Lossless by default. Returns a subscriber id,\n"
+           "unsubscribe() closes the journal. Read it with msgbus.JournalReader, replay it with\n"
+           "msgbus.ReplayProducer.");
+
+
+    // 绑定行情日志
+    py::class_<JournalReader>(m, "JournalReader", "Read-only view of a journal written by MarketDataHub.record()")
+        .def(py::init<const std::string&>(), py::arg("path"))
+        .def("__len__", &JournalReader::size)
+        .def("__getitem__", [](const JournalReader& journal, int64_t i) {
+            if (i < 0) {
+                i += static_cast<int64_t>(journal.size());
+            }
+            if (i < 0 || static_cast<uint64_t>(i) >= journal.size()) {
+                throw py::index_error("journal index out of range");
+            }
+            const JournalRecord& record = journal[static_cast<uint64_t>(i)];
+            py::object data = std::visit([](const auto& msg) -> py::object { return to_dict(msg); },
+                                         record.to_market_data());
+            return py::make_tuple(data_type_name(record.type()), data);
+        }, "Record i as (data_type: str, data: dict)")
+        .def("recv_ns", [](const JournalReader& journal, uint64_t i) { return journal.at(i).recv_ns; },
+             py::arg("i"), "Time the recorder received record i (ns): start_wall_ns plus monotonic\n"
+             "time since recording started, so it never goes backwards when the system clock is stepped")
+        .def_property_readonly("start_wall_ns", &JournalReader::start_wall_ns,
+                               "System clock time (ns) when recording started")
+        .def("lower_bound", &JournalReader::lower_bound, py::arg("recv_ns"),
+             "Index of the first record received at or after recv_ns, len(journal) if none");
+
+    py::class_<ReplayProducer>(m, "ReplayProducer",
+        "Replays a journal into a hub from a C++ thread, as fast as possible or paced to the recording")
+        .def(py::init<MarketDataHub*>(), py::arg("hub"), py::keep_alive<1, 2>())
+        .def("start", [](ReplayProducer& producer, const std::string& path, double speed,
+                          const ThreadPlacement& placement) {
+            py::gil_scoped_release release;
+            producer.start(path, speed, placement);
+        }, py::arg("path"), py::arg("speed") = 0.0, py::arg("placement") = ThreadPlacement(),
+           "Start replaying the journal at `path`\n"
+           "Args:\n"
+           "  speed: 0 = as fast as possible, 1.0 = original pacing, 2.0 = twice as fast\n"
+           "  placement: CPUs, SCHED_FIFO priority and NUMA node for the replay thread")
+        .def("stop", [](ReplayProducer& producer) {
+            py::gil_scoped_release release;
+            producer.stop();
+        }, "Stop the replay thread")
+        .def("wait", [](ReplayProducer& producer) {
+            py::gil_scoped_release release;
+            producer.wait();
+        }, "Wait for the replay to finish")
+        .def("messages_produced", &ReplayProducer::messages_produced,
+             "Number of records replayed so far")
+        .def("journal_size", &ReplayProducer::journal_size,
+             "Number of records in the journal being replayed");
+
+    py::class_<MultiProducerIngress::Port>(m, "IngressPort",
+        "One producer thread's entry into a MultiProducerIngress; use each port from a single thread")
+        .def("add", &add_to_port<Kline>, py::arg("kline"))
+        .def("add", &add_to_port<Trade>, py::arg("trade"))
+        .def("add", &add_to_port<BookL1>, py::arg("book"))
+        .def("add", &add_to_port<CompactKline>, py::arg("kline"))
+        .def("add", &add_to_port<CompactTrade>, py::arg("trade"))
+        .def("add", &add_to_port<BookL2Update>, py::arg("update"))
+        .def("add", &add_to_port<CompactBookL1>, py::arg("book"),
+             "Stage a message; waits (without the GIL) per producer_wait while the port is full")
+        .def("try_add", [](MultiProducerIngress::Port& port, const Trade& trade) { return port.try_add(trade); },
+             py::arg("trade"))
+        .def("try_add", [](MultiProducerIngress::Port& port, const Kline& kline) { return port.try_add(kline); },
+             py::arg("kline"))
+        .def("try_add", [](MultiProducerIngress::Port& port, const BookL1& book) { return port.try_add(book); },
+             py::arg("book"), "Stage a message without waiting, False if the port is full");
+
+    py::class_<MultiProducerIngress>(m, "MultiProducerIngress",
+        "Lets several producer threads publish into one hub without locks: each gets a staging ring\n"
+        "(IngressPort), and a C++ sequencer thread, the hub's only writer, merges them into the hub.\n"
+        "Messages of one port keep their order; there is no order between ports.")
+        .def(py::init([](MarketDataHub* hub, uint32_t port_capacity, uint32_t batch, WaitStrategy producer_wait,
+                         WaitStrategy sequencer_wait, const ThreadPlacement& placement) {
+            IngressOptions options;
+            options.port_capacity = port_capacity;
+            options.batch = batch;
+            options.producer_wait = producer_wait;
+            options.sequencer_wait = sequencer_wait;
+            options.placement = placement;
+            return std::make_unique<MultiProducerIngress>(hub, options);
+        }), py::arg("hub"), py::arg("port_capacity") = 4096, py::arg("batch") = 64,
+           py::arg("producer_wait") = WaitStrategy::YIELD, py::arg("sequencer_wait") = WaitStrategy::PAUSE_SPIN,
+           py::arg("placement") = ThreadPlacement(), py::keep_alive<1, 2>())
+        .def("open_port", &MultiProducerIngress::open_port, py::return_value_policy::reference_internal,
+             "Create a port for one producer thread (up to 64)")
+        .def("stop", [](MultiProducerIngress& ingress) {
+            py::gil_scoped_release release;
+            ingress.stop();
+        }, "Forward what has been staged so far, then stop the sequencer")
+        .def("messages_forwarded", &MultiProducerIngress::messages_forwarded,
+             "Number of messages written into the hub")
+        .def("port_count", &MultiProducerIngress::port_count);
+
+    py::class_<KlineAggregator>(m, "KlineAggregator",
+        "Builds OHLCV bars from the hub's Trade / CompactTrade stream in a C++ subscriber thread and\n"
+        "publishes them back as Kline 'BTCUSDT@1m' (or CompactKline with the id of that name) when a\n"
+        "bar closes. Bars are aligned to trade timestamps, Kline.timestamp is the bar's open time.\n"
+        "Without `port` the aggregator must be the hub's only Kline writer.")
+        .def(py::init([](MarketDataHub* hub, const std::vector<uint64_t>& intervals_ns, bool publish_updates,
+                         const std::string& symbol, bool lossless, WaitStrategy wait, const ThreadPlacement& placement,
+                         const SubscriptionFilter& filter, MultiProducerIngress::Port* port) {
+            KlineAggregatorOptions options;
+            options.intervals_ns = intervals_ns;
+            options.publish_updates = publish_updates;
+            options.subscribe.symbol = symbol;
+            options.subscribe.lossless = lossless;
+            options.subscribe.wait = wait;
+            options.subscribe.placement = placement;
+            options.subscribe.filter = filter;
+            options.port = port;
+
+            py::gil_scoped_release release;
+            return std::make_unique<KlineAggregator>(hub, options);
+        }), py::arg("hub"), py::arg("intervals_ns") = KlineAggregatorOptions().intervals_ns,
+           py::arg("publish_updates") = false, py::arg("symbol") = "", py::arg("lossless") = true,
+           py::arg("wait") = WaitStrategy::SLEEP, py::arg("placement") = ThreadPlacement(),
+           py::arg("filter") = SubscriptionFilter(), py::arg("port") = nullptr,
+           py::keep_alive<1, 2>(), py::keep_alive<1, 10>(),
+           "Start aggregating. `intervals_ns` defaults to 1s, 1m and 5m. `publish_updates=True` also\n"
+           "publishes the open bar after every trade (same timestamp until it closes). `symbol` and\n"
+           "`filter` select the trades as in subscribe(); the trade subscription is lossless by default.\n"
+           "`port` routes the bars through a MultiProducerIngress port instead of hub.add().")
+        .def("stop", [](KlineAggregator& aggregator) {
+            py::gil_scoped_release release;
+            aggregator.stop();
+        }, "Unsubscribe from trades; bars still open are not published")
+        .def("bars_closed", &KlineAggregator::bars_closed, "Number of closed bars published")
+        .def("updates_published", &KlineAggregator::updates_published,
+             "Number of in-progress bars published (publish_updates)")
+        .def("late_trades", &KlineAggregator::late_trades,
+             "Trades dropped because their bar had already closed")
+        .def("dropped_trades", &KlineAggregator::dropped_trades,
+             "Trades dropped because the symbol registry is full, their symbol_id is not registered\n"
+             "or '<symbol>@<interval>' does not fit in Kline.symbol (31 characters)")
+        .def("intervals_ns", &KlineAggregator::intervals_ns)
+        .def_static("interval_label", &KlineAggregator::interval_label, py::arg("interval_ns"),
+                    "Suffix used in the output symbol, e.g. 60_000_000_000 -> '1m'");
+
+    py::class_<BookBuilder>(m, "BookBuilder",
+        "Maintains a per-symbol order book from the hub's BOOK_L2 updates in a C++ subscriber thread and\n"
+        "publishes CompactBookL1 (and optionally BookL1) when the best bid/ask changes and BookSnapshot\n"
+        "when one of the top `depth` levels changes. Updates flagged BOOK_L2_MORE are applied without\n"
+        "publishing. The builder must be the hub's only writer of the types it publishes.")
+        .def(py::init([](MarketDataHub* hub, uint32_t depth, bool publish_l1, bool publish_full_l1,
+                         bool publish_snapshots, const std::string& symbol, bool lossless, WaitStrategy wait,
+                         const ThreadPlacement& placement, const SubscriptionFilter& filter) {
+            BookBuilderOptions options;
+            options.depth = depth;
+            options.publish_l1 = publish_l1;
+            options.publish_full_l1 = publish_full_l1;
+            options.publish_snapshots = publish_snapshots;
+            options.subscribe.symbol = symbol;
+            options.subscribe.lossless = lossless;
+            options.subscribe.wait = wait;
+            options.subscribe.placement = placement;
+            options.subscribe.filter = filter;
+
+            py::gil_scoped_release release;
+            return std::make_unique<BookBuilder>(hub, options);
+        }), py::arg("hub"), py::arg("depth") = kBookDepth, py::arg("publish_l1") = true,
+           py::arg("publish_full_l1") = false, py::arg("publish_snapshots") = true, py::arg("symbol") = "",
+           py::arg("lossless") = true, py::arg("wait") = WaitStrategy::SLEEP,
+           py::arg("placement") = ThreadPlacement(), py::arg("filter") = SubscriptionFilter(),
+           py::keep_alive<1, 2>())
+        .def("stop", [](BookBuilder& builder) {
+            py::gil_scoped_release release;
+            builder.stop();
+        }, "Unsubscribe from the L2 updates")
+        .def("updates_applied", &BookBuilder::updates_applied)
+        .def("stale_updates", &BookBuilder::stale_updates,
+             "Updates dropped because their update_id was older than the book's")
+        .def("invalid_updates", &BookBuilder::invalid_updates,
+             "Updates dropped because their symbol_id is not registered")
+        .def("l1_published", &BookBuilder::l1_published)
+        .def("snapshots_published", &BookBuilder::snapshots_published);
+
+    py::class_<UdpSender>(m, "UdpSender",
+        "Publishes the hub's messages as UDP datagrams (usually multicast) from a C++ subscriber thread.\n"
+        "Messages are batched into datagrams of up to max_datagram bytes and sent with sendmmsg; each\n"
+        "message carries a sequence number so receivers can detect loss.")
+        .def(py::init([](MarketDataHub* hub, const std::string& address, uint16_t port, const std::string& interface,
+                         int ttl, bool loopback, uint32_t max_datagram, uint32_t batch, const std::vector<DataType>& types,
+                         const std::string& symbol, bool lossless, WaitStrategy wait, const ThreadPlacement& placement,
+                         const SubscriptionFilter& filter) {
+            UdpSenderOptions options;
+            options.address = address;
+            options.port = port;
+            options.interface = interface;
+            options.ttl = ttl;
+            options.loopback = loopback;
+            options.max_datagram = max_datagram;
+            options.batch = batch;
+            options.types = types;
+            options.subscribe.symbol = symbol;
+            options.subscribe.lossless = lossless;
+            options.subscribe.wait = wait;
+            options.subscribe.placement = placement;
+            options.subscribe.filter = filter;
+
+            py::gil_scoped_release release;
+            return std::make_unique<UdpSender>(hub, options);
+        }), py::arg("hub"), py::arg("address") = UdpSenderOptions().address, py::arg("port") = UdpSenderOptions().port,
+           py::arg("interface") = "", py::arg("ttl") = 1, py::arg("loopback") = true,
+           py::arg("max_datagram") = UdpSenderOptions().max_datagram, py::arg("batch") = UdpSenderOptions().batch,
+           py::arg("types") = std::vector<DataType>(), py::arg("symbol") = "", py::arg("lossless") = false,
+           py::arg("wait") = WaitStrategy::SLEEP, py::arg("placement") = ThreadPlacement(),
+           py::arg("filter") = SubscriptionFilter(), py::keep_alive<1, 2>())
+        .def("stop", [](UdpSender& sender) {
+            py::gil_scoped_release release;
+            sender.stop();
+        }, "Unsubscribe and send the remaining datagrams")
+        .def("messages_sent", &UdpSender::messages_sent)
+        .def("packets_sent", &UdpSender::packets_sent)
+        .def("bytes_sent", &UdpSender::bytes_sent)
+        .def("send_errors", &UdpSender::send_errors, "Datagrams dropped because the send failed")
+        .def("session", &UdpSender::session);
+
+    py::class_<UdpReceiver>(m, "UdpReceiver",
+        "Receives a UdpSender's datagrams with recvmmsg in a C++ thread and writes the messages into the\n"
+        "local hub, mapping symbol ids through the sender's announcements. Sequence gaps are counted,\n"
+        "not retransmitted. The receiver must be the hub's only writer of the types it receives.")
+        .def(py::init([](MarketDataHub* hub, const std::string& address, uint16_t port, const std::string& interface,
+                         uint32_t batch, int rcvbuf, uint32_t max_symbols, const ThreadPlacement& placement) {
+            UdpReceiverOptions options;
+            options.address = address;
+            options.port = port;
+            options.interface = interface;
+            options.batch = batch;
+            options.rcvbuf = rcvbuf;
+            options.max_symbols = max_symbols;
+            options.placement = placement;
+
+            py::gil_scoped_release release;
+            return std::make_unique<UdpReceiver>(hub, options);
+        }), py::arg("hub"), py::arg("address") = UdpReceiverOptions().address,
+           py::arg("port") = UdpReceiverOptions().port, py::arg("interface") = "",
+           py::arg("batch") = UdpReceiverOptions().batch, py::arg("rcvbuf") = UdpReceiverOptions().rcvbuf,
+           py::arg("max_symbols") = 0, py::arg("placement") = ThreadPlacement(), py::keep_alive<1, 2>())
+        .def("stop", [](UdpReceiver& receiver) {
+            py::gil_scoped_release release;
+            receiver.stop();
+        }, "Stop the receiver thread")
+        .def("stats", [](const UdpReceiver& receiver) {
+            UdpReceiverStats stats = receiver.stats();
+            py::dict d;
+            d["packets"] = stats.packets;
+            d["messages"] = stats.messages;
+            d["gaps"] = stats.gaps;
+            d["lost"] = stats.lost;
+            d["duplicates"] = stats.duplicates;
+            d["malformed"] = stats.malformed;
+            d["unknown_symbols"] = stats.unknown_symbols;
+            d["resets"] = stats.resets;
+            return d;
+        }, "Counters: packets, messages, gaps, lost, duplicates, malformed, unknown_symbols, resets");
 
     // 绑定 MockCppProducer
     py::class_<MockCppProducer>(m, "MockCppProducer",
@@ -206,15 +1265,17 @@ PYBIND11_MODULE(_core, m) {
         .def(py::init<MarketDataHub*>(),
              py::arg("hub"),
              "Create a mock C++ producer")
-        .def("start", [](MockCppProducer& producer, uint64_t num_messages, int message_type) {
+        .def("start", [](MockCppProducer& producer, uint64_t num_messages, int message_type,
+                          const ThreadPlacement& placement) {
             // 释放 GIL，让 C++ 线程自由运行
             py::gil_scoped_release release;
-            producer.start(num_messages, message_type);
-        }, py::arg("num_messages"), py::arg("message_type") = 0,
+            producer.start(num_messages, message_type, placement);
+        }, py::arg("num_messages"), py::arg("message_type") = 0, py::arg("placement") = ThreadPlacement(),
            "Start producing messages in C++ thread\n"
            "Args:\n"
            "  num_messages: Number of messages to produce\n"
-           "  message_type: 0=Trade (default), 1=Kline, 2=BookL1")
+           "  message_type: 0=Trade (default), 1=Kline, 2=BookL1\n"
+           "  placement: CPUs, SCHED_FIFO priority and NUMA node for the producer thread")
         .def("stop", [](MockCppProducer& producer) {
             py::gil_scoped_release release;
             producer.stop();
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Page-aligned backing store for runtime-sized SPMCQueue rings.
+ *
+ * A 1M-slot ring is 64MB; with 4KB pages every reader lap walks 16K TLB entries.
+ * anonymous() first tries MAP_HUGETLB (needs pages reserved in vm.nr_hugepages),
+ * then falls back to a 2MB-aligned mapping with MADV_HUGEPAGE so transparent huge
+ * pages can back it. Rings smaller than one huge page always use normal pages,
+ * rounding them up to 2MB would only waste memory.
+ *
+ * The memory is untouched when returned, so the caller can still mbind() it to a
+ * NUMA node before the queue constructor faults it in.
+ *
+ * createShared()/openShared() put the ring in a named POSIX shared-memory object
+ * instead, so readers in other processes can map it. The creator unlinks the name
+ * when its RingMemory is destroyed; processes that already mapped it keep their view.
+ */
+class RingMemory
+{
+public:
+    static constexpr size_t kHugePageSize = size_t(2) << 20;
+
+    enum class Pages
+    {
+        NORMAL,  // 4KB pages
+        HUGETLB, // explicit huge pages from the hugetlbfs pool
+        THP,     // huge-page aligned and advised, the kernel may still use 4KB pages
+    };
+
+    RingMemory() = default;
+
+    RingMemory(RingMemory &&other) noexcept
+        : addr(std::exchange(other.addr, nullptr)), bytes(std::exchange(other.bytes, 0)), pages(other.pages),
+          read_only(other.read_only), shm_name(std::move(other.shm_name))
+    {
+        other.shm_name.clear();
+    }
+
+    RingMemory &operator=(RingMemory &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            addr = std::exchange(other.addr, nullptr);
+            bytes = std::exchange(other.bytes, 0);
+            pages = other.pages;
+            read_only = other.read_only;
+            shm_name = std::move(other.shm_name);
+            other.shm_name.clear();
+        }
+        return *this;
+    }
+
+    RingMemory(const RingMemory &) = delete;
+    RingMemory &operator=(const RingMemory &) = delete;
+
+    ~RingMemory()
+    {
+        release();
+    }
+
+    // Throws std::system_error if no mapping at all can be created
+    static RingMemory anonymous(size_t size, bool huge_pages = true)
+    {
+        if (!huge_pages || size < kHugePageSize)
+        {
+            return RingMemory(map(size), size, Pages::NORMAL);
+        }
+
+        size_t len = roundUp(size, kHugePageSize);
+
+#ifdef MAP_HUGETLB
+        void *huge = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (huge != MAP_FAILED)
+        {
+            return RingMemory(huge, len, Pages::HUGETLB);
+        }
+#endif
+
+        // Over-map by one huge page so the ring can start on a 2MB boundary, then trim both ends
+        size_t span = len + kHugePageSize;
+        char *raw = static_cast<char *>(map(span));
+        char *aligned = reinterpret_cast<char *>(roundUp(reinterpret_cast<uintptr_t>(raw), kHugePageSize));
+        if (aligned != raw)
+        {
+            munmap(raw, size_t(aligned - raw));
+        }
+        if (aligned + len != raw + span)
+        {
+            munmap(aligned + len, size_t(raw + span - (aligned + len)));
+        }
+
+#ifdef MADV_HUGEPAGE
+        // Best effort: THP may be disabled system-wide, the ring still works with 4KB pages
+        if (madvise(aligned, len, MADV_HUGEPAGE) == 0)
+        {
+            return RingMemory(aligned, len, Pages::THP);
+        }
+#endif
+        return RingMemory(aligned, len, Pages::NORMAL);
+    }
+
+    /*
+     * Create the shared-memory object `name` (e.g. "/md.trade.0") with `size` bytes.
+     * An existing object with that name throws std::system_error (EEXIST): it may
+     * belong to a live creator whose readers would silently lose it. Pass replace to
+     * unlink it first, e.g. a stale one left behind by a crashed creator. MAP_HUGETLB
+     * does not apply to /dev/shm, huge_pages only advises THP (honoured when
+     * /sys/kernel/mm/transparent_hugepage/shmem_enabled allows it).
+     */
+    static RingMemory createShared(const std::string &name, size_t size, bool huge_pages = true,
+                                   bool replace = false)
+    {
+        if (replace)
+        {
+            shm_unlink(name.c_str());
+        }
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+        }
+        if (ftruncate(fd, off_t(size)) != 0)
+        {
+            int err = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::system_error(err, std::generic_category(), "ftruncate " + name);
+        }
+
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int err = errno;
+        close(fd);
+        if (p == MAP_FAILED)
+        {
+            shm_unlink(name.c_str());
+            throw std::system_error(err, std::generic_category(), "mmap " + name);
+        }
+
+        RingMemory mem(p, size, Pages::NORMAL);
+        mem.shm_name = name;
+#ifdef MADV_HUGEPAGE
+        if (huge_pages && size >= kHugePageSize && madvise(p, size, MADV_HUGEPAGE) == 0)
+        {
+            mem.pages = Pages::THP;
+        }
+#else
+        (void)huge_pages;
+#endif
+        return mem;
+    }
+
+    // Map an existing shared-memory object created by another process, read-only by default
+    static RingMemory openShared(const std::string &name, bool read_only = true)
+    {
+        int fd = shm_open(name.c_str(), read_only ? O_RDONLY : O_RDWR, 0);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), "fstat " + name);
+        }
+
+        size_t size = size_t(st.st_size);
+        void *p = mmap(nullptr, size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int err = errno;
+        close(fd);
+        if (p == MAP_FAILED)
+        {
+            throw std::system_error(err, std::generic_category(), "mmap " + name);
+        }
+
+        RingMemory mem(p, size, Pages::NORMAL);
+        mem.read_only = read_only;
+        return mem;
+    }
+
+    void *data() const
+    {
+        return addr;
+    }
+
+    size_t size() const
+    {
+        return bytes;
+    }
+
+    Pages pageKind() const
+    {
+        return pages;
+    }
+
+    bool readOnly() const
+    {
+        return read_only;
+    }
+
+private:
+    RingMemory(void *addr, size_t bytes, Pages pages) : addr(addr), bytes(bytes), pages(pages) {}
+
+    static void *map(size_t size)
+    {
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            throw std::system_error(errno, std::generic_category(), "mmap ring memory");
+        }
+        return p;
+    }
+
+    template <class U>
+    static U roundUp(U value, size_t align)
+    {
+        return U((value + align - 1) & ~(align - 1));
+    }
+
+    void release()
+    {
+        if (addr)
+        {
+            munmap(addr, bytes);
+            addr = nullptr;
+        }
+        if (!shm_name.empty())
+        {
+            shm_unlink(shm_name.c_str());
+            shm_name.clear();
+        }
+    }
+
+    void *addr = nullptr;
+    size_t bytes = 0;
+    Pages pages = Pages::NORMAL;
+    bool read_only = false;
+    std::string shm_name; // set for the creator of a shared-memory object, unlinked on release
+
+};
@@ -1,13 +1,134 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 
+#include "ring_memory.hpp"
+
+/*
+ * Number of leading bytes of T that actually carry data; the rest is tail padding.
+ *
+ * When the padding has room for a uint32_t, SPMCQueue stores the block's idx there
+ * instead of in a separate header. E.g. a 57-byte payload padded to 64 then fits a
+ * whole block in one cache line rather than two. Specialize it for message types
+ * whose padding is worth reclaiming (T must then be trivially copyable):
+ *
+ *   template <>
+ *   struct SlotPayloadSize<Msg> : std::integral_constant<size_t, offsetof(Msg, last_field) + sizeof(bool)> {};
+ */
+template <class T>
+struct SlotPayloadSize : std::integral_constant<size_t, sizeof(T)>
+{
+};
+
+/*
+ * Position of one gating reader (lossless mode), on its own cache line.
+ *
+ * The reader stores the idx of the next message it will read after it is done
+ * with the previous one; the writer never reuses a block a gating reader has not
+ * got to yet.
+ */
+struct alignas(64) SPMCGatingCursor
+{
+    std::atomic<uint64_t> next_idx{0};
+    std::atomic<uint32_t> active{0};
+};
+
+struct SPMCGatingState
+{
+    static constexpr uint32_t kMaxReaders = 16;
+
+    // Read by the writer on every gated write, changes only when readers come and go
+    alignas(64) std::atomic<uint32_t> readers{0};
+    SPMCGatingCursor cursors[kMaxReaders];
+};
+
+/*
+ * Layout of a runtime-sized ring: this header, then the blocks from kSize on.
+ *
+ * The layout is versioned so a process attaching to a shared-memory ring can
+ * refuse one written by an incompatible build. The creator fills in everything
+ * else first and stores magic last (release), so a non-zero magic means the
+ * ring is ready to read.
+ *
+ * Sequence numbers (idx) are 64-bit and never wrap. Each block only stores the
+ * low 32 bits as its tag, which keeps the blocks the size they were; see
+ * Reader::locate() for how readers get the full number back. lap_epoch is
+ * write_idx >> kLapEpochShift, on a line of its own that changes once every
+ * 2^31 messages, so readers can check it on every read without a cache miss.
+ */
+struct SPMCRingHeader
+{
+    static constexpr uint64_t kMagic = 0x434d50534745494eull; // "NIEGSPMC"
+    static constexpr uint32_t kVersion = 4;
+    static constexpr size_t kSize = 4096; // blocks start on their own page
+
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t block_size; // sizeof(Block): catches a different T, alignment or idx packing
+    uint32_t data_size;  // sizeof(T)
+
+    // Avoid sharing cache line with the read-mostly fields above
+    alignas(128) uint64_t write_idx;
+    uint64_t gate_limit; // writer's cached bound from the gating cursors
+
+    SPMCGatingState gating;
+
+    alignas(64) std::atomic<uint64_t> lap_epoch;
+};
+
+static_assert(sizeof(SPMCRingHeader) <= SPMCRingHeader::kSize, "SPMCRingHeader must fit in kSize");
+
+// A reader and the writer in the same lap epoch are less than 2^31 messages apart
+constexpr uint32_t kLapEpochShift = 31;
+
+/*
+ * CNT is the number of slots, fixed at compile time and stored inline. CNT = 0
+ * (DynamicSPMCQueue) takes the slot count at construction instead and keeps the
+ * ring, header included, in a separate RingMemory mapping that can use huge pages
+ * or live in shared memory for readers in other processes.
+ */
 template <class T, uint32_t CNT>
 class SPMCQueue
 {
 public:
-    // CNT must be a power of 2
-    static_assert(CNT && !(CNT & (CNT - 1)), "CNT must be a power of 2");
+    // CNT must be a power of 2 (or 0 for a runtime-sized queue)
+    static_assert(!(CNT & (CNT - 1)), "CNT must be a power of 2");
+
+    // Outcome of Reader::readCopy()
+    enum class ReadStatus
+    {
+        OK,      // out holds the next message
+        EMPTY,   // nothing new has been published yet
+        OVERRUN, // out holds a message, but `lost` older ones were overwritten before we got to them
+    };
+
+    struct ReadResult
+    {
+        ReadStatus status;
+        uint64_t lost; // number of messages skipped, non-zero only for OVERRUN
+        uint64_t seq;  // sequence number (idx) of the message in out, for gap detection
+
+        explicit operator bool() const
+        {
+            return status != ReadStatus::EMPTY;
+        }
+    };
+
+    // Outcome of Reader::readCopyBatch()
+    struct BatchResult
+    {
+        uint32_t count;   // messages copied to out
+        uint64_t lost;    // messages overwritten before we got to them, in total
+        uint64_t last_seq; // sequence number of out[count - 1]
+    };
 
     struct Reader
     {
@@ -19,21 +140,181 @@ public:
 
         T *read()
         {
-            auto &blk = q->blks[next_idx % CNT];
-            uint32_t new_idx = ((std::atomic<uint32_t> *)&blk.idx)->load(std::memory_order_acquire);
+            auto &blk = q->ring.at(next_idx);
+            uint64_t new_idx;
 
             // Check if the data is ready
-            if (int(new_idx - next_idx) < 0)
+            if (!locate(blockIdx(blk).load(std::memory_order_acquire), new_idx))
             {
                 return nullptr;
             }
 
             next_idx = new_idx + 1;
+            if (cursor)
+            {
+                // The caller still uses this block, only the ones before it are released
+                cursor->next_idx.store(new_idx, std::memory_order_release);
+            }
             return &blk.data;
         }
 
+        // True if read() would return nothing right now; does not consume anything
+        bool empty() const
+        {
+            uint64_t new_idx;
+            return !locate(blockIdx(q->ring.at(next_idx)).load(std::memory_order_acquire), new_idx);
+        }
+
+        /*
+         * Seqlock-style read: copy the payload out, then re-check the block's idx.
+         *
+         * read() hands out a pointer into the ring, so the writer may overwrite the
+         * block while the caller is still looking at it. readCopy() copies the block
+         * first and only accepts the copy if idx did not change meanwhile, otherwise
+         * it retries. If the writer lapped us, the result is OVERRUN and `lost` says
+         * how many messages were skipped instead of jumping ahead silently.
+         */
+        ReadResult readCopy(T &out)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "readCopy() requires a trivially copyable T");
+
+            auto &blk = q->ring.at(next_idx);
+            auto *idx = &blockIdx(blk);
+
+            while (true)
+            {
+                uint32_t tag = idx->load(std::memory_order_acquire);
+                uint64_t new_idx;
+                if (!locate(tag, new_idx))
+                {
+                    return {ReadStatus::EMPTY, 0, 0};
+                }
+
+                std::memcpy((void *)&out, &blk.data, kDataBytes);
+
+                // Keep the copy above from being reordered after the re-check below
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (idx->load(std::memory_order_relaxed) != tag)
+                {
+                    continue; // torn copy, the writer reused the block under us
+                }
+
+                uint64_t lost = new_idx - next_idx;
+                next_idx = new_idx + 1;
+                if (cursor)
+                {
+                    cursor->next_idx.store(next_idx, std::memory_order_release);
+                }
+                return {lost ? ReadStatus::OVERRUN : ReadStatus::OK, lost, new_idx};
+            }
+        }
+
+        /*
+         * readCopy() for up to max_n messages at once.
+         *
+         * How far the writer has got is read once into ready_idx and only reloaded when
+         * the reader catches up with it, so catching up on a backlog does not load
+         * write_idx (or probe the block after the last one) per message. While copying,
+         * the blocks a few ahead are prefetched, and a gating reader's cursor is stored
+         * once for the whole batch. Each block is still validated like readCopy() does.
+         */
+        BatchResult readCopyBatch(T *out, uint32_t max_n)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "readCopyBatch() requires a trivially copyable T");
+
+            BatchResult result{0, 0, next_idx - 1};
+            while (result.count < max_n && refreshReady())
+            {
+                prefetchAhead();
+
+                auto &blk = q->ring.at(next_idx);
+                auto *idx = &blockIdx(blk);
+                uint32_t tag = idx->load(std::memory_order_acquire);
+                uint64_t new_idx;
+                if (!locate(tag, new_idx))
+                {
+                    break; // write_idx is bumped before the block is published
+                }
+
+                std::memcpy((void *)&out[result.count], &blk.data, kDataBytes);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (idx->load(std::memory_order_relaxed) != tag)
+                {
+                    continue;
+                }
+
+                result.lost += new_idx - next_idx;
+                result.last_seq = new_idx;
+                next_idx = new_idx + 1;
+                ++result.count;
+            }
+
+            if (result.count && cursor)
+            {
+                cursor->next_idx.store(next_idx, std::memory_order_release);
+            }
+            return result;
+        }
+
+        /*
+         * Zero-copy counterpart of readCopyBatch(): calls f(T &) on up to max_n messages
+         * in place and returns how many it visited. Like read(), the writer may overwrite
+         * a block while f is looking at it unless the reader is a gating one; a gating
+         * reader's cursor moves past the batch only after the last f returns.
+         */
+        template <class F>
+        uint32_t drain(F &&f, uint32_t max_n = UINT32_MAX)
+        {
+            uint32_t n = 0;
+            while (n < max_n && refreshReady())
+            {
+                prefetchAhead();
+
+                auto &blk = q->ring.at(next_idx);
+                uint64_t new_idx;
+                if (!locate(blockIdx(blk).load(std::memory_order_acquire), new_idx))
+                {
+                    break;
+                }
+
+                next_idx = new_idx + 1;
+                ++n;
+                f(blk.data);
+            }
+
+            if (n && cursor)
+            {
+                cursor->next_idx.store(next_idx, std::memory_order_release);
+            }
+            return n;
+        }
+
+        // Messages published but not read yet; more than capacity() means some are lost already
+        uint64_t lag() const
+        {
+            return q->published() + 1 - next_idx;
+        }
+
+        // Newest published message, everything before it is skipped
         T *readLast()
         {
+            // Jump straight to the newest block instead of walking the ones before it
+            ready_idx = q->published();
+            if (int64_t(ready_idx - next_idx) > 0)
+            {
+                auto &blk = q->ring.at(ready_idx);
+                if (blockIdx(blk).load(std::memory_order_acquire) == uint32_t(ready_idx))
+                {
+                    next_idx = ready_idx + 1;
+                    if (cursor)
+                    {
+                        cursor->next_idx.store(ready_idx, std::memory_order_release);
+                    }
+                    return &blk.data;
+                }
+            }
+
+            // The newest block is still being written: fall back to the one before it
             T *ret = nullptr;
             while (T *cur = read())
             {
@@ -43,22 +324,339 @@ public:
         }
 
         SPMCQueue<T, CNT> *q = nullptr;
-        uint32_t next_idx;
+        uint64_t next_idx;                  // sequence number of the next message; next_idx - 1 was read last
+        SPMCGatingCursor *cursor = nullptr; // set for readers from getGatingReader()
+        uint64_t ready_idx = 0;             // write_idx as last seen by the batch reads
+
+    private:
+        // Is there anything below the cached write_idx left? Reload it only if not
+        bool refreshReady()
+        {
+            if (next_idx <= ready_idx)
+            {
+                return true;
+            }
+            ready_idx = q->published();
+            return next_idx <= ready_idx;
+        }
+
+        // Touch the block kPrefetchDistance ahead, if the writer has published that far
+        void prefetchAhead() const
+        {
+            const uint64_t ahead = next_idx + kPrefetchDistance;
+            if (ahead <= ready_idx)
+            {
+                const char *blk = reinterpret_cast<const char *>(&q->ring.at(ahead));
+                for (size_t off = 0; off < sizeof(Block); off += 64)
+                {
+                    __builtin_prefetch(blk + off, 0, 3);
+                }
+            }
+        }
+
+        /*
+         * Full sequence number of the message in the block at next_idx, from its 32-bit tag.
+         *
+         * A tag that is not congruent to the block's position is the "being rewritten"
+         * marker stored by the writer. Otherwise the tag is ambiguous only modulo 2^32,
+         * so it is trusted on its own only while the writer is in the reader's lap epoch
+         * (the tag is loaded with acquire first, so the epoch read after it is at least
+         * that of the tagged message): then the tag is the message we want, or the previous
+         * lap's message that it is going to replace (or the initial zero tag). Anything
+         * else - the writer lapped us, or a stalled reader is an epoch or more behind -
+         * recovers the number from the 64-bit write_idx, which is within 2^31 of it.
+         * Returns false if the block holds nothing at or after next_idx yet.
+         */
+        bool locate(uint32_t tag, uint64_t &idx) const
+        {
+            const uint32_t capacity = q->ring.capacity();
+            const uint32_t delta = tag - uint32_t(next_idx);
+            if ((delta & (capacity - 1)) != 0)
+            {
+                return false;
+            }
+            if (q->ring.lapEpoch().load(std::memory_order_relaxed) == next_idx >> kLapEpochShift)
+            {
+                if (delta == 0)
+                {
+                    idx = next_idx;
+                    return true;
+                }
+                if (uint32_t(0u - delta) <= capacity)
+                {
+                    return false;
+                }
+            }
+
+            const uint64_t written = q->published();
+            idx = written + uint64_t(int64_t(int32_t(tag - uint32_t(written))));
+            return idx >= next_idx;
+        }
     };
 
+    SPMCQueue()
+    {
+        static_assert(CNT != 0, "a runtime-sized queue needs a capacity");
+        clearIdx();
+    }
+
+    // Runtime-sized queue backed by fresh anonymous memory
+    explicit SPMCQueue(uint32_t capacity, bool huge_pages = true)
+        : SPMCQueue(capacity, RingMemory::anonymous(storageBytes(capacity), huge_pages))
+    {
+    }
+
+    /*
+     * Runtime-sized queue on caller-provided memory, e.g. a RingMemory that was
+     * mbind()-ed to a NUMA node before first touch, or RingMemory::createShared().
+     * capacity must be a power of 2 and mem at least storageBytes(capacity) long.
+     */
+    SPMCQueue(uint32_t capacity, RingMemory mem)
+    {
+        static_assert(CNT == 0, "capacity is fixed by CNT");
+        if (!capacity || (capacity & (capacity - 1)))
+        {
+            throw std::invalid_argument("SPMCQueue capacity must be a power of 2");
+        }
+        if (mem.size() < storageBytes(capacity) || mem.readOnly())
+        {
+            throw std::invalid_argument("SPMCQueue ring memory is too small or not writable");
+        }
+
+        auto *hdr = new (mem.data()) SPMCRingHeader();
+        hdr->version = SPMCRingHeader::kVersion;
+        hdr->capacity = capacity;
+        hdr->block_size = uint32_t(sizeof(Block));
+        hdr->data_size = uint32_t(sizeof(T));
+        hdr->write_idx = 0;
+
+        mapRing(std::move(mem), capacity);
+        ring.owner = true;
+        for (uint32_t i = 0; i < capacity; ++i)
+        {
+            new (&ring.blks[i]) Block();
+        }
+        clearIdx();
+
+        hdr->magic.store(SPMCRingHeader::kMagic, std::memory_order_release);
+    }
+
+    /*
+     * Attach to a ring created by another SPMCQueue, typically in another process:
+     *
+     *   DynamicSPMCQueue<Msg> q(RingMemory::openShared("/md.trade.0"));
+     *   auto reader = q.getReader();
+     *
+     * The attached queue only reads: use getReader() and the Reader API, never the
+     * write side (the mapping is read-only by default). Throws std::runtime_error if
+     * the ring is not initialized yet or its layout does not match this build.
+     */
+    explicit SPMCQueue(RingMemory mem)
+    {
+        static_assert(CNT == 0, "only a runtime-sized queue can attach to a ring");
+        if (mem.size() < SPMCRingHeader::kSize)
+        {
+            throw std::runtime_error("SPMCQueue ring memory is too small for a header");
+        }
+
+        const auto *hdr = static_cast<const SPMCRingHeader *>(mem.data());
+        if (hdr->magic.load(std::memory_order_acquire) != SPMCRingHeader::kMagic)
+        {
+            throw std::runtime_error("SPMCQueue ring is not initialized");
+        }
+        if (hdr->version != SPMCRingHeader::kVersion)
+        {
+            throw std::runtime_error("SPMCQueue ring layout version " + std::to_string(hdr->version) +
+                                     " is not supported");
+        }
+        if (hdr->block_size != sizeof(Block) || hdr->data_size != sizeof(T))
+        {
+            throw std::runtime_error("SPMCQueue ring was created for a different message type");
+        }
+
+        uint32_t capacity = hdr->capacity;
+        if (!capacity || (capacity & (capacity - 1)) || mem.size() < storageBytes(capacity))
+        {
+            throw std::runtime_error("SPMCQueue ring header is corrupt");
+        }
+        mapRing(std::move(mem), capacity);
+    }
+
+    SPMCQueue(const SPMCQueue &) = delete;
+    SPMCQueue &operator=(const SPMCQueue &) = delete;
+
+    ~SPMCQueue()
+    {
+        if constexpr (CNT == 0 && !std::is_trivially_destructible<Block>::value)
+        {
+            for (uint32_t i = 0; ring.owner && i < ring.capacity(); ++i)
+            {
+                ring.blks[i].~Block();
+            }
+        }
+    }
+
+    // Bytes of RingMemory a runtime-sized queue with this capacity needs
+    static constexpr size_t storageBytes(uint32_t capacity)
+    {
+        return SPMCRingHeader::kSize + size_t(capacity) * sizeof(Block);
+    }
+
+    uint32_t capacity() const
+    {
+        return ring.capacity();
+    }
+
+    // How the ring memory of a runtime-sized queue ended up being backed
+    RingMemory::Pages pageKind() const
+    {
+        if constexpr (CNT == 0)
+        {
+            return ring.mem.pageKind();
+        }
+        else
+        {
+            return RingMemory::Pages::NORMAL;
+        }
+    }
+
+    // idx of the last published message, safe to read from any thread
+    uint64_t published()
+    {
+        return reinterpret_cast<std::atomic<uint64_t> &>(ring.writeIdx()).load(std::memory_order_relaxed);
+    }
+
     Reader getReader()
     {
         Reader reader;
         reader.q = this;
-        reader.next_idx = write_idx + 1;
+        reader.next_idx = ring.writeIdx() + 1;
+        reader.ready_idx = reader.next_idx - 1;
         return reader;
     }
 
+    /*
+     * Lossless mode: a gating reader's position is published in a cursor the writer
+     * checks, so the writer can hold back instead of lapping it.
+     *
+     * Plain write() still overwrites unconditionally; a producer that wants the back
+     * pressure asks first with hasSpace() / waitForSpace() or uses tryWrite(). Up to
+     * SPMCGatingState::kMaxReaders gating readers at a time, each one must be handed
+     * back with releaseReader() or the writer stalls on it forever. Throws
+     * std::runtime_error when all cursors are taken or the ring is mapped read-only.
+     */
+    Reader getGatingReader()
+    {
+        if constexpr (CNT == 0)
+        {
+            if (ring.mem.readOnly())
+            {
+                throw std::runtime_error("gating readers need a writable ring mapping");
+            }
+        }
+
+        auto &gating = ring.gating();
+        for (auto &cursor : gating.cursors)
+        {
+            uint32_t expected = 0;
+            if (!cursor.active.compare_exchange_strong(expected, 1, std::memory_order_acq_rel))
+            {
+                continue;
+            }
+
+            // Publish a conservative position before the writer can see the cursor, then
+            // start from whatever was written by the time the writer counts us in
+            cursor.next_idx.store(ring.writeIdx() + 1, std::memory_order_relaxed);
+            gating.readers.fetch_add(1, std::memory_order_seq_cst);
+
+            Reader reader = getReader();
+            reader.cursor = &cursor;
+            cursor.next_idx.store(reader.next_idx, std::memory_order_release);
+            return reader;
+        }
+        throw std::runtime_error("no free gating cursor");
+    }
+
+    // Stop gating the writer on this reader; the reader keeps working as a plain one
+    void releaseReader(Reader &reader)
+    {
+        if (reader.cursor)
+        {
+            reader.cursor->active.store(0, std::memory_order_release);
+            ring.gating().readers.fetch_sub(1, std::memory_order_release);
+            reader.cursor = nullptr;
+        }
+    }
+
+    /*
+     * Writer side: can the next n messages go in without lapping a gating reader?
+     *
+     * Without gating readers this is a single relaxed load. Otherwise the bound from
+     * the last scan of the cursors is reused until the writer catches up with it,
+     * so the cursors are only read again when the ring looks full.
+     */
+    bool hasSpace(uint32_t n = 1)
+    {
+        auto &gating = ring.gating();
+        const uint64_t next = ring.writeIdx() + 1;
+        const uint64_t last = next + n - 1;
+
+        if (gating.readers.load(std::memory_order_relaxed) == 0)
+        {
+            // Keep the cached bound close to write_idx so it can't wrap around
+            ring.gateLimit() = next - 1;
+            return true;
+        }
+        if (last <= ring.gateLimit())
+        {
+            return true;
+        }
+
+        // Acquire pairs with the readers' release stores: their copies of the blocks
+        // we are about to reuse are complete
+        uint64_t max_lag = 0;
+        for (auto &cursor : gating.cursors)
+        {
+            if (cursor.active.load(std::memory_order_acquire))
+            {
+                uint64_t lag = next - cursor.next_idx.load(std::memory_order_acquire);
+                max_lag = lag > max_lag ? lag : max_lag;
+            }
+        }
+
+        // The slowest reader needs next - max_lag; writing idx overwrites idx - capacity
+        ring.gateLimit() = next - max_lag + ring.capacity() - 1;
+        return last <= ring.gateLimit();
+    }
+
+    // Calls idle() until hasSpace(n); n must not exceed the capacity
+    template <class Idle>
+    void waitForSpace(uint32_t n, Idle &&idle)
+    {
+        while (!hasSpace(n))
+        {
+            idle();
+        }
+    }
+
+    // write() that reports a full ring instead of overwriting a gating reader's data
+    bool tryWrite(const T &data)
+    {
+        if (!hasSpace())
+        {
+            return false;
+        }
+        write(data);
+        return true;
+    }
+
     void write(const T &data)
     {
         // Increment write_idx first, then use it
-        auto &blk = blks[++write_idx % CNT];
-        blk.data = data;
+        const uint64_t idx = ++ring.writeIdx();
+        auto &blk = ring.at(idx);
+        beginOverwrite(blk, idx);
+        storeData(blk, data);
 
         /*
          * Memory ordering explanation:
@@ -87,22 +685,122 @@ public:
          *     std::cout << data << std::endl;           // 4. Guaranteed to see data=42
          * }
          *
-         * (std::atomic<uint32_t>*)&blk.idx gets pointer location, cast to (std::atomic<uint32_t>*)
+         * blockIdx(blk) gets the idx location, cast to (std::atomic<uint32_t>*)
          */
 
-        ((std::atomic<uint32_t> *)&blk.idx)->store(write_idx, std::memory_order_release);
+        blockIdx(blk).store(uint32_t(idx), std::memory_order_release);
     }
 
     void write(T &&data)
     {
-        auto &blk = blks[++write_idx % CNT];
-        blk.data = std::move(data);
-        ((std::atomic<uint32_t> *)&blk.idx)->store(write_idx, std::memory_order_release);
+        const uint64_t idx = ++ring.writeIdx();
+        auto &blk = ring.at(idx);
+        beginOverwrite(blk, idx);
+        if constexpr (kPackedIdx)
+        {
+            storeData(blk, data);
+        }
+        else
+        {
+            blk.data = std::move(data);
+        }
+        blockIdx(blk).store(uint32_t(idx), std::memory_order_release);
+    }
+
+    /*
+     * Batch write: copy n messages into consecutive blocks and publish them together.
+     *
+     * Compared to n calls of write(), the in-progress markers of the whole range are
+     * stored first and the data and idx stores are each separated by a single fence,
+     * and write_idx is bumped once. If n > capacity only the last capacity messages survive
+     * in the ring; the older ones still use up their sequence numbers, so readers see
+     * them as lost rather than silently missing.
+     */
+    void writeBatch(const T *data, size_t n)
+    {
+        const uint32_t cnt = ring.capacity();
+        if (n > cnt)
+        {
+            ring.writeIdx() += n - cnt;
+            data += n - cnt;
+            n = cnt;
+        }
+
+        const uint64_t first = ring.writeIdx() + 1;
+        if (n)
+        {
+            advanceLapEpoch(first + n - 1);
+        }
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            blockIdx(ring.at(first + i)).store(uint32_t(first + i - cnt - 1), std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            storeData(ring.at(first + i), data[i]);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            blockIdx(ring.at(first + i)).store(uint32_t(first + i), std::memory_order_relaxed);
+        }
+        ring.writeIdx() += n;
+    }
+
+    /*
+     * Zero-copy write: writer(T &msg) fills the next message in place inside the ring.
+     *
+     * queue.write([&](Msg &msg) {
+     *     msg.ts = now;
+     *     msg.idx = i;
+     * });
+     *
+     * The block still holds the message from the previous lap, so writer must set
+     * every field it cares about. When the idx is packed into T's tail padding, assign
+     * fields one by one rather than the whole object (msg = Msg{...}).
+     */
+    template <class F>
+    auto write(F &&writer) -> decltype(writer(std::declval<T &>()), void())
+    {
+        writer(claim());
+        commit();
+    }
+
+    /*
+     * Two-step form of write(writer): claim() hands out the next block's data for the
+     * producer to fill in place, commit() publishes it. Readers don't see the message
+     * until commit(), and every claim() must be followed by exactly one commit().
+     */
+    T &claim()
+    {
+        const uint64_t idx = ring.writeIdx() + 1;
+        auto &blk = ring.at(idx);
+        beginOverwrite(blk, idx);
+        return blk.data;
+    }
+
+    void commit()
+    {
+        const uint64_t idx = ++ring.writeIdx();
+        blockIdx(ring.at(idx)).store(uint32_t(idx), std::memory_order_release);
     }
 
 private:
     friend class Reader; // Allow Reader to access SPMCQueue's private members
 
+    // Where the idx goes when it is packed into T's tail padding
+    static constexpr size_t kIdxOffset = (SlotPayloadSize<T>::value + alignof(uint32_t) - 1) & ~(alignof(uint32_t) - 1);
+    static constexpr bool kPackedIdx = kIdxOffset + sizeof(uint32_t) <= sizeof(T);
+
+    // Bytes copied in and out of a block; a packed idx must never be overwritten by a data copy
+    static constexpr size_t kDataBytes = kPackedIdx ? SlotPayloadSize<T>::value : sizeof(T);
+
+    static_assert(!kPackedIdx || std::is_trivially_copyable<T>::value,
+                  "packing idx into tail padding requires a trivially copyable T");
+
     /*
      * Purpose of alignas: Cache line alignment
      *
@@ -113,14 +811,180 @@ private:
      *
      * Start directly from each cache line, will not span across two cache lines
      */
-    struct alignas(64) Block
+    struct alignas(64) PaddedBlock
     {
         uint32_t idx = 0; // 32 bits, 4 bytes
         T data;
     };
 
-    Block blks[CNT];
+    // idx sits at kIdxOffset inside data's tail padding
+    struct alignas(64) PackedBlock
+    {
+        T data;
+    };
+
+    using Block = std::conditional_t<kPackedIdx, PackedBlock, PaddedBlock>;
+
+    // Batch reads prefetch about 256 bytes ahead of the block being copied
+    static constexpr uint32_t kPrefetchDistance = sizeof(Block) >= 256 ? 1 : uint32_t(256 / sizeof(Block));
+
+    static std::atomic<uint32_t> &blockIdx(Block &blk)
+    {
+        if constexpr (kPackedIdx)
+        {
+            return *(std::atomic<uint32_t> *)((char *)&blk.data + kIdxOffset);
+        }
+        else
+        {
+            return *(std::atomic<uint32_t> *)&blk.idx;
+        }
+    }
+
+    /*
+     * Seqlock write side: before the block's data is touched, move its idx off the
+     * value readers may be copying, so Reader::readCopy() notices the overwrite.
+     * idx - capacity - 1 is never a valid tag for this block (see Reader::locate).
+     *
+     * The release fence keeps the data stores that follow from becoming visible
+     * before the marker does.
+     */
+    // The release fence also orders the lap epoch of idx before idx is published
+    void beginOverwrite(Block &blk, uint64_t idx)
+    {
+        advanceLapEpoch(idx);
+        blockIdx(blk).store(uint32_t(idx - ring.capacity() - 1), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // Called with the newest idx about to be published, before its tag is stored
+    void advanceLapEpoch(uint64_t idx)
+    {
+        const uint64_t epoch = idx >> kLapEpochShift;
+        if (ring.lapEpoch().load(std::memory_order_relaxed) != epoch)
+        {
+            ring.lapEpoch().store(epoch, std::memory_order_relaxed);
+        }
+    }
 
-    // Avoid sharing cache line with other data
-    alignas(128) uint32_t write_idx = 0;
+    void storeData(Block &blk, const T &data)
+    {
+        if constexpr (kPackedIdx)
+        {
+            std::memcpy((void *)&blk.data, &data, kDataBytes);
+        }
+        else
+        {
+            blk.data = data;
+        }
+    }
+
+    void mapRing(RingMemory mem, uint32_t capacity)
+    {
+        ring.hdr = static_cast<SPMCRingHeader *>(mem.data());
+        ring.blks = reinterpret_cast<Block *>(static_cast<char *>(mem.data()) + SPMCRingHeader::kSize);
+        ring.mask = capacity - 1;
+        ring.mem = std::move(mem);
+    }
+
+    // A packed idx lives in T's tail padding, which T's constructor leaves uninitialized
+    void clearIdx()
+    {
+        for (uint32_t i = 0; i < ring.capacity(); ++i)
+        {
+            blockIdx(ring.at(i)).store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Blocks stored inline, capacity known at compile time
+    struct FixedRing
+    {
+        static constexpr uint32_t capacity()
+        {
+            return CNT;
+        }
+
+        Block &at(uint64_t idx)
+        {
+            return blks[idx % CNT];
+        }
+
+        uint64_t &writeIdx()
+        {
+            return write_idx;
+        }
+
+        uint64_t &gateLimit()
+        {
+            return gate_limit;
+        }
+
+        SPMCGatingState &gating()
+        {
+            return gating_state;
+        }
+
+        std::atomic<uint64_t> &lapEpoch()
+        {
+            return lap_epoch;
+        }
+
+        Block blks[CNT ? CNT : 1];
+
+        // Avoid sharing cache line with other data
+        alignas(128) uint64_t write_idx = 0;
+        uint64_t gate_limit = 0;
+
+        SPMCGatingState gating_state;
+
+        alignas(64) std::atomic<uint64_t> lap_epoch{0};
+    };
+
+    // Header and blocks in a RingMemory mapping, capacity chosen at construction
+    struct DynamicRing
+    {
+        uint32_t capacity() const
+        {
+            return mask + 1;
+        }
+
+        Block &at(uint64_t idx)
+        {
+            return blks[idx & mask];
+        }
+
+        uint64_t &writeIdx()
+        {
+            return hdr->write_idx;
+        }
+
+        uint64_t &gateLimit()
+        {
+            return hdr->gate_limit;
+        }
+
+        SPMCGatingState &gating()
+        {
+            return hdr->gating;
+        }
+
+        std::atomic<uint64_t> &lapEpoch()
+        {
+            return hdr->lap_epoch;
+        }
+
+        SPMCRingHeader *hdr = nullptr;
+        Block *blks = nullptr;
+        uint32_t mask = 0;
+        bool owner = false; // constructed the blocks, as opposed to attached to them
+        RingMemory mem;
+    };
+
+    std::conditional_t<CNT != 0, FixedRing, DynamicRing> ring;
+
+public:
+    // Bytes one message occupies in the ring
+    static constexpr size_t kBlockSize = sizeof(Block);
 };
+
+template <class T>
+using DynamicSPMCQueue = SPMCQueue<T, 0>;
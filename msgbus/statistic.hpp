@@ -1,8 +1,10 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
+#include <limits>
 #include <numeric>
 #include <ostream>
 #include <vector>
@@ -56,4 +58,166 @@ public:
 
 private:
     std::vector<T> vec;
-};
\ No newline at end of file
+};
+
+// Log-bucketed (HDR-style) histogram of uint64_t samples, e.g. latencies in ns.
+//
+// Values below 2^SubBucketBits get one bucket each; above that, every power-of-two
+// range is split into 2^(SubBucketBits-1) linear buckets, so a percentile is off by at
+// most 1 / 2^(SubBucketBits-1) of its value (0.8% with the default 8 bits) over the whole
+// uint64_t range. Memory is fixed (~58KB by default) and add() is a clz, a shift and an
+// increment.
+//
+// Single writer: add() uses relaxed load + store instead of a locked RMW, and other threads
+// may read (percentile(), print(), merge() from it) at any time. Counts read while the
+// writer runs are a consistent-enough snapshot for monitoring, not an exact cut.
+template<unsigned SubBucketBits = 8>
+class Histogram {
+    static_assert(SubBucketBits >= 2 && SubBucketBits <= 16, "SubBucketBits must be in [2, 16]");
+
+public:
+    static constexpr uint32_t kSubBuckets = 1u << SubBucketBits;
+    static constexpr uint32_t kHalfBuckets = kSubBuckets / 2;
+    static constexpr uint32_t kBuckets = (64 - SubBucketBits + 2) * kHalfBuckets;
+
+    Histogram() = default;
+    Histogram(const Histogram& other) { merge(other); }
+    Histogram& operator=(const Histogram& other) {
+        if (this != &other) {
+            reset();
+            merge(other);
+        }
+        return *this;
+    }
+
+    // Kept for drop-in use in place of Statistic<uint64_t>; memory is fixed
+    void reserve(uint32_t) {}
+
+    size_t size() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    void add(uint64_t v) {
+        bump(counts_[bucket_of(v)], 1);
+        bump(count_, 1);
+        bump(sum_, v);
+        if (v < min_.load(std::memory_order_relaxed)) {
+            min_.store(v, std::memory_order_relaxed);
+        }
+        if (v > max_.load(std::memory_order_relaxed)) {
+            max_.store(v, std::memory_order_relaxed);
+        }
+    }
+
+    // Adds other's samples to this one; other may be written concurrently by its own thread.
+    // Merging into a histogram that is itself being written is not supported.
+    void merge(const Histogram& other) {
+        for (uint32_t i = 0; i < kBuckets; ++i) {
+            uint64_t c = other.counts_[i].load(std::memory_order_relaxed);
+            if (c) {
+                bump(counts_[i], c);
+            }
+        }
+        bump(count_, other.count_.load(std::memory_order_relaxed));
+        bump(sum_, other.sum_.load(std::memory_order_relaxed));
+        min_.store(std::min(min_.load(std::memory_order_relaxed), other.min_.load(std::memory_order_relaxed)),
+                   std::memory_order_relaxed);
+        max_.store(std::max(max_.load(std::memory_order_relaxed), other.max_.load(std::memory_order_relaxed)),
+                   std::memory_order_relaxed);
+    }
+
+    void reset() {
+        for (auto& c : counts_) {
+            c.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t min() const {
+        return size() ? min_.load(std::memory_order_relaxed) : 0;
+    }
+
+    uint64_t max() const {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    double mean() const {
+        size_t n = size();
+        return n ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    // Smallest bucket upper bound with at least p% of the samples at or below it (p in [0, 100]),
+    // clamped to the exact max. 0 when empty.
+    uint64_t percentile(double p) const {
+        uint64_t total = 0;
+        for (const auto& c : counts_) {
+            total += c.load(std::memory_order_relaxed);
+        }
+        if (total == 0) {
+            return 0;
+        }
+
+        // Counts only grow, so samples added between the two passes just end the scan earlier
+        double clamped = std::min(std::max(p, 0.0), 100.0);
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * total)));
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min(highest_in_bucket(i), max());
+            }
+        }
+        return max();
+    }
+
+    void print(std::ostream& os) const {
+        size_t n = size();
+        os << "cnt: " << n << std::endl;
+
+        if (n == 0) {
+            return;
+        }
+
+        os << "min: " << min() << std::endl;
+        os << "max: " << max() << std::endl;
+        os << "mean: " << static_cast<uint64_t>(mean()) << std::endl;
+        os << "1%: " << percentile(1) << std::endl;
+        os << "10%: " << percentile(10) << std::endl;
+        os << "50%: " << percentile(50) << std::endl;
+        os << "90%: " << percentile(90) << std::endl;
+        os << "99%: " << percentile(99) << std::endl;
+        os << "99.9%: " << percentile(99.9) << std::endl;
+        os << "99.99%: " << percentile(99.99) << std::endl;
+    }
+
+    static uint32_t bucket_of(uint64_t v) {
+        // shift = 0 below kSubBuckets, otherwise enough to bring v into [kHalfBuckets, kSubBuckets)
+        int msb = 63 - __builtin_clzll(v | 1);
+        uint32_t shift = msb < static_cast<int>(SubBucketBits) ? 0 : static_cast<uint32_t>(msb - (SubBucketBits - 1));
+        return shift * kHalfBuckets + static_cast<uint32_t>(v >> shift);
+    }
+
+    static uint64_t highest_in_bucket(uint32_t bucket) {
+        if (bucket < kSubBuckets) {
+            return bucket;
+        }
+        uint32_t shift = bucket / kHalfBuckets - 1;
+        uint64_t sub = bucket - shift * kHalfBuckets;
+        uint64_t lowest = sub << shift;
+        return lowest + ((uint64_t(1) << shift) - 1);
+    }
+
+private:
+    static void bump(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counts_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> min_{std::numeric_limits<uint64_t>::max()};
+    std::atomic<uint64_t> max_{0};
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "market_data.hpp"
+#include "symbol_registry.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+namespace marketdata {
+
+// 成交/盘口方向
+enum class Side {
+    ANY = 0,
+    BUY = 1,   // Trade: 买方主动成交 (is_buyer_maker == false); BookL1: 买一
+    SELL = 2,  // Trade: 卖方主动成交 (is_buyer_maker == true); BookL1: 卖一
+};
+
+/**
+ * 订阅过滤条件, 由消费线程在 C++ 里判断, 不满足的消息不会交给 callback (也不会获取 GIL)
+ *
+ * 价格和数量按消息类型取字段:
+ *   Trade  - price / quantity, side 为主动成交方向
+ *   Kline  - close / volume, 忽略 side
+ *   BookL1 - side 对应一侧的 price / quantity; ANY 时买一或卖一任一侧满足即可
+ *   BookL2Update - price / quantity, side 为买盘 (BUY) 或卖盘 (SELL)
+ *   BookSnapshot - 与 BookL1 相同, 取买一和卖一
+ * 紧凑消息与对应的完整消息相同.
+ */
+struct SubscriptionFilter {
+    std::vector<std::string> symbols;  // 只接收这些交易对, 为空表示不限
+    double min_price = -std::numeric_limits<double>::infinity();
+    double max_price = std::numeric_limits<double>::infinity();
+    double min_quantity = -std::numeric_limits<double>::infinity();
+    double max_quantity = std::numeric_limits<double>::infinity();
+    Side side = Side::ANY;
+
+    // 是否有价格/数量/方向条件
+    bool has_value_predicate() const {
+        return min_price > -std::numeric_limits<double>::infinity() ||
+               max_price < std::numeric_limits<double>::infinity() ||
+               min_quantity > -std::numeric_limits<double>::infinity() ||
+               max_quantity < std::numeric_limits<double>::infinity() || side != Side::ANY;
+    }
+};
+
+/**
+ * 订阅时由 SubscriptionFilter (以及 SubscribeOptions::symbol) 生成的判断逻辑
+ *
+ * symbol 集合对完整消息比较名字 (集合小时线性比较, 大时查哈希表),
+ * 对紧凑消息按 symbol_id 查位图, 只需要一次下标访问.
+ */
+class MessageFilter {
+public:
+    MessageFilter() = default;
+
+    MessageFilter(const SubscriptionFilter& spec, const std::string& symbol) : spec_(spec) {
+        if (!symbol.empty()) {
+            spec_.symbols.push_back(symbol);
+        }
+        for (const auto& name : spec_.symbols) {
+            std::string truncated = name.substr(0, SymbolRegistry::kNameSize - 1);
+            if (std::find(names_.begin(), names_.end(), truncated) == names_.end()) {
+                names_.push_back(std::move(truncated));
+            }
+        }
+        if (names_.size() > kLinearScanLimit) {
+            name_set_.insert(names_.begin(), names_.end());
+        }
+        by_value_ = spec_.has_value_predicate();
+    }
+
+    // 有任一条件, 没有时消费线程不调用 matches()
+    bool active() const {
+        return by_symbol() || by_value_;
+    }
+
+    bool by_symbol() const {
+        return !names_.empty();
+    }
+
+    // 去重后的 symbol 名字
+    const std::vector<std::string>& symbols() const {
+        return names_;
+    }
+
+    /**
+     * 设置 symbols() 对应的 symbol_id, 紧凑消息按 ID 过滤
+     */
+    void set_symbol_ids(const std::vector<uint32_t>& ids) {
+        id_bits_.clear();
+        for (uint32_t id : ids) {
+            if (id >= id_bits_.size()) {
+                id_bits_.resize(size_t(id) + 1, 0);
+            }
+            id_bits_[id] = 1;
+        }
+        ids_resolved_ = true;
+    }
+
+    bool symbol_ids_resolved() const {
+        return ids_resolved_;
+    }
+
+    template <class T>
+    bool matches(const T& msg) const {
+        return (!by_symbol() || symbol_matches(msg)) && (!by_value_ || value_matches(msg));
+    }
+
+private:
+    static constexpr size_t kLinearScanLimit = 8;
+
+    template <class T>
+    bool symbol_matches(const T& msg) const {
+        if constexpr (std::is_same_v<T, CompactKline> || std::is_same_v<T, CompactTrade> ||
+                      std::is_same_v<T, CompactBookL1> || std::is_same_v<T, BookL2Update> ||
+                      std::is_same_v<T, BookSnapshot>) {
+            return msg.symbol_id < id_bits_.size() && id_bits_[msg.symbol_id];
+        } else if (name_set_.empty()) {
+            for (const auto& name : names_) {
+                if (strncmp(msg.symbol, name.c_str(), sizeof(msg.symbol)) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        } else {
+            return name_set_.count(std::string(msg.symbol, strnlen(msg.symbol, sizeof(msg.symbol)))) != 0;
+        }
+    }
+
+    bool in_range(double price, double quantity) const {
+        return price >= spec_.min_price && price <= spec_.max_price &&
+               quantity >= spec_.min_quantity && quantity <= spec_.max_quantity;
+    }
+
+    template <class T>
+    bool value_matches(const T& msg) const {
+        if constexpr (std::is_same_v<T, Trade> || std::is_same_v<T, CompactTrade>) {
+            if ((spec_.side == Side::BUY && msg.is_buyer_maker) || (spec_.side == Side::SELL && !msg.is_buyer_maker)) {
+                return false;
+            }
+            return in_range(msg.price, msg.quantity);
+        } else if constexpr (std::is_same_v<T, Kline> || std::is_same_v<T, CompactKline>) {
+            return in_range(msg.close, msg.volume);
+        } else if constexpr (std::is_same_v<T, BookL2Update>) {
+            if ((spec_.side == Side::BUY && !msg.is_bid) || (spec_.side == Side::SELL && msg.is_bid)) {
+                return false;
+            }
+            return in_range(msg.price, msg.quantity);
+        } else if constexpr (std::is_same_v<T, BookSnapshot>) {
+            // 按最优一档判断, 与 BookL1 一致
+            bool bid = spec_.side != Side::SELL && msg.bid_levels && in_range(msg.bid_price[0], msg.bid_quantity[0]);
+            bool ask = spec_.side != Side::BUY && msg.ask_levels && in_range(msg.ask_price[0], msg.ask_quantity[0]);
+            return bid || ask;
+        } else {
+            bool bid = spec_.side != Side::SELL && in_range(msg.bid_price, msg.bid_quantity);
+            bool ask = spec_.side != Side::BUY && in_range(msg.ask_price, msg.ask_quantity);
+            return bid || ask;
+        }
+    }
+
+    SubscriptionFilter spec_;
+    std::vector<std::string> names_;
+    std::unordered_set<std::string> name_set_;  // names_ 较多时使用
+    std::vector<uint8_t> id_bits_;              // 下标为 symbol_id
+    bool ids_resolved_ = false;
+    bool by_value_ = false;
+};
+
+} // namespace marketdata
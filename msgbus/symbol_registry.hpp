@@ -0,0 +1,206 @@
+#pragma once
+
+#include "ring_memory.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+namespace marketdata {
+
+// 未注册的 symbol
+constexpr uint32_t kNoSymbol = UINT32_MAX;
+
+/**
+ * SymbolRegistry - 交易对名字到连续 uint32_t ID 的映射
+ *
+ * ID 从 0 开始按注册顺序分配, 一旦分配不再改变, 可以直接当数组下标用.
+ * 注册 (intern) 由持有者进程串行执行; 查找 (find/name) 不加锁, 可以在任意线程
+ * 以及连接同一块共享内存的其他进程中进行.
+ *
+ * 内存布局 (可以放在 RingMemory::createShared 创建的共享内存里):
+ *   Header | names[capacity][32] | table[table_size] (开放寻址, 存 id + 1, 0 表示空)
+ */
+class SymbolRegistry {
+public:
+    static constexpr size_t kNameSize = 32;  // 与 Trade::symbol 相同, 含结尾 '\0'
+
+    /**
+     * 在匿名内存中创建
+     * @param capacity 最多可注册的 symbol 数
+     */
+    explicit SymbolRegistry(uint32_t capacity)
+        : SymbolRegistry(capacity, RingMemory::anonymous(storage_bytes(capacity), false)) {}
+
+    /**
+     * 在调用者准备的内存中创建 (例如共享内存), mem 至少 storage_bytes(capacity) 字节
+     */
+    SymbolRegistry(uint32_t capacity, RingMemory mem) : mem_(std::move(mem)) {
+        if (capacity == 0 || capacity > kMaxCapacity) {
+            throw std::invalid_argument("symbol registry capacity must be in [1, 2^30]");
+        }
+        if (mem_.size() < storage_bytes(capacity)) {
+            throw std::invalid_argument("symbol registry memory is too small");
+        }
+
+        header_ = new (mem_.data()) Header();
+        header_->capacity = capacity;
+        header_->table_size = table_size_for(capacity);
+        map_arrays();
+        for (uint32_t i = 0; i < header_->table_size; ++i) {
+            new (&table_[i]) std::atomic<uint32_t>(0);
+        }
+        header_->magic.store(kMagic, std::memory_order_release);
+    }
+
+    /**
+     * 连接其他进程用 (capacity, mem) 创建的注册表, 只能查找
+     */
+    explicit SymbolRegistry(RingMemory mem) : mem_(std::move(mem)), read_only_(true) {
+        header_ = static_cast<Header*>(mem_.data());
+        if (mem_.size() < sizeof(Header) || header_->magic.load(std::memory_order_acquire) != kMagic ||
+            mem_.size() < storage_bytes(header_->capacity)) {
+            throw std::runtime_error("shared memory does not hold a symbol registry");
+        }
+        map_arrays();
+    }
+
+    SymbolRegistry(const SymbolRegistry&) = delete;
+    SymbolRegistry& operator=(const SymbolRegistry&) = delete;
+
+    static size_t storage_bytes(uint32_t capacity) {
+        return sizeof(Header) + size_t(capacity) * kNameSize + size_t(table_size_for(capacity)) * sizeof(uint32_t);
+    }
+
+    /**
+     * 返回 name 的 ID, 第一次出现时分配新 ID. 超过 kNameSize - 1 的部分被截断 (与 set_symbol 一致)
+     * 注册表已满时抛出 std::length_error
+     */
+    uint32_t intern(const char* name) {
+        if (read_only_) {
+            throw std::logic_error("symbol registry is attached read-only");
+        }
+
+        size_t len = strnlen(name, kNameSize - 1);
+        uint32_t id = find(name, len);
+        if (id != kNoSymbol) {
+            return id;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = find(name, len);  // 其他线程可能刚注册过
+        if (id != kNoSymbol) {
+            return id;
+        }
+
+        id = header_->count.load(std::memory_order_relaxed);
+        if (id == header_->capacity) {
+            throw std::length_error("symbol registry is full (" + std::to_string(id) + " symbols)");
+        }
+
+        // 先写名字, 再用 release 发布表项和计数, 读者看到 ID 时名字一定已写好
+        char* slot = names_ + size_t(id) * kNameSize;
+        memcpy(slot, name, len);
+        memset(slot + len, 0, kNameSize - len);
+
+        uint32_t mask = header_->table_size - 1;
+        uint32_t pos = hash(name, len) & mask;
+        while (table_[pos].load(std::memory_order_relaxed) != 0) {
+            pos = (pos + 1) & mask;
+        }
+        table_[pos].store(id + 1, std::memory_order_release);
+        header_->count.store(id + 1, std::memory_order_release);
+        return id;
+    }
+
+    /**
+     * 查找已注册的 name, 不存在时返回 kNoSymbol
+     */
+    uint32_t find(const char* name) const {
+        return find(name, strnlen(name, kNameSize - 1));
+    }
+
+    /**
+     * ID 对应的名字, 未分配的 ID 返回 ""
+     */
+    const char* name(uint32_t id) const {
+        if (id >= header_->count.load(std::memory_order_acquire)) {
+            return "";
+        }
+        return names_ + size_t(id) * kNameSize;
+    }
+
+    // 已注册的 symbol 数, ID 都小于它
+    uint32_t size() const {
+        return header_->count.load(std::memory_order_acquire);
+    }
+
+    uint32_t capacity() const {
+        return header_->capacity;
+    }
+
+    bool read_only() const {
+        return read_only_;
+    }
+
+private:
+    static constexpr uint64_t kMagic = 0x4d47425553594d31ull;  // "MGBUSYM1"
+    static constexpr uint32_t kMaxCapacity = 1u << 30;
+
+    struct alignas(64) Header {
+        std::atomic<uint64_t> magic{0};
+        uint32_t capacity = 0;
+        uint32_t table_size = 0;                // 2 的幂, 至少是 capacity 的两倍, 负载因子不超过 1/2
+        alignas(64) std::atomic<uint32_t> count{0};
+    };
+
+    static uint32_t table_size_for(uint32_t capacity) {
+        uint32_t size = 2;
+        while (size < capacity * 2) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    // FNV-1a
+    static uint32_t hash(const char* name, size_t len) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < len; ++i) {
+            h = (h ^ static_cast<uint8_t>(name[i])) * 16777619u;
+        }
+        return h;
+    }
+
+    uint32_t find(const char* name, size_t len) const {
+        uint32_t mask = header_->table_size - 1;
+        for (uint32_t pos = hash(name, len) & mask;; pos = (pos + 1) & mask) {
+            uint32_t entry = table_[pos].load(std::memory_order_acquire);
+            if (entry == 0) {
+                return kNoSymbol;
+            }
+            const char* candidate = names_ + size_t(entry - 1) * kNameSize;
+            if (memcmp(candidate, name, len) == 0 && candidate[len] == '\0') {
+                return entry - 1;
+            }
+        }
+    }
+
+    void map_arrays() {
+        char* base = static_cast<char*>(mem_.data());
+        names_ = base + sizeof(Header);
+        table_ = reinterpret_cast<std::atomic<uint32_t>*>(names_ + size_t(header_->capacity) * kNameSize);
+    }
+
+    RingMemory mem_;
+    Header* header_ = nullptr;
+    char* names_ = nullptr;
+    std::atomic<uint32_t>* table_ = nullptr;
+    bool read_only_ = false;
+    std::mutex mutex_;  // 串行化 intern
+};
+
+} // namespace marketdata
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace marketdata {
+
+/**
+ * 线程放置: CPU 亲和性, 实时调度优先级和 NUMA 节点
+ */
+struct ThreadPlacement {
+    std::vector<int> cpus;   // 允许运行的 CPU, 为空时使用 numa_node 的全部 CPU (或不限制)
+    int sched_priority = 0;  // > 0 时使用 SCHED_FIFO 和该优先级 (通常需要 CAP_SYS_NICE)
+    int numa_node = -1;      // >= 0 时线程之后分配的内存优先放在该 NUMA 节点
+
+    bool empty() const {
+        return cpus.empty() && sched_priority <= 0 && numa_node < 0;
+    }
+};
+
+// Linux mempolicy 常量 (避免依赖 libnuma 头文件)
+constexpr int kMpolPreferred = 1;
+constexpr int kMpolBind = 2;
+
+// mbind/set_mempolicy 使用的 NUMA 节点位图
+struct NodeMask {
+    static constexpr int kMaxNodes = 1024;
+    unsigned long bits[kMaxNodes / (sizeof(unsigned long) * 8)] = {};
+
+    bool set(int node) {
+        if (node < 0 || node >= kMaxNodes) {
+            return false;
+        }
+        bits[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+        return true;
+    }
+};
+
+/**
+ * 解析 cpulist 格式的 CPU 列表, 如 "0-3,8-11\n"; 空白和空的段被跳过, 不抛出异常
+ * 格式错误时返回空列表; 超出 CPU_SETSIZE 的范围截断在 CPU_SETSIZE, 由调用者报告为无效 CPU
+ */
+inline std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        const char* begin = list.data() + pos;
+        const char* end = list.data() + comma;
+        pos = comma + 1;
+        while (begin < end && std::isspace(static_cast<unsigned char>(*begin))) {
+            ++begin;
+        }
+        while (end > begin && std::isspace(static_cast<unsigned char>(end[-1]))) {
+            --end;
+        }
+        if (begin == end) {
+            continue;  // 没有 CPU 的节点, 文件内容只有 "\n"
+        }
+
+        int first = 0;
+        auto parsed = std::from_chars(begin, end, first);
+        if (parsed.ec != std::errc() || first < 0) {
+            return {};
+        }
+        int last = first;
+        if (parsed.ptr != end) {
+            if (*parsed.ptr != '-') {
+                return {};
+            }
+            parsed = std::from_chars(parsed.ptr + 1, end, last);
+            if (parsed.ec != std::errc() || parsed.ptr != end || last < first) {
+                return {};
+            }
+        }
+        for (int cpu = first; cpu <= std::min(last, CPU_SETSIZE); ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/**
+ * 读取 /sys/devices/system/node/nodeN/cpulist; 节点不存在或没有 CPU 时返回空列表
+ */
+inline std::vector<int> numa_node_cpus(int node) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return parse_cpu_list(list);
+}
+
+/**
+ * 把 [addr, addr + bytes) 绑定到 NUMA 节点, 需在首次访问 (缺页) 之前调用
+ * @return 错误描述, 成功时为空
+ */
+inline std::string numa_bind_memory(void* addr, size_t bytes, int node) {
+#ifdef __linux__
+    NodeMask mask;
+    if (!mask.set(node)) {
+        return "invalid NUMA node " + std::to_string(node);
+    }
+    if (syscall(SYS_mbind, addr, bytes, kMpolBind, mask.bits, NodeMask::kMaxNodes, 0) != 0) {
+        return std::string("mbind failed: ") + strerror(errno);
+    }
+    return "";
+#else
+    (void)addr;
+    (void)bytes;
+    return "NUMA binding is only supported on Linux (node " + std::to_string(node) + ")";
+#endif
+}
+
+/**
+ * 把放置策略应用到当前线程
+ * @return 错误描述, 成功时为空
+ */
+inline std::string apply_thread_placement(const ThreadPlacement& placement) {
+    std::vector<int> cpus = placement.cpus;
+    if (cpus.empty() && placement.numa_node >= 0) {
+        cpus = numa_node_cpus(placement.numa_node);
+        if (cpus.empty()) {
+            return "no CPUs found for NUMA node " + std::to_string(placement.numa_node);
+        }
+    }
+
+    if (!cpus.empty()) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        for (int cpu : cpus) {
+            if (cpu < 0 || cpu >= CPU_SETSIZE) {
+                return "invalid CPU id " + std::to_string(cpu);
+            }
+            CPU_SET(static_cast<size_t>(cpu), &cpuset);
+        }
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+        if (rc != 0) {
+            return std::string("pthread_setaffinity_np failed: ") + strerror(rc);
+        }
+    }
+
+    if (placement.sched_priority > 0) {
+        sched_param param{};
+        param.sched_priority = placement.sched_priority;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (rc != 0) {
+            return std::string("pthread_setschedparam(SCHED_FIFO) failed: ") + strerror(rc);
+        }
+    }
+
+#ifdef __linux__
+    if (placement.numa_node >= 0) {
+        NodeMask mask;
+        if (!mask.set(placement.numa_node)) {
+            return "invalid NUMA node " + std::to_string(placement.numa_node);
+        }
+        if (syscall(SYS_set_mempolicy, kMpolPreferred, mask.bits, NodeMask::kMaxNodes) != 0) {
+            return std::string("set_mempolicy failed: ") + strerror(errno);
+        }
+    }
+#endif
+
+    return "";
+}
+
+/**
+ * 启动线程, 先在新线程里应用 placement 再运行 fn
+ * placement 失败时 fn 不会运行, 线程被 join 后抛出 std::runtime_error
+ */
+template <class F>
+std::unique_ptr<std::thread> start_placed_thread(const ThreadPlacement& placement, F&& fn) {
+    std::promise<std::string> placed;
+    std::future<std::string> result = placed.get_future();
+
+    auto thread = std::make_unique<std::thread>(
+        [placement, placed = std::move(placed), fn = std::forward<F>(fn)]() mutable {
+            // 异常不能在 set_value 之前离开线程, 否则 std::terminate 而不是返回错误
+            std::string error;
+            try {
+                error = apply_thread_placement(placement);
+            } catch (const std::exception& e) {
+                error = std::string("thread placement failed: ") + e.what();
+            }
+            bool ok = error.empty();
+            placed.set_value(std::move(error));
+            if (ok) {
+                fn();
+            }
+        });
+
+    std::string error = result.get();
+    if (!error.empty()) {
+        thread->join();
+        throw std::runtime_error(error);
+    }
+    return thread;
+}
+
+} // namespace marketdata
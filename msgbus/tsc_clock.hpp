@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define MSGBUS_HAS_TSC 1
+#else
+#define MSGBUS_HAS_TSC 0
+#endif
+
+// Cycle-counter clock for latency measurement.
+//
+// now() is a bare rdtsc (~20 cycles, no syscall, no vDSO data page), monotonic as long as
+// the CPU has an invariant TSC (every x86-64 CPU of the last decade; see invariant()).
+// Ticks are converted with a fixed-point multiplier calibrated against steady_clock once
+// per process, so ns() is a multiply and a shift. Timestamps from different cores are
+// comparable on machines whose TSCs are synchronized, which Linux checks at boot.
+// Without a TSC (non-x86) ticks are steady_clock nanoseconds.
+//
+//   TscClock& clock = TscClock::instance();
+//   uint64_t begin = clock.now();
+//   work();
+//   histogram.add(clock.ns(clock.now_serialized() - begin));
+class TscClock {
+public:
+    // Calibrated on first use (~10ms); call it once at startup to keep that off the hot path
+    static TscClock& instance() {
+        static TscClock clock;
+        return clock;
+    }
+
+    // Current tick count
+    static uint64_t now() {
+#if MSGBUS_HAS_TSC
+        return __rdtsc();
+#else
+        return steady_ns();
+#endif
+    }
+
+    // Like now(), but waits for earlier instructions to finish first (rdtscp), so the
+    // measured work cannot be reordered past the end timestamp
+    static uint64_t now_serialized() {
+#if MSGBUS_HAS_TSC
+        unsigned int aux;
+        return __rdtscp(&aux);
+#else
+        return steady_ns();
+#endif
+    }
+
+    // Length of a tick interval in ns
+    uint64_t ns(uint64_t ticks) const {
+        return static_cast<uint64_t>((static_cast<uint128>(ticks) * mult_) >> kShift);
+    }
+
+    // A tick count as steady_clock nanoseconds since its epoch
+    uint64_t to_steady_ns(uint64_t ticks) const {
+        return ticks >= base_ticks_ ? base_ns_ + ns(ticks - base_ticks_) : base_ns_ - ns(base_ticks_ - ticks);
+    }
+
+    double ticks_per_ns() const {
+        return ticks_per_ns_;
+    }
+
+    // CPUID reports an invariant TSC (constant rate across P-/C-states)
+    static bool invariant() {
+#if MSGBUS_HAS_TSC
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007) {
+            return false;
+        }
+        __cpuid(0x80000007, eax, ebx, ecx, edx);
+        return (edx & (1u << 8)) != 0;
+#else
+        return true;
+#endif
+    }
+
+private:
+    static constexpr unsigned kShift = 32;
+    __extension__ typedef unsigned __int128 uint128;
+
+    static uint64_t steady_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Reads steady_clock between two tick readings and pairs it with their midpoint; the
+    // tightest of a few tries is kept so an interrupt in the middle does not skew calibration
+    static void sample(uint64_t& ticks, uint64_t& ns) {
+        uint64_t best = ~uint64_t(0);
+        for (int i = 0; i < 8; ++i) {
+            uint64_t before = now();
+            uint64_t steady = steady_ns();
+            uint64_t after = now();
+            if (after - before < best) {
+                best = after - before;
+                ticks = before + (after - before) / 2;
+                ns = steady;
+            }
+        }
+    }
+
+    TscClock() {
+#if MSGBUS_HAS_TSC
+        uint64_t t0 = 0, n0 = 0, t1 = 0, n1 = 0;
+        sample(t0, n0);
+        do {
+            sample(t1, n1);
+        } while (n1 - n0 < 10000000);  // 10ms: tens of ns of sampling error is a few ppm
+
+        ticks_per_ns_ = static_cast<double>(t1 - t0) / static_cast<double>(n1 - n0);
+        mult_ = static_cast<uint64_t>(static_cast<double>(uint64_t(1) << kShift) / ticks_per_ns_);
+        base_ticks_ = t1;
+        base_ns_ = n1;
+#else
+        ticks_per_ns_ = 1.0;
+        mult_ = uint64_t(1) << kShift;
+        base_ticks_ = base_ns_ = steady_ns();
+#endif
+    }
+
+    double ticks_per_ns_ = 1.0;
+    uint64_t mult_ = 0;  // ns per tick << kShift
+    uint64_t base_ticks_ = 0;
+    uint64_t base_ns_ = 0;
+};
@@ -0,0 +1,755 @@
+#pragma once
+
+#include "market_data_hub.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace marketdata {
+
+/**
+ * UDP 行情桥的报文格式
+ *
+ * datagram: UdpPacketHeader | record[records]
+ * record:   UdpRecordHeader | body[body_size] | name[name_size]
+ *
+ * body 是消息的紧凑形式, 按原样拷贝, 不对齐:
+ *   - 完整消息 (Kline/Trade/BookL1) 发送对应的 CompactKline/CompactTrade/CompactBookL1,
+ *     symbol_id 不使用, 名字 (不含 '\0') 跟在 body 后面
+ *   - 紧凑消息和 L2 消息带发送端的 symbol_id; 发送端在用到一个 ID 之前 (之后每个 announce 周期一次)
+ *     在同一个 datagram 里先发一条 kUdpSymbolRecord 声明 (body 为 uint32_t ID, 后跟名字),
+ *     接收端把它映射到本地 hub 的 symbol_id, 还没收到声明的消息被丢弃
+ *
+ * 每条行情消息有一个 64 位序号, header.sequence 是 datagram 中第一条的序号, symbol 声明不占序号.
+ * 接收端据此发现丢包 (序号跳跃) 和重复 / 乱序到达的旧报文 (丢弃, 不重排).
+ * session 在发送端每次启动时随机生成, 接收端看到新的 session 时重新同步.
+ * 所有字段为小端字节序 (两端都是 x86-64 / aarch64).
+ */
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the UDP wire format is little-endian");
+
+constexpr uint32_t kUdpMagic = 0x5542474d;  // "MGBU"
+constexpr uint16_t kUdpVersion = 1;
+constexpr uint8_t kUdpSymbolRecord = 0xff;
+constexpr size_t kUdpMaxDatagram = 65507;  // IPv4 UDP 载荷上限
+
+struct UdpPacketHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t records;    // 记录数, 含 symbol 声明
+    uint16_t messages;   // 行情消息数
+    uint16_t reserved;
+    uint32_t session;    // 发送端实例
+    uint64_t sequence;   // 第一条行情消息的序号
+};
+
+struct UdpRecordHeader {
+    uint8_t data_type;   // DataType, 或 kUdpSymbolRecord
+    uint8_t name_size;   // body 后面的名字长度
+    uint16_t body_size;
+};
+
+static_assert(sizeof(UdpPacketHeader) == 24 && sizeof(UdpRecordHeader) == 4, "wire headers must not be padded");
+
+// 各数据类型的 body: 完整消息用对应的紧凑消息
+template <class T>
+using UdpBodyOf = std::conditional_t<std::is_same_v<T, Kline>, CompactKline,
+                  std::conditional_t<std::is_same_v<T, Trade>, CompactTrade,
+                  std::conditional_t<std::is_same_v<T, BookL1>, CompactBookL1, T>>>;
+
+/**
+ * 解析 "a.b.c.d" 形式的 IPv4 地址, 空字符串为 INADDR_ANY
+ */
+inline in_addr udp_parse_address(const std::string& address) {
+    in_addr addr;
+    addr.s_addr = htonl(INADDR_ANY);
+    if (!address.empty() && inet_pton(AF_INET, address.c_str(), &addr) != 1) {
+        throw std::invalid_argument("invalid IPv4 address: " + address);
+    }
+    return addr;
+}
+
+inline bool udp_is_multicast(in_addr addr) {
+    return IN_MULTICAST(ntohl(addr.s_addr));
+}
+
+// 持有一个 socket fd, 析构时关闭
+class UdpSocket {
+public:
+    UdpSocket() : fd_(::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) {
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "socket");
+        }
+    }
+
+    ~UdpSocket() {
+        ::close(fd_);
+    }
+
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+
+    int fd() const {
+        return fd_;
+    }
+
+    template <class T>
+    void set_option(int level, int name, const T& value, const char* what) {
+        if (setsockopt(fd_, level, name, &value, sizeof(value)) != 0) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+    }
+
+private:
+    int fd_;
+};
+
+struct UdpSenderOptions {
+    std::string address = "239.255.0.1";   // 目的地址: 组播组或单播地址
+    uint16_t port = 30001;
+    std::string interface;                 // 发送组播的本地网卡地址, 为空时由路由决定
+    int ttl = 1;                           // 组播 TTL, 1 表示不出本网段
+    bool loopback = true;                  // 本机的接收端也能收到自己发的组播
+    uint32_t max_datagram = 1472;          // 每个 datagram 的最大字节数 (以太网 MTU 1500 - IP/UDP 头)
+    uint32_t batch = 16;                   // 每次 sendmmsg 最多发送的 datagram 数
+    uint64_t announce_interval_ns = 1000000000ull;  // 重复声明 symbol 的周期, 让后加入的接收端能解码
+    std::vector<DataType> types;           // 只转发这些类型, 为空表示全部
+    SubscribeOptions subscribe;            // 订阅的 symbol/filter/等待策略/线程放置/无损 (不支持 BLOCKING)
+};
+
+/**
+ * UdpSender - 把 hub 中的行情用 UDP (一般是组播) 发送到其他主机
+ *
+ * 一个 C++ handler 订阅所有类型, 在订阅线程里把消息编码进 datagram 缓冲区;
+ * 一个 datagram 写满或每轮读完已到达的消息 (on_flush) 后才发送, 积攒的多个 datagram
+ * 用一次 sendmmsg 发出. 行情稀疏时一条消息一个 datagram, 突发时每个 datagram 装满.
+ * 发送失败 (例如发送缓冲区满) 的 datagram 被丢弃并计入 send_errors(), 接收端会看到序号跳跃.
+ */
+class UdpSender {
+public:
+    /**
+     * 创建 socket 并开始订阅; 地址或选项无效时抛出异常
+     */
+    explicit UdpSender(MarketDataHub* hub, UdpSenderOptions options = {})
+        : hub_(hub), options_(std::move(options)) {
+        if (options_.max_datagram < sizeof(UdpPacketHeader) + sizeof(UdpRecordHeader) * 2 + sizeof(uint32_t) +
+                                       sizeof(BookSnapshot) + 2 * (sizeof(Trade::symbol) - 1) ||
+            options_.max_datagram > kUdpMaxDatagram) {
+            throw std::invalid_argument("max_datagram must hold the largest record and fit in a UDP datagram");
+        }
+        if (options_.batch == 0) {
+            throw std::invalid_argument("batch must be > 0");
+        }
+        type_mask_ = options_.types.empty() ? ~0u : 0u;
+        for (DataType type : options_.types) {
+            type_mask_ |= 1u << static_cast<int>(type);
+        }
+
+        sockaddr_in dest{};
+        dest.sin_family = AF_INET;
+        dest.sin_port = htons(options_.port);
+        dest.sin_addr = udp_parse_address(options_.address);
+        if (udp_is_multicast(dest.sin_addr)) {
+            socket_.set_option(IPPROTO_IP, IP_MULTICAST_TTL, options_.ttl, "IP_MULTICAST_TTL");
+            socket_.set_option(IPPROTO_IP, IP_MULTICAST_LOOP, int(options_.loopback), "IP_MULTICAST_LOOP");
+            if (!options_.interface.empty()) {
+                socket_.set_option(IPPROTO_IP, IP_MULTICAST_IF, udp_parse_address(options_.interface),
+                                   "IP_MULTICAST_IF");
+            }
+        }
+        // connect 之后每个 datagram 不用再带地址
+        if (::connect(socket_.fd(), reinterpret_cast<const sockaddr*>(&dest), sizeof(dest)) != 0) {
+            throw std::system_error(errno, std::generic_category(), "connect " + options_.address);
+        }
+
+        session_ = std::random_device{}();
+        subscriber_id_ = hub_->subscribe(Encoder(this), options_.subscribe);
+    }
+
+    ~UdpSender() {
+        stop();
+    }
+
+    UdpSender(const UdpSender&) = delete;
+    UdpSender& operator=(const UdpSender&) = delete;
+
+    /**
+     * 取消订阅; 发送线程退出前发出已编码的消息
+     */
+    void stop() {
+        if (subscriber_id_ >= 0) {
+            hub_->unsubscribe(subscriber_id_);
+            subscriber_id_ = -1;
+        }
+    }
+
+    uint64_t messages_sent() const {
+        return messages_sent_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t packets_sent() const {
+        return packets_sent_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t bytes_sent() const {
+        return bytes_sent_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 发送失败被丢弃的 datagram 数量
+     */
+    uint64_t send_errors() const {
+        return send_errors_.load(std::memory_order_relaxed);
+    }
+
+    uint32_t session() const {
+        return session_;
+    }
+
+private:
+    // 订阅线程按值持有的编码器, 缓冲区只在订阅线程里访问
+    class Encoder {
+    public:
+        explicit Encoder(UdpSender* owner)
+            : owner_(owner),
+              buffer_(size_t(owner->options_.max_datagram) * owner->options_.batch),
+              sizes_(owner->options_.batch, 0),
+              iov_(owner->options_.batch),
+              msgs_(owner->options_.batch) {
+            begin_datagram();
+        }
+
+        ~Encoder() {
+            on_flush();  // 取消订阅时发出最后一批
+        }
+
+        void on_kline(const Kline& kline) { encode_full(kline, to_compact(kline, 0)); }
+        void on_trade(const Trade& trade) { encode_full(trade, to_compact(trade, 0)); }
+        void on_book(const BookL1& book) { encode_full(book, to_compact(book, 0)); }
+        void on_kline(const CompactKline& kline) { encode_compact(kline); }
+        void on_trade(const CompactTrade& trade) { encode_compact(trade); }
+        void on_book(const CompactBookL1& book) { encode_compact(book); }
+        void on_book_l2(const BookL2Update& update) { encode_compact(update); }
+        void on_book_snapshot(const BookSnapshot& snapshot) { encode_compact(snapshot); }
+
+        /**
+         * 发出所有已编码的 datagram; 每轮读完之后由 hub 调用
+         */
+        void on_flush() {
+            finish_datagram();
+            send_pending();
+            // symbol 声明的周期按轮检查, 不在每条消息上读时钟
+            uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+            if (now - epoch_started_ >= owner_->options_.announce_interval_ns) {
+                epoch_started_ = now;
+                ++epoch_;
+            }
+        }
+
+    private:
+        template <class T>
+        bool wanted() const {
+            return (owner_->type_mask_ >> static_cast<int>(data_type_of<T>())) & 1u;
+        }
+
+        template <class T, class Body>
+        void encode_full(const T& msg, const Body& body) {
+            if (!wanted<T>()) {
+                return;
+            }
+            const size_t name_size = strnlen(msg.symbol, sizeof(msg.symbol));
+            reserve(sizeof(UdpRecordHeader) + sizeof(Body) + name_size);
+            put_record(static_cast<uint8_t>(data_type_of<T>()), &body, sizeof(Body), msg.symbol, name_size);
+            ++messages_;
+        }
+
+        template <class T>
+        void encode_compact(const T& msg) {
+            if (!wanted<T>()) {
+                return;
+            }
+            const uint32_t id = msg.symbol_id;
+            if (!owner_->hub_->has_symbol_id(id)) {
+                return;  // 没有名字可以声明, 接收端也无法映射
+            }
+            if (id >= announced_.size()) {
+                announced_.resize(size_t(id) + 1, 0);
+            }
+            const bool announce = announced_[id] != epoch_;
+            const char* name = announce ? owner_->hub_->symbols().name(id) : "";
+            const size_t name_size = strnlen(name, sizeof(Trade::symbol) - 1);
+            const size_t announce_size = announce ? sizeof(UdpRecordHeader) + sizeof(uint32_t) + name_size : 0;
+
+            // 声明和消息放在同一个 datagram 里
+            reserve(announce_size + sizeof(UdpRecordHeader) + sizeof(T));
+            if (announce) {
+                char body[sizeof(id)];  // 直接传 &id 时 GCC 12+ 误报 -Wdangling-pointer
+                std::memcpy(body, &id, sizeof(id));
+                put_record(kUdpSymbolRecord, body, sizeof(body), name, name_size);
+                announced_[id] = epoch_;
+            }
+            put_record(static_cast<uint8_t>(data_type_of<T>()), &msg, sizeof(T), "", 0);
+            ++messages_;
+        }
+
+        void put_record(uint8_t type, const void* body, size_t body_size, const char* name, size_t name_size) {
+            UdpRecordHeader header{type, static_cast<uint8_t>(name_size), static_cast<uint16_t>(body_size)};
+            char* out = current() + size_;
+            std::memcpy(out, &header, sizeof(header));
+            std::memcpy(out + sizeof(header), body, body_size);
+            std::memcpy(out + sizeof(header) + body_size, name, name_size);
+            size_ += sizeof(header) + body_size + name_size;
+            ++records_;
+        }
+
+        // 当前 datagram 放不下 n 字节时换下一个, 缓冲区都满了就先发送
+        void reserve(size_t n) {
+            if (size_ + n <= owner_->options_.max_datagram) {
+                return;
+            }
+            finish_datagram();
+            if (pending_ == owner_->options_.batch) {
+                send_pending();
+            }
+        }
+
+        char* current() {
+            return buffer_.data() + size_t(pending_) * owner_->options_.max_datagram;
+        }
+
+        void begin_datagram() {
+            size_ = sizeof(UdpPacketHeader);
+            records_ = 0;
+            messages_ = 0;
+        }
+
+        // 填写当前 datagram 的 header, 加入待发送列表
+        void finish_datagram() {
+            if (records_ == 0) {
+                return;
+            }
+            UdpPacketHeader header{kUdpMagic, kUdpVersion, records_, messages_, 0, owner_->session_, sequence_};
+            std::memcpy(current(), &header, sizeof(header));
+            sizes_[pending_++] = size_;
+            sequence_ += messages_;
+            sent_messages_ += messages_;
+            begin_datagram();
+        }
+
+        void send_pending() {
+            if (pending_ == 0) {
+                return;
+            }
+            const int fd = owner_->socket_.fd();
+            const size_t stride = owner_->options_.max_datagram;
+            uint64_t bytes = 0;
+            for (uint32_t i = 0; i < pending_; ++i) {
+                iov_[i].iov_base = buffer_.data() + i * stride;
+                iov_[i].iov_len = sizes_[i];
+                bytes += sizes_[i];
+            }
+
+            uint32_t sent = 0;
+            uint32_t failed = 0;
+#ifdef __linux__
+            for (uint32_t i = 0; i < pending_; ++i) {
+                msgs_[i] = mmsghdr{};
+                msgs_[i].msg_hdr.msg_iov = &iov_[i];
+                msgs_[i].msg_hdr.msg_iovlen = 1;
+            }
+            while (sent + failed < pending_) {
+                int n = ::sendmmsg(fd, msgs_.data() + sent + failed, pending_ - sent - failed, 0);
+                if (n > 0) {
+                    sent += static_cast<uint32_t>(n);
+                } else if (n < 0 && errno == EINTR) {
+                    continue;
+                } else {
+                    ++failed;  // sendmmsg 在第一个 datagram 就失败了, 跳过它
+                }
+            }
+#else
+            for (uint32_t i = 0; i < pending_; ++i) {
+                if (::send(fd, iov_[i].iov_base, iov_[i].iov_len, 0) >= 0) {
+                    ++sent;
+                } else {
+                    ++failed;
+                }
+            }
+#endif
+            owner_->packets_sent_.fetch_add(sent, std::memory_order_relaxed);
+            owner_->bytes_sent_.fetch_add(bytes, std::memory_order_relaxed);
+            owner_->messages_sent_.store(sent_messages_, std::memory_order_relaxed);
+            if (failed) {
+                owner_->send_errors_.fetch_add(failed, std::memory_order_relaxed);
+            }
+            pending_ = 0;
+        }
+
+        UdpSender* owner_;
+        std::vector<char> buffer_;       // batch 个 datagram, 每个 max_datagram 字节
+        std::vector<size_t> sizes_;      // 已完成的 datagram 的字节数
+        std::vector<iovec> iov_;
+#ifdef __linux__
+        std::vector<mmsghdr> msgs_;
+#else
+        std::vector<int> msgs_;
+#endif
+        uint32_t pending_ = 0;           // 已完成还没发送的 datagram 数
+        size_t size_ = 0;                // 当前 datagram 已写入的字节数
+        uint16_t records_ = 0;
+        uint16_t messages_ = 0;
+        uint64_t sequence_ = 0;          // 下一个 datagram 第一条消息的序号
+        uint64_t sent_messages_ = 0;
+        std::vector<uint32_t> announced_;  // 下标为 symbol_id, 最后一次声明时的 epoch_
+        uint32_t epoch_ = 1;
+        uint64_t epoch_started_ = 0;
+    };
+
+    MarketDataHub* hub_;
+    UdpSenderOptions options_;
+    UdpSocket socket_;
+    uint32_t type_mask_ = ~0u;
+    uint32_t session_ = 0;
+    int subscriber_id_ = -1;
+    std::atomic<uint64_t> messages_sent_{0};
+    std::atomic<uint64_t> packets_sent_{0};
+    std::atomic<uint64_t> bytes_sent_{0};
+    std::atomic<uint64_t> send_errors_{0};
+};
+
+struct UdpReceiverOptions {
+    std::string address = "239.255.0.1";  // 加入的组播组; 单播地址时只绑定端口
+    uint16_t port = 30001;
+    std::string interface;                // 加入组播用的本地网卡地址, 为空时由内核选择
+    uint32_t batch = 32;                  // 每次 recvmmsg 最多接收的 datagram 数
+    int rcvbuf = 8 << 20;                 // SO_RCVBUF 字节数 (受 net.core.rmem_max 限制), <= 0 时不设置
+    uint32_t max_symbols = 0;             // 接受的发送端 symbol_id 上限, 0 表示本地注册表的容量
+    ThreadPlacement placement;            // 接收线程的 CPU/调度/NUMA 放置
+};
+
+// 接收端的计数
+struct UdpReceiverStats {
+    uint64_t packets = 0;          // 收到的 datagram
+    uint64_t messages = 0;         // 写入 hub 的消息
+    uint64_t gaps = 0;             // 序号跳跃的次数
+    uint64_t lost = 0;             // 跳过的消息数
+    uint64_t duplicates = 0;       // 重复或晚到的 datagram (已丢弃)
+    uint64_t malformed = 0;        // 格式错误的 datagram (含超出 max_symbols 的 symbol 声明)
+    uint64_t unknown_symbols = 0;  // 还没收到 symbol 声明, 或本地注册表已满而丢弃的消息和声明
+    uint64_t resets = 0;           // 发送端重新启动 (session 变化) 的次数
+};
+
+/**
+ * UdpReceiver - 接收 UdpSender 的报文并写入本机的 hub
+ *
+ * 一个接收线程用 recvmmsg 一次取多个 datagram, 逐条解码后调用 hub 的 add();
+ * 接收端必须是本地 hub 唯一的写入者 (只接收部分类型时, 是这些类型唯一的写入者).
+ * 发送端的 symbol_id 经声明映射成本地 hub 的 symbol_id, 完整消息按名字写入.
+ * 丢包只统计不重传: 序号跳跃计入 gaps / lost, 之后从新的序号继续.
+ */
+class UdpReceiver {
+public:
+    /**
+     * 绑定端口, 加入组播组并启动接收线程; 失败时抛出 std::system_error
+     */
+    explicit UdpReceiver(MarketDataHub* hub, UdpReceiverOptions options = {})
+        : hub_(hub), options_(std::move(options)) {
+        if (hub_->read_only()) {
+            throw std::logic_error("cannot produce into a read-only hub");
+        }
+        if (options_.batch == 0) {
+            throw std::invalid_argument("batch must be > 0");
+        }
+        if (options_.max_symbols == 0) {
+            options_.max_symbols = hub_->symbols().capacity();
+        }
+
+        const in_addr group = udp_parse_address(options_.address);
+        const bool multicast = udp_is_multicast(group);
+        socket_.set_option(SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+        if (options_.rcvbuf > 0) {
+            socket_.set_option(SOL_SOCKET, SO_RCVBUF, options_.rcvbuf, "SO_RCVBUF");
+        }
+        // 接收线程每 100ms 醒来一次检查 stop()
+        timeval timeout{0, 100000};
+        socket_.set_option(SOL_SOCKET, SO_RCVTIMEO, timeout, "SO_RCVTIMEO");
+
+        // 绑定组播地址时内核只投递这个组的报文
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_port = htons(options_.port);
+        local.sin_addr.s_addr = multicast ? group.s_addr : htonl(INADDR_ANY);
+        if (::bind(socket_.fd(), reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0) {
+            throw std::system_error(errno, std::generic_category(), "bind port " + std::to_string(options_.port));
+        }
+        if (multicast) {
+            ip_mreq membership{};
+            membership.imr_multiaddr = group;
+            membership.imr_interface = udp_parse_address(options_.interface);
+            socket_.set_option(IPPROTO_IP, IP_ADD_MEMBERSHIP, membership, "IP_ADD_MEMBERSHIP");
+        }
+
+        running_ = true;
+        thread_ = start_placed_thread(options_.placement, [this] { receiver_thread(); });
+    }
+
+    ~UdpReceiver() {
+        stop();
+    }
+
+    UdpReceiver(const UdpReceiver&) = delete;
+    UdpReceiver& operator=(const UdpReceiver&) = delete;
+
+    /**
+     * 停止接收线程 (最多等一个接收超时)
+     */
+    void stop() {
+        running_ = false;
+        if (thread_ && thread_->joinable()) {
+            thread_->join();
+        }
+    }
+
+    UdpReceiverStats stats() const {
+        UdpReceiverStats stats;
+        stats.packets = counters_.packets.load(std::memory_order_relaxed);
+        stats.messages = counters_.messages.load(std::memory_order_relaxed);
+        stats.gaps = counters_.gaps.load(std::memory_order_relaxed);
+        stats.lost = counters_.lost.load(std::memory_order_relaxed);
+        stats.duplicates = counters_.duplicates.load(std::memory_order_relaxed);
+        stats.malformed = counters_.malformed.load(std::memory_order_relaxed);
+        stats.unknown_symbols = counters_.unknown_symbols.load(std::memory_order_relaxed);
+        stats.resets = counters_.resets.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    // 只由接收线程写入
+    struct Counters {
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> messages{0};
+        std::atomic<uint64_t> gaps{0};
+        std::atomic<uint64_t> lost{0};
+        std::atomic<uint64_t> duplicates{0};
+        std::atomic<uint64_t> malformed{0};
+        std::atomic<uint64_t> unknown_symbols{0};
+        std::atomic<uint64_t> resets{0};
+
+        static void bump(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    };
+
+    void receiver_thread() {
+        const size_t stride = kUdpMaxDatagram;
+        std::vector<char> buffer(stride * options_.batch);
+        std::vector<iovec> iov(options_.batch);
+        for (uint32_t i = 0; i < options_.batch; ++i) {
+            iov[i].iov_base = buffer.data() + i * stride;
+            iov[i].iov_len = stride;
+        }
+#ifdef __linux__
+        std::vector<mmsghdr> msgs(options_.batch);
+#endif
+
+        while (running_.load(std::memory_order_relaxed)) {
+#ifdef __linux__
+            for (uint32_t i = 0; i < options_.batch; ++i) {
+                msgs[i] = mmsghdr{};
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            // 阻塞到第一个 datagram (或超时), 再不等待地取走已到达的其余 datagram
+            int n = ::recvmmsg(socket_.fd(), msgs.data(), options_.batch, MSG_WAITFORONE, nullptr);
+            for (int i = 0; i < n; ++i) {
+                decode_packet(static_cast<const char*>(iov[i].iov_base), msgs[i].msg_len);
+            }
+#else
+            ssize_t n = ::recv(socket_.fd(), iov[0].iov_base, iov[0].iov_len, 0);
+            if (n > 0) {
+                decode_packet(static_cast<const char*>(iov[0].iov_base), static_cast<size_t>(n));
+            }
+#endif
+        }
+    }
+
+    // 报文来自网络, 任何异常都不能离开接收线程 (会 std::terminate): 计为格式错误, 继续接收
+    void decode_packet(const char* data, size_t size) {
+        try {
+            decode(data, size);
+        } catch (const std::exception&) {
+            Counters::bump(counters_.malformed);
+        }
+    }
+
+    void decode(const char* data, size_t size) {
+        Counters::bump(counters_.packets);
+        UdpPacketHeader header;
+        if (size < sizeof(header)) {
+            Counters::bump(counters_.malformed);
+            return;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (header.magic != kUdpMagic || header.version != kUdpVersion) {
+            Counters::bump(counters_.malformed);
+            return;
+        }
+
+        if (!synced_ || header.session != session_) {
+            if (synced_) {
+                Counters::bump(counters_.resets);
+            }
+            synced_ = true;
+            session_ = header.session;
+            expected_ = header.sequence;
+            local_ids_.clear();  // ID 只在一个 session 内有效
+        }
+        if (header.messages != 0 && header.sequence + header.messages <= expected_) {
+            Counters::bump(counters_.duplicates);
+            return;
+        }
+        if (header.sequence > expected_) {
+            Counters::bump(counters_.gaps);
+            Counters::bump(counters_.lost, header.sequence - expected_);
+        }
+        if (header.sequence + header.messages > expected_) {
+            expected_ = header.sequence + header.messages;
+        }
+
+        size_t offset = sizeof(header);
+        uint64_t written = 0;
+        for (uint16_t r = 0; r < header.records; ++r) {
+            UdpRecordHeader record;
+            if (offset + sizeof(record) > size) {
+                break;
+            }
+            std::memcpy(&record, data + offset, sizeof(record));
+            const char* body = data + offset + sizeof(record);
+            offset += sizeof(record) + record.body_size + record.name_size;
+            if (offset > size || !apply(record, body, written)) {
+                Counters::bump(counters_.malformed);
+                break;
+            }
+        }
+        Counters::bump(counters_.messages, written);
+    }
+
+    // 解码一条记录并写入 hub; body 长度与类型不符时返回 false
+    bool apply(const UdpRecordHeader& record, const char* body, uint64_t& written) {
+        const char* name = body + record.body_size;
+        switch (record.data_type) {
+            case kUdpSymbolRecord: {
+                uint32_t remote;
+                if (record.body_size != sizeof(remote)) {
+                    return false;
+                }
+                std::memcpy(&remote, body, sizeof(remote));
+                // 映射表按 ID 建表, 上限固定, 不随报文内容增长
+                if (remote >= options_.max_symbols || record.name_size == 0) {
+                    return false;
+                }
+                char symbol[sizeof(Trade::symbol)];
+                copy_name(symbol, name, record.name_size);
+                if (remote >= local_ids_.size()) {
+                    local_ids_.resize(size_t(remote) + 1, kNoSymbol);
+                }
+                try {
+                    local_ids_[remote] = hub_->symbol_id(symbol);
+                } catch (const std::length_error&) {
+                    // 本地注册表已满: 这个 ID 保持未映射, 它的消息计入 unknown_symbols
+                    local_ids_[remote] = kNoSymbol;
+                    Counters::bump(counters_.unknown_symbols);
+                }
+                return true;
+            }
+            case static_cast<uint8_t>(DataType::KLINE):
+                return add_full<Kline>(record, body, name, written);
+            case static_cast<uint8_t>(DataType::TRADE):
+                return add_full<Trade>(record, body, name, written);
+            case static_cast<uint8_t>(DataType::BOOK_L1):
+                return add_full<BookL1>(record, body, name, written);
+            case static_cast<uint8_t>(DataType::COMPACT_KLINE):
+                return add_compact<CompactKline>(record, body, written);
+            case static_cast<uint8_t>(DataType::COMPACT_TRADE):
+                return add_compact<CompactTrade>(record, body, written);
+            case static_cast<uint8_t>(DataType::COMPACT_BOOK_L1):
+                return add_compact<CompactBookL1>(record, body, written);
+            case static_cast<uint8_t>(DataType::BOOK_L2):
+                return add_compact<BookL2Update>(record, body, written);
+            case static_cast<uint8_t>(DataType::BOOK_SNAPSHOT):
+                return add_compact<BookSnapshot>(record, body, written);
+            default:
+                return true;  // 更新版本的发送端增加的类型, 跳过
+        }
+    }
+
+    template <class T>
+    bool add_full(const UdpRecordHeader& record, const char* body, const char* name, uint64_t& written) {
+        using Body = UdpBodyOf<T>;
+        if (record.body_size != sizeof(Body)) {
+            return false;
+        }
+        Body compact;
+        std::memcpy(&compact, body, sizeof(compact));
+        char symbol[sizeof(Trade::symbol)];
+        copy_name(symbol, name, record.name_size);
+        hub_->add(from_compact(compact, symbol));
+        ++written;
+        return true;
+    }
+
+    template <class T>
+    bool add_compact(const UdpRecordHeader& record, const char* body, uint64_t& written) {
+        if (record.body_size != sizeof(T)) {
+            return false;
+        }
+        T msg;
+        std::memcpy(&msg, body, sizeof(msg));
+        uint32_t local = msg.symbol_id < local_ids_.size() ? local_ids_[msg.symbol_id] : kNoSymbol;
+        if (local == kNoSymbol) {
+            Counters::bump(counters_.unknown_symbols);
+            return true;
+        }
+        msg.symbol_id = local;
+        hub_->add(msg);
+        ++written;
+        return true;
+    }
+
+    static void copy_name(char (&symbol)[sizeof(Trade::symbol)], const char* name, size_t size) {
+        size = std::min(size, sizeof(symbol) - 1);
+        std::memcpy(symbol, name, size);
+        symbol[size] = '\0';
+    }
+
+    MarketDataHub* hub_;
+    UdpReceiverOptions options_;
+    UdpSocket socket_;
+    std::atomic<bool> running_{false};
+    std::unique_ptr<std::thread> thread_;
+    Counters counters_;
+
+    // 以下只由接收线程访问
+    bool synced_ = false;
+    uint32_t session_ = 0;
+    uint64_t expected_ = 0;             // 下一条消息的序号
+    std::vector<uint32_t> local_ids_;   // 发送端 symbol_id -> 本地 symbol_id
+};
+
+} // namespace marketdata
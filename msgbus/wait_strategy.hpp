@@ -0,0 +1,319 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace marketdata {
+
+// 消费者在队列为空时的等待策略
+enum class WaitStrategy {
+    BUSY_SPIN = 0,   // 纯自旋, 延迟最低, 独占一个核
+    PAUSE_SPIN = 1,  // 自旋 + pause 指令, 空闲越久退避越多
+    YIELD = 2,       // 让出 CPU 时间片
+    SLEEP = 3,       // sleep_for(1us), 受 timer slack 影响实际约 50us
+    BLOCKING = 4     // 短暂自旋后阻塞在 futex 上, 由生产者唤醒
+};
+
+// 自旋等待时提示 CPU 降低功耗并让出流水线给超线程
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/**
+ * WakeupNotifier - 生产者唤醒阻塞消费者
+ *
+ * 消费者: 记录 epoch, 登记为 sleeper, 再检查一次队列, 仍为空才在 epoch 上 futex_wait.
+ * 生产者: 写入后 notify(), 发现有 sleeper 时递增 epoch 并 futex_wake.
+ * 生产者写 idx 和读 sleepers 之间有 seq_cst fence, 消费者登记 sleeper 后再检查队列,
+ * 所以两边至少有一方能看到对方, 不会丢失唤醒.
+ *
+ * 没有 BLOCKING 订阅者时 notify() 只有一次 relaxed load, 不需要 fence.
+ *
+ * 事件循环里的拉取式 Reader 不阻塞线程, 而是占用一个 eventfd 槽位: 读空后 arm_event(),
+ * 生产者下一次 notify() 把槽位从 ARMED 改回 IDLE 并写一次 eventfd, 所以每次
+ * 空闲 -> 有数据只唤醒一次. arm 和重新检查队列的顺序与 wait() 相同.
+ */
+class WakeupNotifier {
+public:
+    static constexpr int kMaxEventSlots = 16;
+
+    ~WakeupNotifier() {
+#ifdef __linux__
+        for (auto& slot : event_slots_) {
+            if (slot.fd >= 0) {
+                close(slot.fd);
+            }
+        }
+#endif
+    }
+
+    /**
+     * 登记/注销一个使用 BLOCKING 策略的订阅者
+     */
+    void add_blocking_subscriber() {
+        blocking_subscribers_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void remove_blocking_subscriber() {
+        blocking_subscribers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * 生产者每次发布后调用
+     */
+    void notify() {
+        if (blocking_subscribers_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+
+        // 让之前写入的 idx 先于 sleepers_ 的读取对其他线程可见
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) != 0) {
+            wake_all();
+        }
+        if (armed_events_.load(std::memory_order_relaxed) != 0) {
+            signal_events();
+        }
+    }
+
+    /**
+     * 无条件唤醒所有等待者 (例如停止订阅时)
+     */
+    void wake_all() {
+        epoch_.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, INT_MAX,
+                nullptr, nullptr, 0);
+#endif
+    }
+
+    /**
+     * 阻塞直到被唤醒或超时
+     * @param has_data 登记为 sleeper 之后再检查一次队列, 返回 true 则不阻塞
+     * @param timeout 最长等待时间, 保证订阅者能及时看到 running=false
+     */
+    template <class Pred>
+    void wait(Pred&& has_data, std::chrono::microseconds timeout) {
+        uint32_t epoch = epoch_.load(std::memory_order_acquire);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+
+        if (!has_data()) {
+#ifdef __linux__
+            timespec ts;
+            ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+            ts.tv_nsec = static_cast<long>((timeout.count() % 1000000) * 1000);
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, epoch,
+                    &ts, nullptr, 0);
+#else
+            // 没有 futex 的平台退化为短暂休眠
+            (void)epoch;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+#endif
+        }
+
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * 占用一个 eventfd 槽位, 返回槽位号; 槽位和 eventfd 在 notifier 销毁前一直保留,
+     * 生产者不会访问已释放的内存. 槽位用完或创建 eventfd 失败时抛出 std::runtime_error
+     */
+    int acquire_event() {
+        for (int i = 0; i < kMaxEventSlots; ++i) {
+            EventSlot& slot = event_slots_[i];
+            uint32_t expected = kEventFree;
+            if (!slot.state.compare_exchange_strong(expected, kEventClaimed, std::memory_order_acquire)) {
+                continue;
+            }
+#ifdef __linux__
+            if (slot.fd < 0) {
+                slot.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (slot.fd < 0) {
+                    slot.state.store(kEventFree, std::memory_order_release);
+                    throw std::runtime_error("eventfd() failed");
+                }
+            }
+            drain_event(slot.fd);  // 上一个使用者可能留下了未读的信号
+#endif
+            slot.state.store(kEventIdle, std::memory_order_release);
+            add_blocking_subscriber();  // 让 notify() 走带 fence 的路径
+            return i;
+        }
+        throw std::runtime_error("too many pollable readers on one data type (max " +
+                                 std::to_string(kMaxEventSlots) + ")");
+    }
+
+    void release_event(int slot) {
+        disarm_event(slot);
+        remove_blocking_subscriber();
+        event_slots_[slot].state.store(kEventFree, std::memory_order_release);
+    }
+
+    // 槽位的 eventfd, 非 Linux 平台为 -1
+    int event_fd(int slot) const {
+        return event_slots_[slot].fd;
+    }
+
+    /**
+     * 读空之后调用: 请求生产者在下一次发布时写 eventfd
+     * @param has_data arm 之后再检查一次队列, 返回 true 时撤销 arm 并返回 false, 调用者应继续读取
+     */
+    template <class Pred>
+    bool arm_event(int slot, Pred&& has_data) {
+        EventSlot& s = event_slots_[slot];
+        s.state.store(kEventArmed, std::memory_order_seq_cst);
+        armed_events_.fetch_add(1, std::memory_order_seq_cst);
+        if (has_data()) {
+            disarm_event(slot);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * 撤销 arm, 读掉生产者已经写入的信号, 之后 event_fd() 不再可读
+     */
+    void disarm_event(int slot) {
+        EventSlot& s = event_slots_[slot];
+        uint32_t expected = kEventArmed;
+        if (s.state.compare_exchange_strong(expected, kEventIdle, std::memory_order_acq_rel)) {
+            armed_events_.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+        // 生产者已经接手: 等它写完 eventfd 再读掉, 避免信号在读之后才到达
+        while (s.state.load(std::memory_order_acquire) == kEventSignalling) {
+            cpu_relax();
+        }
+#ifdef __linux__
+        drain_event(s.fd);
+#endif
+    }
+
+private:
+    static constexpr uint32_t kEventFree = 0;        // 未被占用
+    static constexpr uint32_t kEventClaimed = 1;     // 正在初始化
+    static constexpr uint32_t kEventIdle = 2;        // 已占用, 不需要信号
+    static constexpr uint32_t kEventArmed = 3;       // 等待生产者写 eventfd
+    static constexpr uint32_t kEventSignalling = 4;  // 生产者正在写 eventfd
+
+    struct alignas(64) EventSlot {
+        std::atomic<uint32_t> state{kEventFree};
+        int fd = -1;
+    };
+
+    void signal_events() {
+        for (auto& slot : event_slots_) {
+            uint32_t expected = kEventArmed;
+            if (!slot.state.compare_exchange_strong(expected, kEventSignalling, std::memory_order_acq_rel)) {
+                continue;
+            }
+            armed_events_.fetch_sub(1, std::memory_order_relaxed);
+#ifdef __linux__
+            uint64_t one = 1;
+            ssize_t ret = write(slot.fd, &one, sizeof(one));
+            (void)ret;  // 计数器不会溢出, EAGAIN 说明已经可读
+#endif
+            slot.state.store(kEventIdle, std::memory_order_release);
+        }
+    }
+
+#ifdef __linux__
+    static void drain_event(int fd) {
+        uint64_t value;
+        while (read(fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+        }
+    }
+#endif
+
+    alignas(64) std::atomic<uint32_t> epoch_{0};  // futex 等待的地址
+    std::atomic<uint32_t> sleepers_{0};           // 正在阻塞 (或即将阻塞) 的消费者数
+    alignas(64) std::atomic<uint32_t> blocking_subscribers_{0};  // 生产者每次都会读, 单独一条 cache line
+    alignas(64) std::atomic<uint32_t> armed_events_{0};          // ARMED 状态的槽位数
+    EventSlot event_slots_[kMaxEventSlots];
+};
+
+/**
+ * IdleWaiter - 消费者线程按 WaitStrategy 执行空闲等待
+ *
+ * 读不到数据时调用 idle(), 读到数据后调用 reset() 清除退避状态.
+ */
+class IdleWaiter {
+public:
+    IdleWaiter(WaitStrategy strategy, WakeupNotifier& notifier)
+        : strategy_(strategy), notifier_(notifier) {}
+
+    void reset() {
+        idle_rounds_ = 0;
+    }
+
+    /**
+     * @param has_data 不消费数据地检查队列是否非空, BLOCKING 策略在阻塞前使用
+     */
+    template <class Pred>
+    void idle(Pred&& has_data) {
+        switch (strategy_) {
+            case WaitStrategy::BUSY_SPIN:
+                break;
+            case WaitStrategy::PAUSE_SPIN:
+                // 指数退避: 1, 2, 4 ... 64 次 pause
+                for (uint32_t i = 0; i < pauses(); ++i) {
+                    cpu_relax();
+                }
+                if (idle_rounds_ < kMaxBackoffRounds) {
+                    ++idle_rounds_;
+                }
+                break;
+            case WaitStrategy::YIELD:
+                std::this_thread::yield();
+                break;
+            case WaitStrategy::SLEEP:
+                std::this_thread::sleep_for(std::chrono::microseconds(1));
+                break;
+            case WaitStrategy::BLOCKING:
+                // 先自旋一会儿, 避免刚空闲就进入内核
+                if (idle_rounds_ < kSpinRoundsBeforeBlock) {
+                    cpu_relax();
+                    ++idle_rounds_;
+                } else {
+                    notifier_.wait(has_data, std::chrono::milliseconds(100));
+                }
+                break;
+        }
+    }
+
+private:
+    static constexpr uint32_t kMaxBackoffRounds = 6;  // 1 << 6 = 最多 64 次 pause
+    static constexpr uint32_t kSpinRoundsBeforeBlock = 1000;
+
+    uint32_t pauses() const {
+        return 1u << idle_rounds_;
+    }
+
+    WaitStrategy strategy_;
+    WakeupNotifier& notifier_;
+    uint32_t idle_rounds_ = 0;
+};
+
+} // namespace marketdata
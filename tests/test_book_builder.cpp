@@ -0,0 +1,148 @@
+// BookBuilder: kBookL2Reset / kBookL2More handling, stale and unregistered updates.
+
+#include "market_data_hub.hpp"
+#include "test_util.hpp"
+
+#include <vector>
+
+using namespace marketdata;
+
+namespace {
+
+struct Fixture {
+    MarketDataHub hub;
+    std::unique_ptr<MarketDataHub::PollReader> l1_reader;
+    std::unique_ptr<MarketDataHub::PollReader> snapshot_reader;
+    std::unique_ptr<BookBuilder> builder;
+    uint32_t symbol;
+
+    Fixture() : hub(options()) {
+        l1_reader = hub.reader(DataType::COMPACT_BOOK_L1);
+        snapshot_reader = hub.reader(DataType::BOOK_SNAPSHOT);
+        BookBuilderOptions bo;
+        bo.depth = 3;
+        bo.subscribe.wait = WaitStrategy::YIELD;
+        builder = std::make_unique<BookBuilder>(&hub, bo);
+        symbol = hub.symbol_id("ETHUSDT");
+    }
+
+    static HubOptions options() {
+        HubOptions ho;
+        ho.queue_size = 1024;
+        return ho;
+    }
+
+    void update(uint64_t update_id, bool bid, double price, double quantity, uint8_t flags = 0) {
+        BookL2Update u{};
+        u.timestamp = update_id * 10;
+        u.update_id = update_id;
+        u.symbol_id = symbol;
+        u.is_bid = bid;
+        u.price = price;
+        u.quantity = quantity;
+        u.flags = flags;
+        hub.add(u);
+    }
+
+    // Waits until the builder has seen `handled` updates (applied, stale or invalid) and published
+    // l1s / snapshots in total; the publish counters are bumped after the message is in the hub
+    bool settle(uint64_t handled, uint64_t l1s, uint64_t snapshots) {
+        return test::eventually([&] {
+            return builder->updates_applied() + builder->stale_updates() + builder->invalid_updates() == handled &&
+                   builder->l1_published() == l1s && builder->snapshots_published() == snapshots;
+        });
+    }
+
+    std::vector<CompactBookL1> l1s() {
+        std::vector<CompactBookL1> out(64);
+        out.resize(l1_reader->poll(out.data(), out.size()));
+        return out;
+    }
+
+    std::vector<BookSnapshot> snapshots() {
+        std::vector<BookSnapshot> out(64);
+        out.resize(snapshot_reader->poll(out.data(), out.size()));
+        return out;
+    }
+};
+
+void test_reset_and_more_publish_once() {
+    Fixture f;
+    // A 5 + 5 level snapshot: Reset on the first update, More on all but the last
+    for (int i = 0; i < 5; ++i) {
+        f.update(1, true, 100 - i, 1 + i, i == 0 ? (kBookL2Reset | kBookL2More) : kBookL2More);
+    }
+    for (int i = 0; i < 5; ++i) {
+        f.update(1, false, 101 + i, 1 + i, i == 4 ? 0 : kBookL2More);
+    }
+    CHECK(f.settle(10, 1, 1));
+
+    auto l1s = f.l1s();
+    auto snaps = f.snapshots();
+    CHECK(l1s.size() == 1 && snaps.size() == 1);
+    if (l1s.size() == 1) {
+        CHECK(l1s[0].symbol_id == f.symbol && l1s[0].bid_price == 100 && l1s[0].ask_price == 101);
+    }
+    if (snaps.size() == 1) {
+        const BookSnapshot& s = snaps[0];
+        CHECK(s.update_id == 1 && s.bid_levels == 3 && s.ask_levels == 3);
+        CHECK(s.bid_price[0] == 100 && s.bid_price[2] == 98 && s.ask_price[0] == 101 && s.ask_price[2] == 103);
+        CHECK(s.bid_quantity[1] == 2 && s.ask_quantity[2] == 3);
+    }
+
+    // Below the top 3: applied, nothing published. Rank 1: snapshot only. New best: both
+    f.update(2, true, 96, 7);
+    f.update(3, true, 99, 9);
+    f.update(4, false, 100.5, 2);
+    CHECK(f.settle(13, 2, 3));
+    l1s = f.l1s();
+    snaps = f.snapshots();
+    CHECK(l1s.size() == 1 && snaps.size() == 2);
+    if (l1s.size() == 1) {
+        CHECK(l1s[0].ask_price == 100.5 && l1s[0].ask_quantity == 2);
+    }
+    if (snaps.size() == 2) {
+        CHECK(snaps[0].bid_quantity[1] == 9 && snaps[1].ask_price[0] == 100.5);
+    }
+
+    // A new Reset replaces the book instead of merging into it, even with an older update_id
+    f.update(1, true, 90, 1, kBookL2Reset | kBookL2More);
+    f.update(1, false, 91, 1);
+    CHECK(f.settle(15, 3, 4));
+    snaps = f.snapshots();
+    CHECK(snaps.size() == 1 && f.builder->stale_updates() == 0);
+    if (snaps.size() == 1) {
+        CHECK(snaps[0].bid_levels == 1 && snaps[0].ask_levels == 1);
+        CHECK(snaps[0].bid_price[0] == 90 && snaps[0].ask_price[0] == 91);
+    }
+    f.builder->stop();
+}
+
+void test_stale_and_unregistered_updates_are_dropped() {
+    Fixture f;
+    f.update(5, true, 100, 1, kBookL2Reset);
+    f.update(4, true, 101, 1);  // older than the book
+    BookL2Update bad{};
+    bad.update_id = 9;
+    bad.symbol_id = kNoSymbol;
+    f.hub.add(bad);             // add() routes by id but does not check it
+    bad.symbol_id = 1000;
+    f.hub.add(bad);
+    CHECK(f.settle(4, 1, 1));
+    CHECK(f.builder->updates_applied() == 1);
+    CHECK(f.builder->stale_updates() == 1);
+    CHECK(f.builder->invalid_updates() == 2);
+
+    auto l1s = f.l1s();
+    CHECK(l1s.size() == 1 && l1s[0].bid_price == 100);
+    CHECK(f.snapshots().size() == 1);
+    f.builder->stop();
+}
+
+} // namespace
+
+int main() {
+    test::run("reset_and_more_publish_once", test_reset_and_more_publish_once);
+    test::run("stale_and_unregistered_updates_are_dropped", test_stale_and_unregistered_updates_are_dropped);
+    return test::result();
+}
@@ -0,0 +1,89 @@
+// MarketDataHub::subscribe_conflated: one latest-value slot per registered symbol.
+
+#include "market_data_hub.hpp"
+#include "test_util.hpp"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace marketdata;
+
+namespace {
+
+void test_full_messages_are_keyed_by_registry_id() {
+    HubOptions ho;
+    ho.queue_size = 1024;
+    ho.max_symbols = 2;
+    MarketDataHub hub(ho);
+
+    std::mutex mutex;
+    std::map<std::string, double> latest;
+    std::atomic<uint64_t> delivered{0};
+    SubscribeOptions so;
+    so.wait = WaitStrategy::YIELD;
+    hub.subscribe_conflated(DataType::BOOK_L1, [&](DataType, const void* data, size_t n) {
+        auto* books = static_cast<const BookL1*>(data);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < n; ++i) {
+            latest[books[i].symbol] = books[i].bid_price;
+        }
+        delivered += n;
+    }, so);
+
+    // The registry holds two names; the third can't be interned and is dropped
+    const char* names[] = {"BTC", "ETH", "SOL"};
+    for (int i = 0; i < 300; ++i) {
+        BookL1 book{};
+        set_symbol(book.symbol, names[i % 3]);
+        book.bid_price = i;
+        hub.add(book);
+    }
+    CHECK(test::eventually([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return latest["BTC"] == 297 && latest["ETH"] == 298;
+    }));
+    std::lock_guard<std::mutex> lock(mutex);
+    CHECK(latest.count("SOL") == 0);
+    CHECK(hub.symbols().size() == 2 && hub.symbol_id("BTC") == 0 && hub.symbol_id("ETH") == 1);
+    CHECK(delivered <= 200);
+}
+
+void test_compact_messages_with_unregistered_ids_are_dropped() {
+    HubOptions ho;
+    ho.queue_size = 1024;
+    MarketDataHub hub(ho);
+    uint32_t btc = hub.symbol_id("BTC");
+
+    std::atomic<uint64_t> delivered{0};
+    std::atomic<double> last{0};
+    std::atomic<bool> bad_id{false};
+    SubscribeOptions so;
+    so.wait = WaitStrategy::YIELD;
+    hub.subscribe_conflated(DataType::COMPACT_BOOK_L1, [&](DataType, const void* data, size_t n) {
+        auto* books = static_cast<const CompactBookL1*>(data);
+        for (size_t i = 0; i < n; ++i) {
+            bad_id = bad_id || books[i].symbol_id != btc;
+            last = books[i].bid_price;
+        }
+        delivered += n;
+    }, so);
+
+    for (uint32_t id : {kNoSymbol, 1000u, btc}) {
+        CompactBookL1 book{};
+        book.symbol_id = id;
+        book.bid_price = id == btc ? 1 : 2;
+        hub.add(book);  // add() does not check the id, so unknown ones reach the subscriber
+    }
+    CHECK(test::eventually([&] { return last.load() == 1; }));
+    CHECK(!bad_id && delivered == 1);
+}
+
+} // namespace
+
+int main() {
+    test::run("full_messages_are_keyed_by_registry_id", test_full_messages_are_keyed_by_registry_id);
+    test::run("compact_messages_with_unregistered_ids_are_dropped",
+              test_compact_messages_with_unregistered_ids_are_dropped);
+    return test::result();
+}
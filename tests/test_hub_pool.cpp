@@ -0,0 +1,92 @@
+// MarketDataHub consumer thread pool: callbacks may call back into the hub, including
+// unsubscribing subscriptions that live on another worker.
+
+#include "market_data_hub.hpp"
+#include "test_util.hpp"
+
+#include <atomic>
+
+using namespace marketdata;
+
+namespace {
+
+HubOptions pool_options(uint32_t workers) {
+    HubOptions ho;
+    ho.queue_size = 1024;
+    ho.worker_threads = workers;
+    ho.worker_wait = WaitStrategy::YIELD;
+    return ho;
+}
+
+void test_callback_reenters_hub() {
+    MarketDataHub hub(pool_options(1));
+    std::atomic<int> self{-1};
+    std::atomic<int> calls{0};
+    std::atomic<size_t> stats_seen{0};
+    std::atomic<uint64_t> spawned_calls{0};
+    std::atomic<bool> spawned{false};
+    self = hub.subscribe(DataType::TRADE, [&](DataType, const void*) {
+        ++calls;
+        stats_seen = hub.stats().size();
+        if (!spawned.exchange(true)) {
+            hub.subscribe(DataType::TRADE, [&](DataType, const void*) { ++spawned_calls; });
+        }
+        hub.unsubscribe(self.load());
+    });
+
+    for (int i = 0; i < 50; ++i) {
+        hub.add(Trade{});
+    }
+    CHECK(test::eventually([&] { return spawned_calls.load() > 0 && hub.subscriber_count() == 1; }));
+    CHECK(calls == 1 && stats_seen == 1);
+    hub.stop_all();
+}
+
+void test_workers_unsubscribe_each_other() {
+    MarketDataHub hub(pool_options(2));
+    std::atomic<int> ids[2] = {{-1}, {-1}};
+    std::atomic<int> arrived{0};
+    std::atomic<int> done{0};
+    auto callback = [&](int mine) {
+        return [&, mine](DataType, const void*) {
+            if (arrived.fetch_add(1) >= 2) {
+                return;
+            }
+            // Both workers are inside a callback before either cancels the other's subscription
+            test::eventually([&] { return arrived.load() >= 2; }, 1000);
+            hub.unsubscribe(ids[1 - mine].load());
+            ++done;
+        };
+    };
+    // Subscriptions go to the least-loaded worker, so these two land on different threads
+    ids[0] = hub.subscribe(DataType::TRADE, callback(0));
+    ids[1] = hub.subscribe(DataType::TRADE, callback(1));
+
+    hub.add(Trade{});
+    CHECK(test::eventually([&] { return done.load() == 2; }));
+    CHECK(hub.subscriber_count() == 0);
+    hub.stop_all();
+}
+
+void test_unsubscribe_waits_for_running_callback() {
+    MarketDataHub hub(pool_options(1));
+    std::atomic<bool> in_callback{false};
+    int id = hub.subscribe(DataType::TRADE, [&](DataType, const void*) {
+        in_callback = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        in_callback = false;
+    });
+    hub.add(Trade{});
+    CHECK(test::eventually([&] { return in_callback.load(); }));
+    hub.unsubscribe(id);
+    CHECK(!in_callback);
+}
+
+} // namespace
+
+int main() {
+    test::run("callback_reenters_hub", test_callback_reenters_hub);
+    test::run("workers_unsubscribe_each_other", test_workers_unsubscribe_each_other);
+    test::run("unsubscribe_waits_for_running_callback", test_unsubscribe_waits_for_running_callback);
+    return test::result();
+}
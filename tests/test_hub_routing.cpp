@@ -0,0 +1,37 @@
+// MarketDataHub::symbol_group: a symbol hashes to the same queue whether or not it was cut
+// to fit the 32-byte symbol field.
+
+#include "market_data_hub.hpp"
+#include "test_util.hpp"
+
+#include <cstring>
+#include <string>
+
+using namespace marketdata;
+
+namespace {
+
+void test_long_symbols_share_a_group() {
+    HubOptions ho;
+    ho.queue_size = 1024;
+    ho.symbol_groups = 64;
+    MarketDataHub hub(ho);
+
+    const std::string name(40, 'A');
+    Trade trade{};
+    set_symbol(trade.symbol, name.c_str());
+    char unterminated[sizeof(Trade::symbol)];
+    std::memset(unterminated, 'A', sizeof(unterminated));
+
+    // Only the 31 characters set_symbol keeps take part in the hash
+    const uint32_t group = hub.symbol_group(trade.symbol);
+    CHECK(hub.symbol_group(name.c_str()) == group);
+    CHECK(hub.symbol_group(unterminated) == group);
+}
+
+} // namespace
+
+int main() {
+    test::run("long_symbols_share_a_group", test_long_symbols_share_a_group);
+    return test::result();
+}
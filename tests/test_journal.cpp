@@ -0,0 +1,84 @@
+// JournalWriter / JournalReader: receive times stay ordered, so the index and replay pacing
+// hold up when the caller's clock goes backwards.
+
+#include "journal.hpp"
+#include "test_util.hpp"
+
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+using namespace marketdata;
+
+namespace {
+
+std::string journal_path() {
+    return "/tmp/msgbus_test_journal." + std::to_string(getpid());
+}
+
+void remove_journal(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + ".idx").c_str());
+}
+
+Trade trade(uint64_t timestamp) {
+    Trade t{};
+    set_symbol(t.symbol, "BTC");
+    t.timestamp = timestamp;
+    return t;
+}
+
+void test_recv_ns_is_monotonic() {
+    const std::string path = journal_path();
+    uint64_t start = 0;
+    {
+        JournalWriter writer(path, 16);
+        start = writer.start_wall_ns();
+        for (uint64_t i = 0; i < 3000; ++i) {
+            writer.append(trade(i));
+        }
+        CHECK(writer.now_ns() >= start);
+    }
+    JournalReader reader(path);
+    CHECK(reader.size() == 3000 && reader.start_wall_ns() == start);
+    bool ordered = reader[0].recv_ns >= start;
+    for (uint64_t i = 1; i < reader.size(); ++i) {
+        ordered &= reader[i].recv_ns >= reader[i - 1].recv_ns;
+    }
+    CHECK(ordered);
+    remove_journal(path);
+}
+
+void test_backward_times_are_clamped() {
+    const std::string path = journal_path();
+    {
+        // A clock stepped back in the middle of a recording, across several index entries
+        JournalWriter writer(path, 16);
+        for (uint64_t i = 0; i < 2 * kJournalIndexStride; ++i) {
+            writer.append(trade(i), 1000 + i);
+        }
+        for (uint64_t i = 0; i < 2 * kJournalIndexStride; ++i) {
+            writer.append(trade(i), 500 + i);
+        }
+        writer.append(trade(0), 5000);
+    }
+    JournalReader reader(path);
+    const uint64_t last_before_step = 1000 + 2 * kJournalIndexStride - 1;
+    CHECK(reader.size() == 4 * kJournalIndexStride + 1);
+    CHECK(reader[2 * kJournalIndexStride].recv_ns == last_before_step);
+    CHECK(reader[4 * kJournalIndexStride - 1].recv_ns == last_before_step);
+    CHECK(reader.lower_bound(0) == 0);
+    CHECK(reader.lower_bound(1500) == 500);
+    CHECK(reader.lower_bound(last_before_step) == 2 * kJournalIndexStride - 1);
+    CHECK(reader.lower_bound(last_before_step + 1) == 4 * kJournalIndexStride);
+    CHECK(reader.lower_bound(6000) == reader.size());
+    remove_journal(path);
+}
+
+} // namespace
+
+int main() {
+    test::run("recv_ns_is_monotonic", test_recv_ns_is_monotonic);
+    test::run("backward_times_are_clamped", test_backward_times_are_clamped);
+    return test::result();
+}
@@ -0,0 +1,62 @@
+// KlineAggregator: bars whose "<symbol>@<interval>" name does not fit in Kline::symbol are
+// dropped and counted, never published under a truncated name.
+
+#include "market_data_hub.hpp"
+#include "test_util.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace marketdata;
+
+namespace {
+
+void test_long_names_are_not_truncated() {
+    HubOptions ho;
+    ho.queue_size = 1024;
+    MarketDataHub hub(ho);
+    auto klines = hub.reader(DataType::KLINE);
+    auto compact = hub.reader(DataType::COMPACT_KLINE);
+
+    KlineAggregatorOptions ko;
+    ko.intervals_ns = {1000000000ull, 250000000ull};  // "@1s" fits a 28-character symbol, "@250ms" does not
+    ko.subscribe.wait = WaitStrategy::YIELD;
+    KlineAggregator aggregator(&hub, ko);
+
+    const std::string symbol(28, 'X');
+    const uint32_t symbol_id = hub.symbol_id(symbol.c_str());
+    for (uint64_t ts : {100000000ull, 1100000000ull}) {
+        Trade trade{};
+        set_symbol(trade.symbol, symbol.c_str());
+        trade.timestamp = ts;
+        trade.price = 1;
+        trade.quantity = 1;
+        hub.add(trade);
+        CompactTrade compact_trade{};
+        compact_trade.symbol_id = symbol_id;
+        compact_trade.timestamp = ts;
+        compact_trade.price = 1;
+        compact_trade.quantity = 1;
+        hub.add(compact_trade);
+    }
+
+    // The second trade closes the 1s bar of each stream; every trade misses its 250ms bar
+    CHECK(test::eventually([&] { return aggregator.bars_closed() == 2 && aggregator.dropped_trades() == 4; }));
+    std::vector<Kline> got(8);
+    got.resize(klines->poll(got.data(), got.size()));
+    CHECK(got.size() == 1 && got[0].symbol == symbol + "@1s");
+    std::vector<CompactKline> got_compact(8);
+    got_compact.resize(compact->poll(got_compact.data(), got_compact.size()));
+    CHECK(got_compact.size() == 1 && hub.symbols().name(got_compact[0].symbol_id) == symbol + "@1s");
+    CHECK(hub.symbols().find((symbol + "@250ms").c_str()) == kNoSymbol);
+    CHECK(hub.symbols().size() == 2);
+    aggregator.stop();
+}
+
+} // namespace
+
+int main() {
+    test::run("long_names_are_not_truncated", test_long_names_are_not_truncated);
+    return test::result();
+}
@@ -0,0 +1,332 @@
+// SPMCQueue: overrun accounting, gating (lossless) readers, batch vs single-message paths,
+// readers lapped across the 32-bit block tag range, and shared-memory rings.
+
+#include "spmc.hpp"
+#include "test_util.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Msg {
+    uint64_t value;
+    char pad[40];
+};
+
+using Fixed = SPMCQueue<Msg, 64>;
+using Dynamic = DynamicSPMCQueue<Msg>;
+
+Msg make(uint64_t value) {
+    Msg m{};
+    m.value = value;
+    return m;
+}
+
+// Everything readCopy() returns until the queue is empty: values, and the lost count in total
+template <class Reader>
+std::vector<uint64_t> read_all(Reader& reader, uint64_t& lost) {
+    std::vector<uint64_t> values;
+    Msg out;
+    lost = 0;
+    while (auto res = reader.readCopy(out)) {
+        CHECK(res.seq == out.value);
+        lost += res.lost;
+        values.push_back(out.value);
+    }
+    return values;
+}
+
+void test_overrun_accounting() {
+    Fixed q;
+    auto reader = q.getReader();
+    Msg out;
+    CHECK(reader.readCopy(out).status == Fixed::ReadStatus::EMPTY);
+    CHECK(reader.empty());
+
+    // Sequence numbers start at 1; the value carries the sequence number it was written at
+    for (uint64_t i = 1; i <= 10; ++i) {
+        q.write(make(i));
+    }
+    CHECK(reader.lag() == 10);
+    auto res = reader.readCopy(out);
+    CHECK(res.status == Fixed::ReadStatus::OK && res.lost == 0 && res.seq == 1 && out.value == 1);
+
+    // Lap the reader: the first read reports every skipped message once, the rest are OK
+    for (uint64_t i = 11; i <= 300; ++i) {
+        q.write(make(i));
+    }
+    CHECK(reader.lag() == 299);
+    res = reader.readCopy(out);
+    CHECK(res.status == Fixed::ReadStatus::OVERRUN);
+    CHECK(res.lost > 0 && res.seq == 2 + res.lost && out.value == res.seq);
+    uint64_t lost = res.lost;
+    uint64_t read = 2;
+    uint64_t next = res.seq + 1;
+    while ((res = reader.readCopy(out))) {
+        CHECK(res.status == Fixed::ReadStatus::OK && res.seq == next && out.value == next);
+        ++next;
+        ++read;
+    }
+    CHECK(next == 301 && read + lost == 300);
+    CHECK(reader.lag() == 0 && reader.empty());
+
+    // The batch read reports the same total
+    for (uint64_t i = 301; i <= 600; ++i) {
+        q.write(make(i));
+    }
+    Msg batch[64];
+    lost = 0;
+    uint64_t count = 0;
+    uint64_t expect = 0;
+    while (true) {
+        auto b = reader.readCopyBatch(batch, 64);
+        if (b.count == 0) {
+            break;
+        }
+        if (expect == 0) {
+            expect = batch[0].value;
+        }
+        for (uint32_t i = 0; i < b.count; ++i) {
+            CHECK(batch[i].value == expect++);
+        }
+        CHECK(b.last_seq == expect - 1);
+        lost += b.lost;
+        count += b.count;
+    }
+    CHECK(lost + count == 300 && expect == 601);
+}
+
+void test_gating_reader_is_never_overwritten() {
+    Dynamic q(64, false);
+    auto gated = q.getGatingReader();
+    auto plain = q.getReader();
+
+    // The writer may fill the ring once, then has to wait for the gating reader
+    uint32_t written = 0;
+    while (q.tryWrite(make(written + 1))) {
+        ++written;
+    }
+    CHECK(written == 64);
+    CHECK(!q.hasSpace());
+
+    Msg out;
+    for (uint64_t i = 1; i <= 16; ++i) {
+        auto res = gated.readCopy(out);
+        CHECK(res.status == Dynamic::ReadStatus::OK && out.value == i);
+    }
+    CHECK(q.hasSpace(16) && !q.hasSpace(17));
+    for (uint64_t i = 65; i <= 80; ++i) {
+        CHECK(q.tryWrite(make(i)));
+    }
+    CHECK(!q.tryWrite(make(81)));
+
+    // The gating reader sees every message; the plain reader was lapped and says how much it missed
+    uint64_t lost = 0;
+    auto values = read_all(gated, lost);
+    CHECK(lost == 0 && values.size() == 64 && values.front() == 17 && values.back() == 80);
+    values = read_all(plain, lost);
+    CHECK(lost > 0 && lost + values.size() == 80 && values.back() == 80);
+
+    // Released, the reader stops gating the writer
+    q.releaseReader(gated);
+    for (uint64_t i = 81; i <= 300; ++i) {
+        CHECK(q.tryWrite(make(i)));
+    }
+    values = read_all(gated, lost);
+    CHECK(lost > 0 && values.back() == 300);
+}
+
+void test_gating_reader_concurrent() {
+    Dynamic q(256, false);
+    auto reader = q.getGatingReader();
+    const uint64_t n = 200000;
+    std::thread writer([&] {
+        for (uint64_t i = 1; i <= n; ++i) {
+            while (!q.tryWrite(make(i))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::vector<Msg> out(100);
+    uint64_t expect = 1;
+    uint64_t lost = 0;
+    bool in_order = true;
+    while (expect <= n) {
+        auto res = reader.readCopyBatch(out.data(), static_cast<uint32_t>(out.size()));
+        lost += res.lost;
+        for (uint32_t i = 0; i < res.count; ++i) {
+            in_order &= out[i].value == expect++;
+        }
+        if (res.count == 0) {
+            std::this_thread::yield();
+        }
+    }
+    writer.join();
+    CHECK(lost == 0 && in_order);
+}
+
+void test_batch_matches_single_message_paths() {
+    // The same values written four ways, within one lap and past it
+    for (uint64_t total : {40u, 200u}) {
+        std::vector<Msg> input;
+        for (uint64_t i = 1; i <= total; ++i) {
+            input.push_back(make(i));
+        }
+
+        Fixed single, batch, claimed, in_place;
+        auto r_single = single.getReader();
+        auto r_batch = batch.getReader();
+        auto r_claimed = claimed.getReader();
+        auto r_in_place = in_place.getReader();
+        for (const Msg& m : input) {
+            single.write(m);
+            claimed.claim() = m;
+            claimed.commit();
+            in_place.write([&](Msg& slot) { slot.value = m.value; });
+        }
+        batch.writeBatch(input.data(), input.size());
+        CHECK(single.published() == total && batch.published() == total);
+        CHECK(claimed.published() == total && in_place.published() == total);
+
+        uint64_t lost_single = 0;
+        uint64_t lost = 0;
+        auto expected = read_all(r_single, lost_single);
+        CHECK(lost_single + expected.size() == total);
+        CHECK(read_all(r_batch, lost) == expected && lost == lost_single);
+        CHECK(read_all(r_claimed, lost) == expected && lost == lost_single);
+        CHECK(read_all(r_in_place, lost) == expected && lost == lost_single);
+
+        // readCopyBatch() and drain() return what readCopy() did
+        Fixed again;
+        auto r_copy_batch = again.getReader();
+        auto r_drain = again.getReader();
+        again.writeBatch(input.data(), input.size());
+        std::vector<uint64_t> got;
+        Msg out[16];
+        uint64_t batch_lost = 0;
+        while (true) {
+            auto b = r_copy_batch.readCopyBatch(out, 16);
+            if (b.count == 0) {
+                break;
+            }
+            batch_lost += b.lost;
+            for (uint32_t i = 0; i < b.count; ++i) {
+                got.push_back(out[i].value);
+            }
+        }
+        CHECK(got == expected && batch_lost == lost_single);
+        got.clear();
+        r_drain.drain([&](Msg& m) { got.push_back(m.value); });
+        CHECK(got == expected);
+    }
+}
+
+// A runtime-sized queue on memory whose ring header the test keeps a pointer to
+struct SeekableQueue {
+    explicit SeekableQueue(uint32_t capacity)
+        : SeekableQueue(capacity, RingMemory::anonymous(Dynamic::storageBytes(capacity), false)) {}
+
+    SeekableQueue(uint32_t capacity, RingMemory mem)
+        : header(static_cast<SPMCRingHeader*>(mem.data())), q(capacity, std::move(mem)) {}
+
+    // Publishes sequence numbers up to `last` without writing the ones in between, the way
+    // writeBatch() skips what would not survive: move write_idx, then write the final
+    // capacity() messages. last - capacity() must not be behind published()
+    void jump_to(uint64_t last) {
+        const uint32_t cap = q.capacity();
+        CHECK(last - cap >= q.published());
+        header->write_idx = last - cap;
+        header->lap_epoch.store(header->write_idx >> kLapEpochShift, std::memory_order_relaxed);
+        std::vector<Msg> tail(cap);
+        for (uint32_t i = 0; i < cap; ++i) {
+            tail[i].value = last - cap + 1 + i;
+        }
+        q.writeBatch(tail.data(), cap);
+    }
+
+    SPMCRingHeader* header;
+    Dynamic q;
+};
+
+void test_lapped_reader_locate() {
+    const uint64_t k32 = 1ull << 32;
+    Msg out;
+    {
+        // Lapped by exactly 2^32: the block at the reader's position carries the same 32-bit tag
+        SeekableQueue ring(64);
+        Dynamic& q = ring.q;
+        auto reader = q.getReader();
+        q.write(make(1));
+        CHECK(reader.readCopy(out).seq == 1);
+        ring.jump_to(2 + k32);
+        auto res = reader.readCopy(out);
+        CHECK(res.status == Dynamic::ReadStatus::OVERRUN && res.seq == 2 + k32 && res.lost == k32);
+        CHECK(out.value == 2 + k32);
+    }
+    {
+        // Lapped by 2^32 - capacity: the block looks like one from the reader's previous lap
+        SeekableQueue ring(64);
+        Dynamic& q = ring.q;
+        auto reader = q.getReader();
+        ring.jump_to(k32 - 63);
+        auto res = reader.readCopy(out);
+        CHECK(res.status == Dynamic::ReadStatus::OVERRUN && res.seq == k32 - 63 && out.value == k32 - 63);
+        CHECK(reader.empty());
+    }
+    {
+        // A reader keeping up across the 2^31 epoch boundary reads everything in order
+        SeekableQueue ring(64);
+        Dynamic& q = ring.q;
+        ring.jump_to((1ull << 31) - 10);
+        auto reader = q.getReader();
+        for (uint64_t i = 0; i < 20; ++i) {
+            q.write(make((1ull << 31) - 9 + i));
+        }
+        uint64_t lost = 0;
+        auto values = read_all(reader, lost);
+        CHECK(lost == 0 && values.size() == 20 && values.back() == (1ull << 31) + 10);
+    }
+}
+
+void test_shared_ring_name_in_use() {
+    const std::string name = "/msgbus_test_spmc." + std::to_string(getpid());
+    const size_t bytes = Dynamic::storageBytes(64);
+    Dynamic first(64, RingMemory::createShared(name, bytes, false));
+    first.write(make(1));
+
+    // A second creator must not unlink a ring that readers of the first one are using
+    int err = 0;
+    try {
+        RingMemory::createShared(name, bytes, false);
+    } catch (const std::system_error& e) {
+        err = e.code().value();
+    }
+    CHECK(err == EEXIST);
+    Dynamic attached(RingMemory::openShared(name));
+    CHECK(attached.published() == 1);
+
+    // replace is the explicit way to take over a stale name
+    Dynamic second(64, RingMemory::createShared(name, bytes, false, true));
+    Dynamic reattached(RingMemory::openShared(name));
+    CHECK(reattached.published() == 0 && attached.published() == 1);
+}
+
+} // namespace
+
+int main() {
+    test::run("overrun_accounting", test_overrun_accounting);
+    test::run("gating_reader_is_never_overwritten", test_gating_reader_is_never_overwritten);
+    test::run("gating_reader_concurrent", test_gating_reader_concurrent);
+    test::run("batch_matches_single_message_paths", test_batch_matches_single_message_paths);
+    test::run("lapped_reader_locate", test_lapped_reader_locate);
+    test::run("shared_ring_name_in_use", test_shared_ring_name_in_use);
+    return test::result();
+}
@@ -0,0 +1,64 @@
+// thread_placement.hpp: cpulist parsing and how placement errors reach the caller.
+
+#include "thread_placement.hpp"
+#include "test_util.hpp"
+
+#include <atomic>
+
+using namespace marketdata;
+
+namespace {
+
+void test_parse_cpu_list() {
+    CHECK(parse_cpu_list("0-3,8-9\n") == (std::vector<int>{0, 1, 2, 3, 8, 9}));
+    CHECK(parse_cpu_list("5\n") == std::vector<int>{5});
+    CHECK(parse_cpu_list(" 1 , 4-5 ") == (std::vector<int>{1, 4, 5}));
+    // A memory-only NUMA node has no CPUs: the file holds just a newline
+    CHECK(parse_cpu_list("\n").empty());
+    CHECK(parse_cpu_list("").empty());
+    CHECK(parse_cpu_list("2,,3") == (std::vector<int>{2, 3}));
+    // Malformed input yields no CPUs rather than an exception
+    CHECK(parse_cpu_list("x").empty());
+    CHECK(parse_cpu_list("1-").empty());
+    CHECK(parse_cpu_list("3-1").empty());
+    CHECK(parse_cpu_list("1-2x").empty());
+    CHECK(parse_cpu_list("-1").empty());
+    CHECK(parse_cpu_list("99999999999").empty());
+    // A huge range stops at CPU_SETSIZE, which apply_thread_placement() reports as invalid
+    CHECK(parse_cpu_list("0-2147483647").size() == size_t(CPU_SETSIZE) + 1);
+}
+
+void test_placement_errors_reach_the_caller() {
+    ThreadPlacement placement;
+    placement.numa_node = NodeMask::kMaxNodes - 1;  // no such node: no cpulist to read
+    std::atomic<bool> ran{false};
+    bool threw = false;
+    try {
+        start_placed_thread(placement, [&] { ran = true; })->join();
+    } catch (const std::runtime_error& e) {
+        threw = std::string(e.what()).find("no CPUs found") != std::string::npos;
+    }
+    CHECK(threw && !ran);
+
+    placement = ThreadPlacement{};
+    placement.cpus = {CPU_SETSIZE};
+    threw = false;
+    try {
+        start_placed_thread(placement, [&] { ran = true; })->join();
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw && !ran);
+
+    auto thread = start_placed_thread(ThreadPlacement{}, [&] { ran = true; });
+    thread->join();
+    CHECK(ran);
+}
+
+} // namespace
+
+int main() {
+    test::run("parse_cpu_list", test_parse_cpu_list);
+    test::run("placement_errors_reach_the_caller", test_placement_errors_reach_the_caller);
+    return test::result();
+}
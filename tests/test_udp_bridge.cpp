@@ -0,0 +1,216 @@
+// UdpSender / UdpReceiver over loopback: a round trip, and hand-built datagrams that are
+// truncated or malformed, which must be counted and dropped without stopping the receiver.
+
+#include "udp_bridge.hpp"
+#include "test_util.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace marketdata;
+
+namespace {
+
+constexpr uint16_t kRoundTripPort = 39101;
+constexpr uint16_t kCraftedPort = 39102;
+
+HubOptions hub_options(uint32_t max_symbols = 0) {
+    HubOptions ho;
+    ho.queue_size = 1 << 14;
+    if (max_symbols) {
+        ho.max_symbols = max_symbols;
+    }
+    return ho;
+}
+
+// A datagram assembled field by field, so tests can cut it short or lie about sizes
+class Datagram {
+public:
+    Datagram(uint16_t records, uint16_t messages, uint64_t sequence, uint32_t magic = kUdpMagic,
+             uint16_t version = kUdpVersion) {
+        UdpPacketHeader header{magic, version, records, messages, 0, 42, sequence};
+        append(&header, sizeof(header));
+    }
+
+    Datagram& announce(uint32_t remote_id, const std::string& name) {
+        UdpRecordHeader record{kUdpSymbolRecord, uint8_t(name.size()), uint16_t(sizeof(remote_id))};
+        append(&record, sizeof(record));
+        append(&remote_id, sizeof(remote_id));
+        append(name.data(), name.size());
+        return *this;
+    }
+
+    template <class Body>
+    Datagram& message(DataType type, const Body& body, const std::string& name = "",
+                      uint16_t body_size = sizeof(Body)) {
+        UdpRecordHeader record{uint8_t(type), uint8_t(name.size()), body_size};
+        append(&record, sizeof(record));
+        append(&body, sizeof(body));
+        append(name.data(), name.size());
+        return *this;
+    }
+
+    Datagram& truncate(size_t bytes) {
+        bytes_.resize(bytes_.size() - bytes);
+        return *this;
+    }
+
+    void send(uint16_t port) const {
+        UdpSocket socket;
+        sockaddr_in to{};
+        to.sin_family = AF_INET;
+        to.sin_port = htons(port);
+        to.sin_addr = udp_parse_address("127.0.0.1");
+        sendto(socket.fd(), bytes_.data(), bytes_.size(), 0, reinterpret_cast<sockaddr*>(&to), sizeof(to));
+    }
+
+private:
+    void append(const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        bytes_.insert(bytes_.end(), p, p + size);
+    }
+
+    std::vector<char> bytes_;
+};
+
+CompactTrade compact_trade(uint32_t symbol_id, uint64_t timestamp) {
+    CompactTrade t{};
+    t.symbol_id = symbol_id;
+    t.timestamp = timestamp;
+    t.price = static_cast<double>(timestamp);
+    return t;
+}
+
+void test_round_trip() {
+    MarketDataHub a(hub_options()), b(hub_options());
+    b.symbol_id("PADDING");  // the two hubs assign different ids to the same name
+    auto trades = b.reader(DataType::TRADE);
+    auto compact = b.reader(DataType::COMPACT_TRADE);
+
+    UdpReceiverOptions ro;
+    ro.address = "127.0.0.1";
+    ro.port = kRoundTripPort;
+    UdpReceiver rx(&b, ro);
+    UdpSenderOptions so;
+    so.address = "127.0.0.1";
+    so.port = kRoundTripPort;
+    so.subscribe.lossless = true;
+    so.subscribe.wait = WaitStrategy::YIELD;
+    UdpSender tx(&a, so);
+
+    const uint64_t n = 2000;
+    uint32_t eth = a.symbol_id("ETH");
+    for (uint64_t i = 0; i < n; ++i) {
+        Trade t{};
+        set_symbol(t.symbol, "BTC");
+        t.timestamp = i;
+        t.price = static_cast<double>(i);
+        a.add(t);
+        a.add(compact_trade(eth, i));
+        if (i % 200 == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    CHECK(test::eventually([&] { return tx.messages_sent() == 2 * n && rx.stats().messages == 2 * n; }));
+
+    std::vector<Trade> got_trades(n);
+    std::vector<CompactTrade> got_compact(n);
+    size_t trade_count = trades->poll(got_trades.data(), n);
+    size_t compact_count = compact->poll(got_compact.data(), n);
+    CHECK(trade_count == n && compact_count == n);
+    bool decoded = true;
+    for (size_t i = 0; i < trade_count; ++i) {
+        decoded &= std::strcmp(got_trades[i].symbol, "BTC") == 0 && got_trades[i].price == double(i);
+    }
+    for (size_t i = 0; i < compact_count; ++i) {
+        decoded &= std::strcmp(b.symbols().name(got_compact[i].symbol_id), "ETH") == 0 &&
+                   got_compact[i].timestamp == i;
+    }
+    CHECK(decoded);
+    auto stats = rx.stats();
+    CHECK(stats.malformed == 0 && stats.unknown_symbols == 0 && stats.lost == 0);
+    tx.stop();
+    rx.stop();
+}
+
+void test_truncated_and_malformed_datagrams() {
+    MarketDataHub hub(hub_options(2));  // room for two local symbols
+    auto compact = hub.reader(DataType::COMPACT_TRADE);
+    UdpReceiverOptions ro;
+    ro.address = "127.0.0.1";
+    ro.port = kCraftedPort;
+    ro.max_symbols = 16;
+    UdpReceiver rx(&hub, ro);
+
+    uint64_t sent = 0;
+    auto deliver = [&](const Datagram& d) {
+        d.send(kCraftedPort);
+        ++sent;
+        CHECK(test::eventually([&] { return rx.stats().packets == sent; }));
+    };
+    uint64_t seq = 0;
+    auto trade = [&](uint32_t remote_id, uint16_t body_size = sizeof(CompactTrade)) {
+        uint64_t sequence = seq++;
+        return Datagram(1, 1, sequence).message(DataType::COMPACT_TRADE, compact_trade(remote_id, sequence), "",
+                                                body_size);
+    };
+
+    // Shorter than the packet header, wrong magic, wrong version
+    deliver(Datagram(0, 0, 0).truncate(10));
+    deliver(Datagram(0, 0, 0, 0x12345678));
+    deliver(Datagram(0, 0, 0, kUdpMagic, kUdpVersion + 1));
+    CHECK(rx.stats().malformed == 3);
+
+    // A valid announcement and message for remote id 7
+    deliver(Datagram(1, 0, seq).announce(7, "AAA"));
+    deliver(trade(7));
+    CHECK(rx.stats().messages == 1 && rx.stats().malformed == 3);
+
+    // Body cut short, body size that does not match the type, symbol name cut off
+    deliver(trade(7).truncate(1));
+    deliver(trade(7, sizeof(CompactTrade) - 4));
+    deliver(Datagram(1, 0, seq).announce(8, "BBB").truncate(1));
+    CHECK(rx.stats().malformed == 6);
+
+    // Announcements outside max_symbols or without a name
+    deliver(Datagram(1, 0, seq).announce(16, "CCC"));
+    deliver(Datagram(1, 0, seq).announce(0xFFFFFFFFu, "DDD"));
+    deliver(Datagram(1, 0, seq).announce(3, ""));
+    CHECK(rx.stats().malformed == 9);
+
+    // The local registry fills up: the third name stays unmapped, as do never-announced ids
+    deliver(Datagram(2, 0, seq).announce(1, "BBB").announce(2, "CCC"));
+    CHECK(hub.symbols().size() == 2 && rx.stats().unknown_symbols == 1);
+    deliver(trade(2));
+    deliver(trade(5));
+    CHECK(rx.stats().unknown_symbols == 3);
+    deliver(trade(1));
+
+    // Records after a bad one in the same datagram are not applied
+    deliver(Datagram(2, 2, seq).message(DataType::COMPACT_TRADE, compact_trade(7, 0), "", 3)
+                               .message(DataType::COMPACT_TRADE, compact_trade(7, 0)));
+    seq += 2;
+
+    // Nothing above stopped the receiver; only the three good messages reached the hub
+    deliver(trade(7));
+    auto stats = rx.stats();
+    CHECK(stats.malformed == 10 && stats.messages == 3);
+    std::vector<CompactTrade> got(16);
+    got.resize(compact->poll(got.data(), got.size()));
+    CHECK(got.size() == 3);
+    if (got.size() == 3) {
+        CHECK(std::strcmp(hub.symbols().name(got[0].symbol_id), "AAA") == 0);
+        CHECK(std::strcmp(hub.symbols().name(got[1].symbol_id), "BBB") == 0);
+        CHECK(got[2].symbol_id == got[0].symbol_id);
+    }
+    rx.stop();
+}
+
+} // namespace
+
+int main() {
+    test::run("round_trip", test_round_trip);
+    test::run("truncated_and_malformed_datagrams", test_truncated_and_malformed_datagrams);
+    return test::result();
+}
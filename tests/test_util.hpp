@@ -0,0 +1,52 @@
+// Minimal checks for the C++ tests: assert() is compiled out in Release builds (-DNDEBUG),
+// so failures are reported here and turned into a non-zero exit code for ctest.
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace test {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline void report(bool ok, const char* expr, const char* file, int line) {
+    if (!ok) {
+        std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+        ++failures();
+    }
+}
+
+// Polls cond until it holds or timeout_ms passes; returns the final value
+template <class Cond>
+bool eventually(Cond&& cond, int timeout_ms = 2000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Runs one test case and prints its name, so a failing CHECK can be traced to it
+template <class F>
+void run(const char* name, F&& f) {
+    int before = failures();
+    f();
+    std::printf("%-40s %s\n", name, failures() == before ? "ok" : "FAILED");
+}
+
+inline int result() {
+    return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace test
+
+#define CHECK(cond) ::test::report(static_cast<bool>(cond), #cond, __FILE__, __LINE__)